@@ -765,12 +765,14 @@ void fg_free(FilterGraph **pfg);
 int fg_transcode_step(FilterGraph *graph, InputStream **best_ist);
 
 /**
- * Get and encode new output from any of the filtergraphs, without causing
- * activity.
+ * Send a command to the filters of the specified filter graph, or queue it
+ * for the given time if time is not negative.
  *
- * @return  0 for success, <0 for severe errors
+ * @param all_filters send to all matching filters instead of only the first
+ *                    one supporting the command
  */
-int reap_filters(int flush);
+void fg_send_command(FilterGraph *fg, double time, const char *target,
+                     const char *command, const char *arg, int all_filters);
 
 int ffmpeg_parse_options(int argc, char **argv);
 
@@ -20,6 +20,7 @@
 #include <stdint.h>
 
 #include "ffmpeg.h"
+#include "thread_queue.h"
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
@@ -67,8 +68,66 @@ struct Encoder {
     uint64_t dup_warning;
 
     int opened;
+
+    pthread_t       thread;
+    /**
+     * Queue for sending frames from the main thread to the encoder thread.
+     *
+     * Finishing the queue flushes the encoder and terminates the thread.
+     */
+    ThreadQueue    *queue_in;
+    /**
+     * Queue for sending encoded packets from the encoder thread to the
+     * main thread, with the streams listed in EncQueueStream.
+     */
+    ThreadQueue    *queue_out;
+
+    // frame for sending data to the encoder thread
+    AVFrame        *frame;
+    // number of frames sent to the encoder thread for which the
+    // end-of-frame packet has not been received yet
+    int             frames_in_flight;
+};
+
+enum EncQueueStream {
+    // packets produced by the encoder
+    ENC_QUEUE_PACKETS,
+    // one empty packet for each frame that was fully processed
+    ENC_QUEUE_FRAME_DONE,
+
+    ENC_QUEUE_NB,
 };
 
+// data that is local to the encoder thread and not visible outside of it
+typedef struct EncThreadContext {
+    AVFrame         *frame;
+    AVPacket        *pkt;
+} EncThreadContext;
+
+/* Maximum number of frames queued to an encoder thread. The main thread
+ * waits for the oldest one to be encoded before sending more, so sending
+ * never blocks and the encoder output is never left unread for long. */
+#define ENC_FRAMES_IN_FLIGHT 8
+
+static int enc_thread_stop(Encoder *e)
+{
+    void *ret;
+
+    if (!e->queue_in)
+        return 0;
+
+    tq_send_finish(e->queue_in, 0);
+    for (int i = 0; i < ENC_QUEUE_NB; i++)
+        tq_receive_finish(e->queue_out, i);
+
+    pthread_join(e->thread, &ret);
+
+    tq_free(&e->queue_in);
+    tq_free(&e->queue_out);
+
+    return (intptr_t)ret;
+}
+
 void enc_free(Encoder **penc)
 {
     Encoder *enc = *penc;
@@ -76,6 +135,9 @@ void enc_free(Encoder **penc)
     if (!enc)
         return;
 
+    enc_thread_stop(enc);
+
+    av_frame_free(&enc->frame);
     av_frame_free(&enc->last_frame);
     av_frame_free(&enc->sq_frame);
 
@@ -100,6 +162,10 @@ int enc_alloc(Encoder **penc, const AVCodec *codec)
             goto fail;
     }
 
+    enc->frame = av_frame_alloc();
+    if (!enc->frame)
+        goto fail;
+
     enc->pkt = av_packet_alloc();
     if (!enc->pkt)
         goto fail;
@@ -188,6 +254,8 @@ static void set_encoder_id(OutputFile *of, OutputStream *ost)
                 AV_DICT_DONT_STRDUP_VAL | AV_DICT_DONT_OVERWRITE);
 }
 
+static int enc_thread_start(OutputStream *ost);
+
 int enc_open(OutputStream *ost, AVFrame *frame)
 {
     InputStream *ist = ost->ist;
@@ -462,6 +530,13 @@ int enc_open(OutputStream *ost, AVFrame *frame)
     if (ret < 0)
         return ret;
 
+    // subtitles are encoded synchronously on the main thread
+    if (enc->type == AVMEDIA_TYPE_VIDEO || enc->type == AVMEDIA_TYPE_AUDIO) {
+        ret = enc_thread_start(ost);
+        if (ret < 0)
+            return ret;
+    }
+
     return 0;
 }
 
@@ -691,34 +766,18 @@ static void update_video_stats(OutputStream *ost, const AVPacket *pkt, int write
     fprintf(vstats_file, "type= %c\n", av_get_picture_type_char(pict_type));
 }
 
-static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
+/* runs in the encoder thread */
+static int encode_frame(OutputStream *ost, EncThreadContext *et, AVFrame *frame)
 {
     Encoder            *e = ost->enc;
     AVCodecContext   *enc = ost->enc_ctx;
-    AVPacket         *pkt = e->pkt;
+    AVPacket         *pkt = et->pkt;
     const char *type_desc = av_get_media_type_string(enc->codec_type);
     const char    *action = frame ? "encode" : "flush";
     int ret;
 
-    if (frame) {
-        if (ost->enc_stats_pre.io)
-            enc_stats_write(ost, &ost->enc_stats_pre, frame, NULL,
-                            ost->frames_encoded);
-
-        ost->frames_encoded++;
-        ost->samples_encoded += frame->nb_samples;
-
-        if (debug_ts) {
-            av_log(ost, AV_LOG_INFO, "encoder <- type:%s "
-                   "frame_pts:%s frame_pts_time:%s time_base:%d/%d\n",
-                   type_desc,
-                   av_ts2str(frame->pts), av_ts2timestr(frame->pts, &enc->time_base),
-                   enc->time_base.num, enc->time_base.den);
-        }
-
-        if (frame->sample_aspect_ratio.num && !ost->frame_aspect_ratio.num)
-            enc->sample_aspect_ratio = frame->sample_aspect_ratio;
-    }
+    if (frame && frame->sample_aspect_ratio.num && !ost->frame_aspect_ratio.num)
+        enc->sample_aspect_ratio = frame->sample_aspect_ratio;
 
     update_benchmark(NULL);
 
@@ -744,44 +803,304 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
             av_assert0(frame); // should never happen during flushing
             return 0;
         } else if (ret == AVERROR_EOF) {
-            of_output_packet(of, ost, NULL);
             return ret;
         } else if (ret < 0) {
             av_log(ost, AV_LOG_ERROR, "%s encoding failed\n", type_desc);
             return ret;
         }
 
-        if (enc->codec_type == AVMEDIA_TYPE_VIDEO)
-            update_video_stats(ost, pkt, !!vstats_filename);
-        if (ost->enc_stats_post.io)
-            enc_stats_write(ost, &ost->enc_stats_post, NULL, pkt,
-                            e->packets_encoded);
+        ret = tq_send(e->queue_out, ENC_QUEUE_PACKETS, pkt);
+        if (ret < 0)
+            return ret;
+    }
+
+    av_assert0(0);
+}
+
+static void enc_thread_set_name(const OutputStream *ost)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "enc%d:%d:%s", ost->file_index, ost->index,
+             ost->enc_ctx->codec->name);
+    ff_thread_setname(name);
+}
+
+static void enc_thread_uninit(EncThreadContext *et)
+{
+    av_packet_free(&et->pkt);
+    av_frame_free(&et->frame);
+
+    memset(et, 0, sizeof(*et));
+}
+
+static int enc_thread_init(EncThreadContext *et)
+{
+    memset(et, 0, sizeof(*et));
+
+    et->frame = av_frame_alloc();
+    if (!et->frame)
+        goto fail;
+
+    et->pkt = av_packet_alloc();
+    if (!et->pkt)
+        goto fail;
+
+    return 0;
+
+fail:
+    enc_thread_uninit(et);
+    return AVERROR(ENOMEM);
+}
+
+static void *encoder_thread(void *arg)
+{
+    OutputStream *ost = arg;
+    Encoder         *e = ost->enc;
+    EncThreadContext et;
+    int ret = 0, input_status = 0;
+
+    ret = enc_thread_init(&et);
+    if (ret < 0)
+        goto finish;
+
+    enc_thread_set_name(ost);
+
+    while (!input_status) {
+        int dummy;
+
+        input_status = tq_receive(e->queue_in, &dummy, et.frame);
+        if (input_status < 0)
+            av_log(ost, AV_LOG_VERBOSE, "Encoder thread received EOF\n");
+
+        ret = encode_frame(ost, &et, input_status >= 0 ? et.frame : NULL);
+
+        av_frame_unref(et.frame);
+
+        if (ret == AVERROR_EOF) {
+            av_log(ost, AV_LOG_VERBOSE, "Encoder returned EOF, finishing\n");
+            break;
+        } else if (ret < 0) {
+            av_log(ost, AV_LOG_ERROR, "Error encoding a frame: %s\n",
+                   av_err2str(ret));
+            break;
+        }
+
+        // signal to the main thread that the entire frame was processed
+        av_packet_unref(et.pkt);
+        ret = tq_send(e->queue_out, ENC_QUEUE_FRAME_DONE, et.pkt);
+        if (ret < 0) {
+            if (ret != AVERROR_EOF)
+                av_log(ost, AV_LOG_ERROR, "Error communicating with the main thread\n");
+            break;
+        }
+    }
+
+    // EOF is normal thread termination
+    if (ret == AVERROR_EOF)
+        ret = 0;
+
+finish:
+    tq_receive_finish(e->queue_in, 0);
+    for (int i = 0; i < ENC_QUEUE_NB; i++)
+        tq_send_finish(e->queue_out, i);
+
+    enc_thread_uninit(&et);
+
+    av_log(ost, AV_LOG_VERBOSE, "Terminating encoder thread\n");
+
+    return (void*)(intptr_t)ret;
+}
+
+static int enc_thread_start(OutputStream *ost)
+{
+    Encoder *e = ost->enc;
+    ObjPool *op;
+    int ret = 0;
+
+    op = objpool_alloc_frames();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    e->queue_in = tq_alloc(1, ENC_FRAMES_IN_FLIGHT, op, frame_move);
+    if (!e->queue_in) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+
+    op = objpool_alloc_packets();
+    if (!op)
+        goto fail;
+
+    e->queue_out = tq_alloc(ENC_QUEUE_NB, 4 * ENC_FRAMES_IN_FLIGHT, op, pkt_move);
+    if (!e->queue_out) {
+        objpool_free(&op);
+        goto fail;
+    }
+
+    ret = pthread_create(&e->thread, NULL, encoder_thread, ost);
+    if (ret) {
+        ret = AVERROR(ret);
+        av_log(ost, AV_LOG_ERROR, "pthread_create() failed: %s\n",
+               av_err2str(ret));
+        goto fail;
+    }
+
+    return 0;
+fail:
+    if (ret >= 0)
+        ret = AVERROR(ENOMEM);
+
+    tq_free(&e->queue_in);
+    tq_free(&e->queue_out);
+    return ret;
+}
+
+static void output_packet(OutputFile *of, OutputStream *ost, AVPacket *pkt)
+{
+    Encoder            *e = ost->enc;
+    AVCodecContext   *enc = ost->enc_ctx;
+    const char *type_desc = av_get_media_type_string(enc->codec_type);
+    int ret;
+
+    if (enc->codec_type == AVMEDIA_TYPE_VIDEO)
+        update_video_stats(ost, pkt, !!vstats_filename);
+    if (ost->enc_stats_post.io)
+        enc_stats_write(ost, &ost->enc_stats_post, NULL, pkt,
+                        e->packets_encoded);
+
+    if (debug_ts) {
+        av_log(ost, AV_LOG_INFO, "encoder -> type:%s "
+               "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s "
+               "duration:%s duration_time:%s\n",
+               type_desc,
+               av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
+               av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base),
+               av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &enc->time_base));
+    }
+
+    if ((ret = trigger_fix_sub_duration_heartbeat(ost, pkt)) < 0) {
+        av_log(NULL, AV_LOG_ERROR,
+               "Subtitle heartbeat logic failed in %s! (%s)\n",
+               __func__, av_err2str(ret));
+        exit_program(1);
+    }
+
+    e->data_size += pkt->size;
+
+    e->packets_encoded++;
+
+    of_output_packet(of, ost, pkt);
+}
+
+/**
+ * Retrieve and mux the packets produced by the encoder thread.
+ *
+ * @param wait if set, return once the oldest frame in flight was fully
+ *             processed, otherwise only retrieve the packets that are
+ *             already available
+ * @return 0 on success, AVERROR_EOF when the encoder thread terminated
+ */
+static int receive_packets(OutputFile *of, OutputStream *ost, int wait)
+{
+    Encoder *e = ost->enc;
+    int ret;
+
+    while (1) {
+        int stream_idx;
+
+        ret = wait ? tq_receive        (e->queue_out, &stream_idx, e->pkt) :
+                     tq_receive_nonblock(e->queue_out, &stream_idx, e->pkt);
+        if (ret == AVERROR(EAGAIN))
+            return 0;
+        // the encoder thread finishes all the streams at once
+        if (ret < 0)
+            return ret;
+
+        if (stream_idx == ENC_QUEUE_FRAME_DONE) {
+            e->frames_in_flight--;
+            if (wait)
+                return 0;
+            continue;
+        }
+
+        output_packet(of, ost, e->pkt);
+        av_packet_unref(e->pkt);
+    }
+}
+
+static int enc_thread_send_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
+{
+    Encoder            *e = ost->enc;
+    AVCodecContext   *enc = ost->enc_ctx;
+    const char *type_desc = av_get_media_type_string(enc->codec_type);
+    int ret, thread_ret;
+
+    if (frame) {
+        if (ost->enc_stats_pre.io)
+            enc_stats_write(ost, &ost->enc_stats_pre, frame, NULL,
+                            ost->frames_encoded);
+
+        ost->frames_encoded++;
+        ost->samples_encoded += frame->nb_samples;
 
         if (debug_ts) {
-            av_log(ost, AV_LOG_INFO, "encoder -> type:%s "
-                   "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s "
-                   "duration:%s duration_time:%s\n",
+            av_log(ost, AV_LOG_INFO, "encoder <- type:%s "
+                   "frame_pts:%s frame_pts_time:%s time_base:%d/%d\n",
                    type_desc,
-                   av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
-                   av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base),
-                   av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &enc->time_base));
+                   av_ts2str(frame->pts), av_ts2timestr(frame->pts, &enc->time_base),
+                   enc->time_base.num, enc->time_base.den);
         }
+    }
 
-        if ((ret = trigger_fix_sub_duration_heartbeat(ost, pkt)) < 0) {
-            av_log(NULL, AV_LOG_ERROR,
-                   "Subtitle heartbeat logic failed in %s! (%s)\n",
-                   __func__, av_err2str(ret));
-            exit_program(1);
+    // thread already joined
+    if (!e->queue_in)
+        return AVERROR_EOF;
+
+    if (frame) {
+        // mux the packets that are ready, then wait for the oldest frame
+        // if needed, so that sending cannot block
+        ret = receive_packets(of, ost, 0);
+        if (ret < 0)
+            goto finish;
+        while (e->frames_in_flight >= ENC_FRAMES_IN_FLIGHT) {
+            ret = receive_packets(of, ost, 1);
+            if (ret < 0)
+                goto finish;
         }
 
-        e->data_size += pkt->size;
+        ret = av_frame_ref(e->frame, frame);
+        if (ret < 0)
+            goto finish;
 
-        e->packets_encoded++;
+        ret = tq_send(e->queue_in, 0, e->frame);
+        if (ret < 0) {
+            av_frame_unref(e->frame);
+            goto finish;
+        }
+        e->frames_in_flight++;
 
-        of_output_packet(of, ost, pkt);
+        return 0;
     }
 
-    av_assert0(0);
+    // flush the encoder and retrieve everything it still has
+    tq_send_finish(e->queue_in, 0);
+    do {
+        ret = receive_packets(of, ost, 1);
+    } while (ret >= 0);
+
+finish:
+    thread_ret = enc_thread_stop(e);
+    if (thread_ret < 0) {
+        av_log(ost, AV_LOG_ERROR, "Encoder thread returned error: %s\n",
+               av_err2str(thread_ret));
+        ret = err_merge(ret, thread_ret);
+    }
+    e->frames_in_flight = 0;
+
+    if (ret == AVERROR_EOF)
+        of_output_packet(of, ost, NULL);
+
+    return ret;
 }
 
 static int submit_encode_frame(OutputFile *of, OutputStream *ost,
@@ -791,7 +1110,7 @@ static int submit_encode_frame(OutputFile *of, OutputStream *ost,
     int ret;
 
     if (ost->sq_idx_encode < 0)
-        return encode_frame(of, ost, frame);
+        return enc_thread_send_frame(of, ost, frame);
 
     if (frame) {
         ret = av_frame_ref(e->sq_frame, frame);
@@ -820,7 +1139,7 @@ static int submit_encode_frame(OutputFile *of, OutputStream *ost,
             return (ret == AVERROR(EAGAIN)) ? 0 : ret;
         }
 
-        ret = encode_frame(of, ost, enc_frame);
+        ret = enc_thread_send_frame(of, ost, enc_frame);
         if (enc_frame)
             av_frame_unref(enc_frame);
         if (ret < 0) {
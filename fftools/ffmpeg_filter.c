@@ -38,6 +38,39 @@
 #include "libavutil/samplefmt.h"
 #include "libavutil/timestamp.h"
 
+#include "thread_queue.h"
+
+/* Requests and notifications sent to the filtering thread. They are carried
+ * in frames without data, with the type stored in AVFrame.opaque. */
+enum FrameOpaque {
+    FRAME_OPAQUE_CHOOSE_INPUT = 1,
+    FRAME_OPAQUE_SUB_HEARTBEAT,
+    FRAME_OPAQUE_EOF,
+    FRAME_OPAQUE_SEND_COMMAND,
+};
+
+/* Reply to FRAME_OPAQUE_CHOOSE_INPUT, carried in the data of an empty frame
+ * sent on the last stream of the output queue. */
+typedef struct ChooseInputReply {
+    // avfilter_graph_request_oldest() return value, or 1 when the graph is
+    // not configured yet
+    int  ret;
+    // first input still lacking parameters when the graph is not configured,
+    // -1 if there is none
+    int  best_input;
+    // failed requests on each input, -1 for inputs that reached EOF
+    int *nb_failed_requests;
+} ChooseInputReply;
+
+typedef struct FilterCommand {
+    char *target;
+    char *command;
+    char *arg;
+
+    double time;
+    int    all_filters;
+} FilterCommand;
+
 typedef struct FilterGraphPriv {
     FilterGraph fg;
 
@@ -54,6 +87,27 @@ typedef struct FilterGraphPriv {
 
     // frame for temporarily holding output from the filtergraph
     AVFrame *frame;
+    // frame used by the main thread for talking to the filtering thread
+    AVFrame *frame_main;
+
+    int             thread_started;
+    pthread_t       thread;
+    /**
+     * Queue for sending frames from the main thread to the filtering thread.
+     * Stream i carries input i, stream nb_inputs carries requests.
+     */
+    ThreadQueue    *queue_in;
+    /**
+     * Queue for sending filtered frames to the main thread. Stream i carries
+     * output i, stream nb_outputs carries the replies to requests.
+     */
+    ThreadQueue    *queue_out;
+
+    // set by the main thread while a FRAME_OPAQUE_CHOOSE_INPUT request
+    // has not been answered
+    int             choose_input_pending;
+    // the last reply to FRAME_OPAQUE_CHOOSE_INPUT, owned by the main thread
+    AVFrame        *choose_input_reply;
 } FilterGraphPriv;
 
 static FilterGraphPriv *fgp_from_fg(FilterGraph *fg)
@@ -69,6 +123,9 @@ static const FilterGraphPriv *cfgp_from_cfg(const FilterGraph *fg)
 typedef struct InputFilterPriv {
     InputFilter ifilter;
 
+    // index of this input in the filtergraph
+    int index;
+
     AVFilterContext *filter;
 
     InputStream *ist;
@@ -88,6 +145,11 @@ typedef struct InputFilterPriv {
 
     int eof;
 
+    // input stream frame rates, copied when binding the input stream since
+    // the filtering thread must not access the InputStream
+    AVRational framerate;
+    AVRational framerate_guessed;
+
     // parameters configured for this input
     int format;
 
@@ -154,6 +216,16 @@ typedef struct OutputFilterPriv {
     const AVChannelLayout *ch_layouts;
     const int *sample_rates;
 
+    // pixel formats to convert to, chosen when binding the output stream
+    char *pix_fmts;
+    // filtergraph threads requested in the encoder options, copied when
+    // binding the output stream
+    char *nb_threads;
+
+    // frames taken out of the filtergraph before reconfiguring it, to be
+    // passed to the main thread with the next request
+    AVFifo *frame_queue;
+
     // set to 1 after at least one frame passed through this output
     int got_frame;
 } OutputFilterPriv;
@@ -164,6 +236,7 @@ static OutputFilterPriv *ofp_from_ofilter(OutputFilter *ofilter)
 }
 
 static int configure_filtergraph(FilterGraph *fg);
+static int fg_thread_stop(FilterGraph *fg);
 
 static int sub2video_get_blank_frame(InputFilterPriv *ifp)
 {
@@ -618,6 +691,10 @@ static OutputFilter *ofilter_alloc(FilterGraph *fg)
     ofp->format       = -1;
     ofilter->last_pts = AV_NOPTS_VALUE;
 
+    ofp->frame_queue = av_fifo_alloc2(8, sizeof(AVFrame*), AV_FIFO_FLAG_AUTO_GROW);
+    if (!ofp->frame_queue)
+        report_and_exit(AVERROR(ENOMEM));
+
     return ofilter;
 }
 
@@ -628,8 +705,10 @@ static int ifilter_bind_ist(InputFilter *ifilter, InputStream *ist)
 
     av_assert0(!ifp->ist);
 
-    ifp->ist             = ist;
-    ifp->type_src        = ist->st->codecpar->codec_type;
+    ifp->ist               = ist;
+    ifp->type_src          = ist->st->codecpar->codec_type;
+    ifp->framerate         = ist->framerate;
+    ifp->framerate_guessed = ist->framerate_guessed;
 
     ret = ist_filter_add(ist, ifilter, filtergraph_is_simple(ifilter->graph));
     if (ret < 0)
@@ -688,14 +767,26 @@ void ofilter_bind_ost(OutputFilter *ofilter, OutputStream *ost)
     FilterGraph  *fg = ofilter->graph;
     FilterGraphPriv *fgp = fgp_from_fg(fg);
     const AVCodec *c = ost->enc_ctx->codec;
+    const AVDictionaryEntry *e;
 
     av_assert0(!ofilter->ost);
 
     ofilter->ost = ost;
     av_freep(&ofilter->linklabel);
 
+    // the encoder options are consumed when opening the encoder
+    e = av_dict_get(ost->encoder_opts, "threads", NULL, 0);
+    if (e) {
+        ofp->nb_threads = av_strdup(e->value);
+        if (!ofp->nb_threads)
+            report_and_exit(AVERROR(ENOMEM));
+    }
+
     switch (ost->enc_ctx->codec_type) {
-    case AVMEDIA_TYPE_VIDEO:
+    case AVMEDIA_TYPE_VIDEO: {
+        AVBPrint bprint;
+        const char *pix_fmts;
+
         ofp->width      = ost->enc_ctx->width;
         ofp->height     = ost->enc_ctx->height;
         if (ost->enc_ctx->pix_fmt != AV_PIX_FMT_NONE) {
@@ -704,9 +795,21 @@ void ofilter_bind_ost(OutputFilter *ofilter, OutputStream *ost)
             ofp->formats = c->pix_fmts;
         }
 
+        // the encoder context must not be accessed from the filtering
+        // thread, so choose the formats here
+        av_bprint_init(&bprint, 0, AV_BPRINT_SIZE_UNLIMITED);
+        pix_fmts = choose_pix_fmts(ofilter, &bprint);
+        if (pix_fmts) {
+            ofp->pix_fmts = av_strdup(pix_fmts);
+            if (!ofp->pix_fmts)
+                report_and_exit(AVERROR(ENOMEM));
+        }
+        av_bprint_finalize(&bprint, NULL);
+
         fgp->disable_conversions |= ost->keep_pix_fmt;
 
         break;
+        }
     case AVMEDIA_TYPE_AUDIO:
         if (ost->enc_ctx->sample_fmt != AV_SAMPLE_FMT_NONE) {
             ofp->format = ost->enc_ctx->sample_fmt;
@@ -751,6 +854,7 @@ static InputFilter *ifilter_alloc(FilterGraph *fg)
     InputFilter *ifilter = &ifp->ifilter;
 
     ifilter->graph  = fg;
+    ifp->index      = fg->nb_inputs - 1;
 
     ifp->frame = av_frame_alloc();
     if (!ifp->frame)
@@ -770,11 +874,17 @@ void fg_free(FilterGraph **pfg)
 {
     FilterGraph *fg = *pfg;
     FilterGraphPriv *fgp;
+    int ret;
 
     if (!fg)
         return;
     fgp = fgp_from_fg(fg);
 
+    ret = fg_thread_stop(fg);
+    if (ret < 0)
+        av_log(fg, AV_LOG_ERROR, "Filtering thread returned error: %s\n",
+               av_err2str(ret));
+
     avfilter_graph_free(&fg->graph);
     for (int j = 0; j < fg->nb_inputs; j++) {
         InputFilter *ifilter = fg->inputs[j];
@@ -802,8 +912,17 @@ void fg_free(FilterGraph **pfg)
         OutputFilter *ofilter = fg->outputs[j];
         OutputFilterPriv *ofp = ofp_from_ofilter(ofilter);
 
+        if (ofp->frame_queue) {
+            AVFrame *frame;
+            while (av_fifo_read(ofp->frame_queue, &frame, 1) >= 0)
+                av_frame_free(&frame);
+            av_fifo_freep2(&ofp->frame_queue);
+        }
+
         av_freep(&ofilter->linklabel);
         av_freep(&ofilter->name);
+        av_freep(&ofp->pix_fmts);
+        av_freep(&ofp->nb_threads);
         av_channel_layout_uninit(&ofp->ch_layout);
         av_freep(&fg->outputs[j]);
     }
@@ -811,6 +930,8 @@ void fg_free(FilterGraph **pfg)
     av_freep(&fgp->graph_desc);
 
     av_frame_free(&fgp->frame);
+    av_frame_free(&fgp->frame_main);
+    av_frame_free(&fgp->choose_input_reply);
 
     av_freep(pfg);
 }
@@ -845,8 +966,10 @@ FilterGraph *fg_create(char *graph_desc)
 
     snprintf(fgp->log_name, sizeof(fgp->log_name), "fc#%d", fg->index);
 
-    fgp->frame = av_frame_alloc();
-    if (!fgp->frame)
+    fgp->frame              = av_frame_alloc();
+    fgp->frame_main         = av_frame_alloc();
+    fgp->choose_input_reply = av_frame_alloc();
+    if (!fgp->frame || !fgp->frame_main || !fgp->choose_input_reply)
         report_and_exit(AVERROR(ENOMEM));
 
     /* this graph is only used for determining the kinds of inputs
@@ -1089,10 +1212,8 @@ static int configure_output_video_filter(FilterGraph *fg, OutputFilter *ofilter,
     OutputStream *ost = ofilter->ost;
     OutputFile    *of = output_files[ost->file_index];
     AVFilterContext *last_filter = out->filter_ctx;
-    AVBPrint bprint;
     int pad_idx = out->pad_idx;
     int ret;
-    const char *pix_fmts;
     char name[255];
 
     snprintf(name, sizeof(name), "out_%d_%d", ost->file_index, ost->index);
@@ -1127,14 +1248,12 @@ static int configure_output_video_filter(FilterGraph *fg, OutputFilter *ofilter,
         pad_idx = 0;
     }
 
-    av_bprint_init(&bprint, 0, AV_BPRINT_SIZE_UNLIMITED);
-    if ((pix_fmts = choose_pix_fmts(ofilter, &bprint))) {
+    if (ofp->pix_fmts) {
         AVFilterContext *filter;
 
         ret = avfilter_graph_create_filter(&filter,
                                            avfilter_get_by_name("format"),
-                                           "format", pix_fmts, NULL, fg->graph);
-        av_bprint_finalize(&bprint, NULL);
+                                           "format", ofp->pix_fmts, NULL, fg->graph);
         if (ret < 0)
             return ret;
         if ((ret = avfilter_link(last_filter, pad_idx, filter, 0)) < 0)
@@ -1243,7 +1362,7 @@ static int configure_output_audio_filter(FilterGraph *fg, OutputFilter *ofilter,
         int i;
 
         for (i = 0; i < of->nb_streams; i++)
-            if (of->streams[i]->st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+            if (of->streams[i]->type == AVMEDIA_TYPE_VIDEO)
                 break;
 
         if (i < of->nb_streams) {
@@ -1318,7 +1437,7 @@ static int configure_input_video_filter(FilterGraph *fg, InputFilter *ifilter,
     const AVPixFmtDescriptor *desc;
     InputStream *ist = ifp->ist;
     InputFile     *f = input_files[ist->file_index];
-    AVRational fr = ist->framerate;
+    AVRational fr = ifp->framerate;
     AVRational sar;
     AVBPrint args;
     char name[255];
@@ -1338,12 +1457,12 @@ static int configure_input_video_filter(FilterGraph *fg, InputFilter *ifilter,
     }
 
     if (!fr.num)
-        fr = ist->framerate_guessed;
+        fr = ifp->framerate_guessed;
 
     if (ifp->type_src == AVMEDIA_TYPE_SUBTITLE)
         sub2video_prepare(ifp);
 
-    ifp->time_base =  ist->framerate.num ? av_inv_q(ist->framerate) :
+    ifp->time_base =  ifp->framerate.num ? av_inv_q(ifp->framerate) :
                                            ist->st->time_base;
 
     sar = ifp->sample_aspect_ratio;
@@ -1549,17 +1668,15 @@ static int configure_filtergraph(FilterGraph *fg)
         return AVERROR(ENOMEM);
 
     if (simple) {
-        OutputStream *ost = fg->outputs[0]->ost;
+        OutputFilterPriv *ofp = ofp_from_ofilter(fg->outputs[0]);
+        OutputStream     *ost = fg->outputs[0]->ost;
 
         if (filter_nbthreads) {
             ret = av_opt_set(fg->graph, "threads", filter_nbthreads, 0);
             if (ret < 0)
                 goto fail;
-        } else {
-            const AVDictionaryEntry *e = NULL;
-            e = av_dict_get(ost->encoder_opts, "threads", NULL, 0);
-            if (e)
-                av_opt_set(fg->graph, "threads", e->value, 0);
+        } else if (ofp->nb_threads) {
+            av_opt_set(fg->graph, "threads", ofp->nb_threads, 0);
         }
 
         if (av_dict_count(ost->sws_dict)) {
@@ -1729,23 +1846,33 @@ int filtergraph_is_simple(const FilterGraph *fg)
     return fgp->is_simple;
 }
 
-int reap_filters(int flush)
+/* Take the frames available in the buffersinks. They are passed to the main
+ * thread, or kept in the per-output queues if the main thread is not
+ * waiting for a request to be processed. */
+static int read_frames(FilterGraph *fg, int flush, int queue)
 {
-    /* Reap all buffers present in the buffer sinks */
-    for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
-        OutputFilterPriv *ofp;
-        FilterGraphPriv *fgp;
-        AVFrame *filtered_frame;
-        AVFilterContext *filter;
-        int ret = 0;
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    AVFrame *filtered_frame = fgp->frame;
+    int ret;
 
-        if (!ost->filter || !ost->filter->graph->graph)
-            continue;
-        fgp    = fgp_from_fg(ost->filter->graph);
-        ofp    = ofp_from_ofilter(ost->filter);
-        filter = ofp->filter;
+    for (int i = 0; i < fg->nb_outputs; i++) {
+        OutputFilter *ofilter = fg->outputs[i];
+        OutputFilterPriv *ofp = ofp_from_ofilter(ofilter);
+        AVFilterContext *filter = ofp->filter;
+
+        if (!queue) {
+            AVFrame *tmp;
+
+            while (av_fifo_read(ofp->frame_queue, &tmp, 1) >= 0) {
+                ret = tq_send(fgp->queue_out, i, tmp);
+                av_frame_free(&tmp);
+                if (ret < 0)
+                    return ret;
+            }
+        }
 
-        filtered_frame = fgp->frame;
+        if (!filter)
+            continue;
 
         while (1) {
             FrameData *fd;
@@ -1757,20 +1884,18 @@ int reap_filters(int flush)
                     av_log(fgp, AV_LOG_WARNING,
                            "Error in av_buffersink_get_frame_flags(): %s\n", av_err2str(ret));
                 } else if (flush && ret == AVERROR_EOF && ofp->got_frame &&
-                           av_buffersink_get_type(filter) == AVMEDIA_TYPE_VIDEO)
-                    enc_frame(ost, NULL);
+                           av_buffersink_get_type(filter) == AVMEDIA_TYPE_VIDEO) {
+                    // an empty frame without parameters flushes the encoder
+                    ret = tq_send(fgp->queue_out, i, filtered_frame);
+                    if (ret < 0)
+                        return ret;
+                }
 
                 break;
             }
-            if (ost->finished) {
-                av_frame_unref(filtered_frame);
-                continue;
-            }
 
             if (filtered_frame->pts != AV_NOPTS_VALUE) {
                 AVRational tb = av_buffersink_get_time_base(filter);
-                ost->filter->last_pts = av_rescale_q(filtered_frame->pts, tb,
-                                                     AV_TIME_BASE_Q);
                 filtered_frame->time_base = tb;
 
                 if (debug_ts)
@@ -1783,7 +1908,7 @@ int reap_filters(int flush)
             fd = frame_data(filtered_frame);
             if (!fd) {
                 av_frame_unref(filtered_frame);
-                report_and_exit(AVERROR(ENOMEM));
+                return AVERROR(ENOMEM);
             }
 
             // only use bits_per_raw_sample passed through from the decoder
@@ -1791,19 +1916,38 @@ int reap_filters(int flush)
             if (!fgp->is_meta)
                 fd->bits_per_raw_sample = 0;
 
-            if (ost->type == AVMEDIA_TYPE_VIDEO)
+            if (ofilter->type == AVMEDIA_TYPE_VIDEO)
                 fd->frame_rate_filter = av_buffersink_get_frame_rate(filter);
 
-            enc_frame(ost, filtered_frame);
-            av_frame_unref(filtered_frame);
             ofp->got_frame = 1;
+
+            if (queue) {
+                AVFrame *tmp = av_frame_alloc();
+                if (!tmp) {
+                    av_frame_unref(filtered_frame);
+                    return AVERROR(ENOMEM);
+                }
+                av_frame_move_ref(tmp, filtered_frame);
+
+                ret = av_fifo_write(ofp->frame_queue, &tmp, 1);
+                if (ret < 0) {
+                    av_frame_free(&tmp);
+                    return ret;
+                }
+            } else {
+                ret = tq_send(fgp->queue_out, i, filtered_frame);
+                if (ret < 0) {
+                    av_frame_unref(filtered_frame);
+                    return ret;
+                }
+            }
         }
     }
 
     return 0;
 }
 
-void ifilter_sub2video_heartbeat(InputFilter *ifilter, int64_t pts, AVRational tb)
+static void sub2video_heartbeat(InputFilter *ifilter, int64_t pts, AVRational tb)
 {
     InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
     int64_t pts2;
@@ -1829,7 +1973,7 @@ void ifilter_sub2video_heartbeat(InputFilter *ifilter, int64_t pts, AVRational t
         sub2video_push_ref(ifp, pts2);
 }
 
-int ifilter_sub2video(InputFilter *ifilter, const AVFrame *frame)
+static int sub2video_frame(InputFilter *ifilter, const AVFrame *frame)
 {
     InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
     int ret;
@@ -1862,7 +2006,7 @@ int ifilter_sub2video(InputFilter *ifilter, const AVFrame *frame)
     return 0;
 }
 
-int ifilter_send_eof(InputFilter *ifilter, int64_t pts, AVRational tb)
+static int send_eof(InputFilter *ifilter, int64_t pts, AVRational tb)
 {
     InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
     int ret;
@@ -1910,10 +2054,9 @@ int ifilter_send_eof(InputFilter *ifilter, int64_t pts, AVRational tb)
     return 0;
 }
 
-int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
+static int send_frame(FilterGraph *fg, InputFilter *ifilter, AVFrame *frame)
 {
     InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
-    FilterGraph *fg = ifilter->graph;
     AVFrameSideData *sd;
     int need_reinit, ret;
 
@@ -1965,8 +2108,8 @@ int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
             return ret;
         }
 
-        ret = reap_filters(0);
-        if (ret < 0 && ret != AVERROR_EOF) {
+        ret = read_frames(fg, 0, 1);
+        if (ret < 0) {
             av_log(fg, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
             return ret;
         }
@@ -1978,14 +2121,6 @@ int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
         }
     }
 
-    if (keep_reference) {
-        ret = av_frame_ref(ifp->frame, frame);
-        if (ret < 0)
-            return ret;
-    } else
-        av_frame_move_ref(ifp->frame, frame);
-    frame = ifp->frame;
-
     frame->pts       = av_rescale_q(frame->pts,      frame->time_base, ifp->time_base);
     frame->duration  = av_rescale_q(frame->duration, frame->time_base, ifp->time_base);
     frame->time_base = ifp->time_base;
@@ -2007,85 +2142,530 @@ int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
     return 0;
 }
 
-int fg_transcode_step(FilterGraph *graph, InputStream **best_ist)
+static int choose_input(FilterGraph *fg)
 {
-    FilterGraphPriv *fgp = fgp_from_fg(graph);
-    int i, ret;
-    int nb_requests, nb_requests_max = 0;
-    InputStream *ist;
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    AVFrame       *frame = fgp->frame;
+    ChooseInputReply *reply;
+    AVBufferRef *buf;
+    int ret;
 
-    if (!graph->graph) {
-        for (int i = 0; i < graph->nb_inputs; i++) {
-            InputFilter *ifilter = graph->inputs[i];
-            InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
+    // the failed request counts are stored right after the reply
+    buf = av_buffer_allocz(sizeof(*reply) +
+                           fg->nb_inputs * sizeof(*reply->nb_failed_requests));
+    if (!buf)
+        return AVERROR(ENOMEM);
+    reply = (ChooseInputReply*)buf->data;
+    reply->nb_failed_requests = (int*)(reply + 1);
+    reply->best_input         = -1;
+
+    if (!fg->graph) {
+        for (int i = 0; i < fg->nb_inputs; i++) {
+            InputFilterPriv *ifp = ifp_from_ifilter(fg->inputs[i]);
             if (ifp->format < 0 && !ifp->eof) {
-                *best_ist = ifp->ist;
-                return 0;
+                reply->best_input = i;
+                break;
             }
         }
+        reply->ret = 1;
+        goto reply;
+    }
 
-        // graph not configured, but all inputs are either initialized or EOF
-        for (int i = 0; i < graph->nb_outputs; i++)
-            graph->outputs[i]->ost->inputs_done = 1;
+    ret = avfilter_graph_request_oldest(fg->graph);
+    reply->ret = ret;
+
+    if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+        goto reply;
+
+    ret = read_frames(fg, ret == AVERROR_EOF, 0);
+    if (ret < 0)
+        goto fail;
+
+    if (reply->ret == AVERROR(EAGAIN)) {
+        for (int i = 0; i < fg->nb_inputs; i++) {
+            InputFilterPriv *ifp = ifp_from_ifilter(fg->inputs[i]);
+            reply->nb_failed_requests[i] = ifp->eof ? -1 :
+                av_buffersrc_get_nb_failed_requests(ifp->filter);
+        }
+    } else if (reply->ret == AVERROR_EOF) {
+        for (int i = 0; i < fg->nb_outputs; i++) {
+            OutputFilterPriv *ofp = ofp_from_ofilter(fg->outputs[i]);
+
+            if (ofp->got_frame)
+                continue;
+
+            // we are finished and no frames were ever seen at this output,
+            // send the output parameters so that the encoder can at least
+            // be initialized
+            frame->time_base   = ofp->time_base;
+            frame->format      = ofp->format;
+
+            frame->width               = ofp->width;
+            frame->height              = ofp->height;
+            frame->sample_aspect_ratio = ofp->sample_aspect_ratio;
+
+            frame->sample_rate = ofp->sample_rate;
+            if (ofp->ch_layout.nb_channels) {
+                ret = av_channel_layout_copy(&frame->ch_layout, &ofp->ch_layout);
+                if (ret < 0)
+                    goto fail;
+            }
+
+            av_assert0(!frame->buf[0]);
+
+            ret = tq_send(fgp->queue_out, i, frame);
+            if (ret < 0) {
+                av_frame_unref(frame);
+                goto fail;
+            }
+        }
+    }
+
+reply:
+    frame->buf[0] = buf;
+    return tq_send(fgp->queue_out, fg->nb_outputs, frame);
+fail:
+    av_buffer_unref(&buf);
+    return ret;
+}
+
+static void send_command(FilterGraph *fg, const FilterCommand *fc)
+{
+    char buf[4096];
+    int ret;
 
+    if (!fg->graph)
+        return;
+
+    if (fc->time < 0) {
+        ret = avfilter_graph_send_command(fg->graph, fc->target, fc->command, fc->arg,
+                                          buf, sizeof(buf),
+                                          fc->all_filters ? 0 : AVFILTER_CMD_FLAG_ONE);
+        fprintf(stderr, "Command reply for stream %d: ret:%d res:\n%s", fg->index, ret, buf);
+    } else if (!fc->all_filters) {
+        fprintf(stderr, "Queuing commands only on filters supporting the specific command is unsupported\n");
+    } else {
+        ret = avfilter_graph_queue_command(fg->graph, fc->target, fc->command, fc->arg, 0, fc->time);
+        if (ret < 0)
+            fprintf(stderr, "Queuing command failed with error %s\n", av_err2str(ret));
+    }
+}
+
+static int filter_input(FilterGraph *fg, InputFilter *ifilter, AVFrame *frame)
+{
+    InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
+    int ret;
+
+    if (frame->buf[0]) {
+        if (ifp->type_src == AVMEDIA_TYPE_SUBTITLE) {
+            ret = sub2video_frame(ifilter, frame);
+            if (ret < 0)
+                av_log(fg, AV_LOG_ERROR, "Error sending a subtitle for filtering: %s\n",
+                       av_err2str(ret));
+            return ret;
+        }
+
+        ret = send_frame(fg, ifilter, frame);
+        // a closed input is not an error, the frame is just dropped
+        return ret == AVERROR_EOF ? 0 : ret;
+    }
+
+    switch ((intptr_t)frame->opaque) {
+    case FRAME_OPAQUE_SUB_HEARTBEAT:
+        sub2video_heartbeat(ifilter, frame->pts, frame->time_base);
         return 0;
+    case FRAME_OPAQUE_EOF:
+        if (ifp->type_src == AVMEDIA_TYPE_SUBTITLE) {
+            ret = sub2video_frame(ifilter, NULL);
+            if (ret != AVERROR_EOF && ret < 0)
+                av_log(fg, AV_LOG_WARNING, "Flush the frame error.\n");
+            return 0;
+        }
+
+        ret = send_eof(ifilter, frame->pts, frame->time_base);
+        if (ret < 0)
+            av_log(fg, AV_LOG_FATAL, "Error marking filters as finished\n");
+        return ret;
+    default:
+        av_assert0(0);
+        return AVERROR_BUG;
     }
+}
 
-    *best_ist = NULL;
-    ret = avfilter_graph_request_oldest(graph->graph);
+static void *filter_thread(void *arg)
+{
+    FilterGraph     *fg = arg;
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    AVFrame *frame;
+    int ret = 0;
+
+    frame = av_frame_alloc();
+    if (!frame) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    ff_thread_setname(fgp->log_name);
+
+    while (1) {
+        int idx;
+
+        ret = tq_receive(fgp->queue_in, &idx, frame);
+        if (ret < 0) {
+            // the main thread finishes all the streams at once,
+            // keep going until the EOF for all of them
+            if (ret == AVERROR_EOF && idx >= 0)
+                continue;
+            break;
+        }
+
+        if (idx < fg->nb_inputs) {
+            ret = filter_input(fg, fg->inputs[idx], frame);
+        } else if ((intptr_t)frame->opaque == FRAME_OPAQUE_CHOOSE_INPUT) {
+            ret = choose_input(fg);
+        } else {
+            av_assert0((intptr_t)frame->opaque == FRAME_OPAQUE_SEND_COMMAND);
+            send_command(fg, (const FilterCommand*)frame->buf[0]->data);
+        }
+        av_frame_unref(frame);
+        if (ret < 0)
+            break;
+    }
+
+    // EOF is normal thread termination
+    if (ret == AVERROR_EOF)
+        ret = 0;
+
+finish:
+    for (int i = 0; i <= fg->nb_inputs; i++)
+        tq_receive_finish(fgp->queue_in, i);
+    for (int i = 0; i <= fg->nb_outputs; i++)
+        tq_send_finish(fgp->queue_out, i);
+
+    av_frame_free(&frame);
+
+    av_log(fg, AV_LOG_VERBOSE, "Terminating filtering thread\n");
+
+    return (void*)(intptr_t)ret;
+}
+
+static int fg_thread_start(FilterGraph *fg)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    ObjPool *op;
+    int ret = 0;
+
+    // the thread is only started once, it may have already terminated
+    if (fgp->thread_started)
+        return fgp->queue_in ? 0 : AVERROR_EOF;
+    fgp->thread_started = 1;
+
+    op = objpool_alloc_frames();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    fgp->queue_in = tq_alloc(fg->nb_inputs + 1, 8, op, frame_move);
+    if (!fgp->queue_in) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+
+    op = objpool_alloc_frames();
+    if (!op)
+        goto fail;
+
+    /* The main thread does not read the filtered frames while it sends input
+     * to the filtering thread, so this queue must not block the latter. It
+     * only holds the output of a single request. */
+    fgp->queue_out = tq_alloc(fg->nb_outputs + 1, 0, op, frame_move);
+    if (!fgp->queue_out) {
+        objpool_free(&op);
+        goto fail;
+    }
+
+    ret = pthread_create(&fgp->thread, NULL, filter_thread, fg);
+    if (ret) {
+        ret = AVERROR(ret);
+        av_log(fg, AV_LOG_ERROR, "pthread_create() failed: %s\n",
+               av_err2str(ret));
+        goto fail;
+    }
+
+    return 0;
+fail:
     if (ret >= 0)
-        return reap_filters(0);
+        ret = AVERROR(ENOMEM);
 
-    if (ret == AVERROR_EOF) {
-        reap_filters(1);
-        for (int i = 0; i < graph->nb_outputs; i++) {
-            OutputFilter *ofilter = graph->outputs[i];
-            OutputFilterPriv *ofp = ofp_from_ofilter(ofilter);
+    tq_free(&fgp->queue_in);
+    tq_free(&fgp->queue_out);
+    return ret;
+}
 
-            // we are finished and no frames were ever seen at this output,
-            // at least initialize the encoder with a dummy frame
-            if (!ofp->got_frame) {
-                AVFrame *frame = fgp->frame;
+static int fg_thread_stop(FilterGraph *fg)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    void *ret;
 
-                frame->time_base   = ofp->time_base;
-                frame->format      = ofp->format;
+    if (!fgp->queue_in)
+        return 0;
 
-                frame->width               = ofp->width;
-                frame->height              = ofp->height;
-                frame->sample_aspect_ratio = ofp->sample_aspect_ratio;
+    for (int i = 0; i <= fg->nb_inputs; i++)
+        tq_send_finish(fgp->queue_in, i);
+    for (int i = 0; i <= fg->nb_outputs; i++)
+        tq_receive_finish(fgp->queue_out, i);
 
-                frame->sample_rate = ofp->sample_rate;
-                if (ofp->ch_layout.nb_channels) {
-                    ret = av_channel_layout_copy(&frame->ch_layout, &ofp->ch_layout);
-                    if (ret < 0)
-                        return ret;
-                }
+    pthread_join(fgp->thread, &ret);
 
-                av_assert0(!frame->buf[0]);
+    tq_free(&fgp->queue_in);
+    tq_free(&fgp->queue_out);
 
-                av_log(ofilter->ost, AV_LOG_WARNING,
-                       "No filtered frames for output stream, trying to "
-                       "initialize anyway.\n");
+    return (intptr_t)ret;
+}
 
-                enc_open(ofilter->ost, frame);
-                av_frame_unref(frame);
-            }
+/* Send a frame or request to the filtering thread, starting it if needed.
+ * The frame is always consumed. */
+static int fg_send(FilterGraph *fg, int stream_idx, AVFrame *frame)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    int ret;
+
+    ret = fg_thread_start(fg);
+    if (ret >= 0)
+        ret = tq_send(fgp->queue_in, stream_idx, frame);
+    if (ret < 0)
+        av_frame_unref(frame);
+
+    return ret;
+}
+
+void ifilter_sub2video_heartbeat(InputFilter *ifilter, int64_t pts, AVRational tb)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(ifilter->graph);
+    InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
+    AVFrame       *frame = fgp->frame_main;
+
+    frame->pts       = pts;
+    frame->time_base = tb;
+    frame->opaque    = (void*)(intptr_t)FRAME_OPAQUE_SUB_HEARTBEAT;
+
+    fg_send(ifilter->graph, ifp->index, frame);
+}
+
+int ifilter_sub2video(InputFilter *ifilter, const AVFrame *frame)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(ifilter->graph);
+    InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
+    int ret;
+
+    if (frame) {
+        ret = av_frame_ref(ifp->frame, frame);
+        if (ret < 0)
+            return ret;
+
+        ret = fg_send(ifilter->graph, ifp->index, ifp->frame);
+    } else {
+        fgp->frame_main->opaque = (void*)(intptr_t)FRAME_OPAQUE_EOF;
+
+        ret = fg_send(ifilter->graph, ifp->index, fgp->frame_main);
+    }
+
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
+int ifilter_send_eof(InputFilter *ifilter, int64_t pts, AVRational tb)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(ifilter->graph);
+    InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
+    AVFrame       *frame = fgp->frame_main;
+    int ret;
+
+    frame->pts       = pts;
+    frame->time_base = tb;
+    frame->opaque    = (void*)(intptr_t)FRAME_OPAQUE_EOF;
+
+    ret = fg_send(ifilter->graph, ifp->index, frame);
+
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
+int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
+{
+    InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
+    int ret;
+
+    if (keep_reference) {
+        ret = av_frame_ref(ifp->frame, frame);
+        if (ret < 0)
+            return ret;
+    } else
+        av_frame_move_ref(ifp->frame, frame);
+
+    return fg_send(ifilter->graph, ifp->index, ifp->frame);
+}
+
+static void filter_command_free(void *opaque, uint8_t *data)
+{
+    FilterCommand *fc = (FilterCommand*)data;
+
+    av_freep(&fc->target);
+    av_freep(&fc->command);
+    av_freep(&fc->arg);
+
+    av_free(data);
+}
+
+void fg_send_command(FilterGraph *fg, double time, const char *target,
+                     const char *command, const char *arg, int all_filters)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    AVFrame       *frame = fgp->frame_main;
+    FilterCommand *fc;
+
+    fc = av_mallocz(sizeof(*fc));
+    if (!fc)
+        goto fail;
+
+    frame->buf[0] = av_buffer_create((uint8_t*)fc, sizeof(*fc),
+                                     filter_command_free, NULL, 0);
+    if (!frame->buf[0]) {
+        av_freep(&fc);
+        goto fail;
+    }
 
-            close_output_stream(ofilter->ost);
+    fc->target  = av_strdup(target);
+    fc->command = av_strdup(command);
+    fc->arg     = av_strdup(arg);
+    if (!fc->target || !fc->command || !fc->arg)
+        goto fail;
+
+    fc->time        = time;
+    fc->all_filters = all_filters;
+
+    frame->opaque = (void*)(intptr_t)FRAME_OPAQUE_SEND_COMMAND;
+
+    fg_send(fg, fg->nb_inputs, frame);
+    return;
+fail:
+    av_frame_unref(frame);
+    av_log(fg, AV_LOG_ERROR, "Could not send a command to the filtergraph\n");
+}
+
+/* Pass a frame received from the filtering thread on to the encoder. */
+static void ofilter_output_frame(OutputFilter *ofilter, AVFrame *frame)
+{
+    OutputStream *ost = ofilter->ost;
+
+    if (!frame->buf[0]) {
+        // no parameters means the output is flushed, otherwise no frames
+        // were ever seen at it and the encoder still has to be initialized
+        if (frame->format < 0) {
+            enc_frame(ost, NULL);
+        } else {
+            av_log(ost, AV_LOG_WARNING,
+                   "No filtered frames for output stream, trying to "
+                   "initialize anyway.\n");
+
+            enc_open(ost, frame);
         }
+    } else if (!ost->finished) {
+        if (frame->pts != AV_NOPTS_VALUE)
+            ofilter->last_pts = av_rescale_q(frame->pts, frame->time_base,
+                                             AV_TIME_BASE_Q);
+
+        enc_frame(ost, frame);
+    }
+
+    av_frame_unref(frame);
+}
+
+int fg_transcode_step(FilterGraph *graph, InputStream **best_ist)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(graph);
+    AVFrame       *frame = fgp->frame_main;
+    const ChooseInputReply *reply;
+    int i, ret, thread_ret;
+    int nb_requests, nb_requests_max = 0;
+    InputStream *ist;
+
+    *best_ist = NULL;
+
+    /* With at most one input, the requests are pipelined: the input for this
+     * step is chosen from the reply to the previous request, and the next
+     * request is sent before returning, so that the filtering thread answers
+     * it while this step's input is demuxed and decoded. The reply may then
+     * lag one step behind, which at worst feeds the input before it is
+     * needed and does not change the output.
+     * With several inputs, the order in which they are fed can change the
+     * output of some filters (e.g. amix), so every request is answered
+     * before choosing an input. */
+    if (!fgp->choose_input_pending) {
+        frame->opaque = (void*)(intptr_t)FRAME_OPAQUE_CHOOSE_INPUT;
+        ret = fg_send(graph, graph->nb_inputs, frame);
+        if (ret < 0)
+            goto fail;
+        fgp->choose_input_pending = 1;
+    }
+
+    // encode everything the graph has output until the request is answered
+    while (1) {
+        int idx;
+
+        ret = tq_receive(fgp->queue_out, &idx, frame);
+        if (ret < 0)
+            goto fail;
+
+        if (idx == graph->nb_outputs) {
+            av_frame_unref(fgp->choose_input_reply);
+            av_frame_move_ref(fgp->choose_input_reply, frame);
+            fgp->choose_input_pending = 0;
+            break;
+        }
+
+        ofilter_output_frame(graph->outputs[idx], frame);
+    }
+    reply = (const ChooseInputReply*)fgp->choose_input_reply->buf[0]->data;
+
+    // nothing more will be requested once the graph is finished
+    if (graph->nb_inputs <= 1 && reply->ret != AVERROR_EOF &&
+        !(reply->ret == 1 && reply->best_input < 0)) {
+        frame->opaque = (void*)(intptr_t)FRAME_OPAQUE_CHOOSE_INPUT;
+        ret = fg_send(graph, graph->nb_inputs, frame);
+        if (ret < 0)
+            goto fail;
+        fgp->choose_input_pending = 1;
+    }
+
+    if (reply->ret == 1) {
+        // graph not configured
+        if (reply->best_input >= 0) {
+            *best_ist = ifp_from_ifilter(graph->inputs[reply->best_input])->ist;
+            return 0;
+        }
+
+        // all inputs are either initialized or EOF
+        for (int i = 0; i < graph->nb_outputs; i++)
+            graph->outputs[i]->ost->inputs_done = 1;
+
+        return 0;
+    }
+
+    ret = reply->ret;
+    if (ret >= 0)
+        return 0;
+
+    if (ret == AVERROR_EOF) {
+        for (int i = 0; i < graph->nb_outputs; i++)
+            close_output_stream(graph->outputs[i]->ost);
         return 0;
     }
     if (ret != AVERROR(EAGAIN))
         return ret;
 
     for (i = 0; i < graph->nb_inputs; i++) {
-        InputFilter *ifilter = graph->inputs[i];
-        InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
-
-        ist = ifp->ist;
-        if (input_files[ist->file_index]->eagain || ifp->eof)
+        ist = ifp_from_ifilter(graph->inputs[i])->ist;
+        nb_requests = reply->nb_failed_requests[i];
+        if (input_files[ist->file_index]->eagain || nb_requests < 0)
             continue;
-        nb_requests = av_buffersrc_get_nb_failed_requests(ifp->filter);
         if (nb_requests > nb_requests_max) {
             nb_requests_max = nb_requests;
             *best_ist = ist;
@@ -2097,4 +2677,14 @@ int fg_transcode_step(FilterGraph *graph, InputStream **best_ist)
             graph->outputs[i]->ost->unavailable = 1;
 
     return 0;
+
+fail:
+    // the filtering thread is gone
+    thread_ret = fg_thread_stop(graph);
+    if (thread_ret < 0) {
+        av_log(graph, AV_LOG_ERROR, "Filtering thread returned error: %s\n",
+               av_err2str(thread_ret));
+        return thread_ret;
+    }
+    return ret == AVERROR_EOF ? AVERROR_BUG : ret;
 }
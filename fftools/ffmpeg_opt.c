@@ -52,6 +52,7 @@
 #include "libavutil/parseutils.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/pixfmt.h"
+#include "libavutil/threadpool.h"
 
 const char *const opt_name_codec_names[]                      = {"c", "codec", "acodec", "vcodec", "scodec", "dcodec", NULL};
 const char *const opt_name_frame_rates[]                      = {"r", NULL};
@@ -297,6 +298,17 @@ static int opt_filter_threads(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_thread_pool(void *optctx, const char *opt, const char *arg)
+{
+    int nb_threads = parse_number_or_die(opt, arg, OPT_INT, 0, INT_MAX);
+    int ret = av_thread_pool_set_shared(nb_threads);
+
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Cannot enable the shared thread pool: %s\n",
+               av_err2str(ret));
+    return ret;
+}
+
 static int opt_abort_on(void *optctx, const char *opt, const char *arg)
 {
     static const AVOption opts[] = {
@@ -1517,6 +1529,8 @@ const OptionDef options[] = {
         "set stream filtergraph", "filter_graph" },
     { "filter_threads", HAS_ARG,                                     { .func_arg = opt_filter_threads },
         "number of non-complex filter threads" },
+    { "thread_pool",    HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_thread_pool },
+        "run slice threaded decoders, encoders, filters and scalers on one shared pool of worker threads", "number" },
     { "filter_script",  HAS_ARG | OPT_STRING | OPT_SPEC | OPT_OUTPUT, { .off = OFFSET(filter_scripts) },
         "read stream filtergraph description from a file", "filename" },
     { "reinit_filter",  HAS_ARG | OPT_INT | OPT_SPEC | OPT_INPUT,    { .off = OFFSET(reinit_filters) },
@@ -44,6 +44,8 @@ struct ThreadQueue {
     unsigned int    nb_streams;
 
     AVFifo  *fifo;
+    // set for queues that grow instead of blocking the sender
+    int      unbounded;
 
     ObjPool *obj_pool;
     void   (*obj_move)(void *dst, void *src);
@@ -104,9 +106,13 @@ ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
         goto fail;
     tq->nb_streams = nb_streams;
 
-    tq->fifo = av_fifo_alloc2(queue_size, sizeof(FifoElem), 0);
+    tq->unbounded = !queue_size;
+    tq->fifo = av_fifo_alloc2(tq->unbounded ? 8 : queue_size, sizeof(FifoElem),
+                              tq->unbounded ? AV_FIFO_FLAG_AUTO_GROW : 0);
     if (!tq->fifo)
         goto fail;
+    if (tq->unbounded)
+        av_fifo_auto_grow_limit(tq->fifo, SIZE_MAX);
 
     tq->obj_pool = obj_pool;
     tq->obj_move = obj_move;
@@ -132,7 +138,8 @@ int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
         goto finish;
     }
 
-    while (!(*finished & FINISHED_RECV) && !av_fifo_can_write(tq->fifo))
+    while (!(*finished & FINISHED_RECV) && !tq->unbounded &&
+           !av_fifo_can_write(tq->fifo))
         pthread_cond_wait(&tq->cond, &tq->lock);
 
     if (*finished & FINISHED_RECV) {
@@ -148,7 +155,13 @@ int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
         tq->obj_move(elem.obj, data);
 
         ret = av_fifo_write(tq->fifo, &elem, 1);
-        av_assert0(ret >= 0);
+        if (ret < 0) {
+            // only an unbounded queue can fail to grow
+            av_assert0(tq->unbounded);
+            tq->obj_move(data, elem.obj);
+            objpool_release(tq->obj_pool, &elem.obj);
+            goto finish;
+        }
         pthread_cond_broadcast(&tq->cond);
     }
 
@@ -188,7 +201,7 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
     return nb_finished == tq->nb_streams ? AVERROR_EOF : AVERROR(EAGAIN);
 }
 
-int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
+static int receive(ThreadQueue *tq, int *stream_idx, void *data, int block)
 {
     int ret;
 
@@ -198,7 +211,7 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
 
     while (1) {
         ret = receive_locked(tq, stream_idx, data);
-        if (ret == AVERROR(EAGAIN)) {
+        if (ret == AVERROR(EAGAIN) && block) {
             pthread_cond_wait(&tq->cond, &tq->lock);
             continue;
         }
@@ -214,6 +227,16 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
     return ret;
 }
 
+int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
+{
+    return receive(tq, stream_idx, data, 1);
+}
+
+int tq_receive_nonblock(ThreadQueue *tq, int *stream_idx, void *data)
+{
+    return receive(tq, stream_idx, data, 0);
+}
+
 void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
@@ -31,7 +31,7 @@ typedef struct ThreadQueue ThreadQueue;
  * @param nb_streams number of streams for which a distinct EOF state is
  *                   maintained
  * @param queue_size number of items that can be stored in the queue without
- *                   blocking
+ *                   blocking, 0 for a queue that never blocks the sender
  * @param obj_pool object pool that will be used to allocate items stored in the
  *                 queue; the pool becomes owned by the queue
  * @param callback that moves the contents between two data pointers
@@ -73,6 +73,11 @@ void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx);
  *   for each stream. When *stream_idx is -1, all streams are done.
  */
 int tq_receive(ThreadQueue *tq, int *stream_idx, void *data);
+/**
+ * Same as tq_receive(), but return AVERROR(EAGAIN) instead of blocking when
+ * no item is available and not all streams are finished.
+ */
+int tq_receive_nonblock(ThreadQueue *tq, int *stream_idx, void *data);
 /**
  * Mark the given stream finished from the receiving side.
  */
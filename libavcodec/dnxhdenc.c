@@ -116,6 +116,18 @@ void dnxhd_10bit_get_pixels_8x4_sym(int16_t *av_restrict block,
     memcpy(block + 4 * 8, pixels + 3 * line_size, 8 * sizeof(*block));
 }
 
+av_cold void ff_dnxhdenc_init(DNXHDEncContext *ctx)
+{
+    if (ctx->bit_depth == 10)
+        ctx->get_pixels_8x4_sym = dnxhd_10bit_get_pixels_8x4_sym;
+    else
+        ctx->get_pixels_8x4_sym = dnxhd_8bit_get_pixels_8x4_sym;
+
+#if ARCH_X86
+    ff_dnxhdenc_init_x86(ctx);
+#endif
+}
+
 static int dnxhd_10bit_dct_quantize_444(MpegEncContext *ctx, int16_t *block,
                                         int n, int qscale, int *overflow)
 {
@@ -434,20 +446,15 @@ static av_cold int dnxhd_encode_init(AVCodecContext *avctx)
 
     if (ctx->is_444 || ctx->profile == FF_PROFILE_DNXHR_HQX) {
         ctx->m.dct_quantize     = dnxhd_10bit_dct_quantize_444;
-        ctx->get_pixels_8x4_sym = dnxhd_10bit_get_pixels_8x4_sym;
         ctx->block_width_l2     = 4;
     } else if (ctx->bit_depth == 10) {
         ctx->m.dct_quantize     = dnxhd_10bit_dct_quantize;
-        ctx->get_pixels_8x4_sym = dnxhd_10bit_get_pixels_8x4_sym;
         ctx->block_width_l2     = 4;
     } else {
-        ctx->get_pixels_8x4_sym = dnxhd_8bit_get_pixels_8x4_sym;
         ctx->block_width_l2     = 3;
     }
 
-#if ARCH_X86
-    ff_dnxhdenc_init_x86(ctx);
-#endif
+    ff_dnxhdenc_init(ctx);
 
     ctx->m.mb_height = (avctx->height + 15) / 16;
     ctx->m.mb_width  = (avctx->width  + 15) / 16;
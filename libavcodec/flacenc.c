@@ -25,6 +25,7 @@
 #include "libavutil/intmath.h"
 #include "libavutil/md5.h"
 #include "libavutil/opt.h"
+#include "libavutil/slicethread.h"
 
 #include "avcodec.h"
 #include "bswapdsp.h"
@@ -102,9 +103,26 @@ typedef struct FlacFrame {
     int verbatim_only;
 } FlacFrame;
 
+/**
+ * State of one frame being encoded. There is one job per thread, the rest
+ * of the context is shared and stays constant while the jobs run.
+ */
+typedef struct FlacEncodeJob {
+    PutBitContext pb;
+    FlacFrame frame;
+    LPCContext lpc_ctx;
+    int max_framesize;
+    uint32_t frame_count;
+
+    AVFrame *input;
+    uint8_t *buf;
+    unsigned int buf_size;
+    int bytes;
+    int ret;
+} FlacEncodeJob;
+
 typedef struct FlacEncodeContext {
     AVClass *class;
-    PutBitContext pb;
     int channels;
     int samplerate;
     int sr_code[2];
@@ -116,10 +134,9 @@ typedef struct FlacEncodeContext {
     uint32_t frame_count;
     uint64_t sample_count;
     uint8_t md5sum[16];
-    FlacFrame frame;
+    int blocksize;          ///< block size of the last frame
     CompressionOptions options;
     AVCodecContext *avctx;
-    LPCContext lpc_ctx;
     struct AVMD5 *md5ctx;
     uint8_t *md5_buffer;
     unsigned int md5_buffer_size;
@@ -128,6 +145,15 @@ typedef struct FlacEncodeContext {
 
     int flushed;
     int64_t next_pts;
+
+    /* Frame threading: with more than one job, nb_jobs frames are queued
+     * and encoded in parallel on the slice threads. */
+    AVSliceThread *thread;
+    FlacEncodeJob *jobs;
+    int nb_jobs;
+    int nb_queued;          ///< jobs holding a frame that is not encoded yet
+    int nb_encoded;         ///< jobs encoded in the last batch
+    int next_out;           ///< next encoded job to output
 } FlacEncodeContext;
 
 
@@ -266,12 +292,15 @@ static av_cold void dprint_compression_options(FlacEncodeContext *s)
 }
 
 
+static void encode_frame_job(void *arg, int jobnr, int threadnr, int nb_jobs,
+                             int nb_threads);
+
 static av_cold int flac_encode_init(AVCodecContext *avctx)
 {
     int freq = avctx->sample_rate;
     int channels = avctx->ch_layout.nb_channels;
     FlacEncodeContext *s = avctx->priv_data;
-    int i, level, ret;
+    int i, level, nb_jobs, ret;
     uint8_t *streaminfo;
 
     s->avctx = avctx;
@@ -463,24 +492,55 @@ static av_cold int flac_encode_init(AVCodecContext *avctx)
         }
     }
 
-    ret = ff_lpc_init(&s->lpc_ctx, avctx->frame_size,
-                      s->options.max_prediction_order, FF_LPC_TYPE_LEVINSON);
-
     ff_bswapdsp_init(&s->bdsp);
     ff_flacencdsp_init(&s->flac_dsp);
 
     dprint_compression_options(s);
 
-    return ret;
+    /* Threads are only used when explicitly requested, as they delay the
+     * output by one frame per thread. */
+    nb_jobs = 1;
+    if (avctx->thread_count > 1 && !(avctx->flags & AV_CODEC_FLAG_LOW_DELAY)) {
+        ret = avpriv_slicethread_create(&s->thread, s, encode_frame_job, NULL,
+                                        avctx->thread_count);
+        if (ret < 0 && ret != AVERROR(ENOSYS))
+            return ret;
+        if (ret > 1)
+            nb_jobs = ret;
+        else
+            avpriv_slicethread_free(&s->thread);
+    }
+
+    s->jobs = av_calloc(nb_jobs, sizeof(*s->jobs));
+    if (!s->jobs)
+        return AVERROR(ENOMEM);
+
+    s->nb_jobs = nb_jobs;
+
+    for (i = 0; i < s->nb_jobs; i++) {
+        FlacEncodeJob *job = &s->jobs[i];
+
+        ret = ff_lpc_init(&job->lpc_ctx, avctx->frame_size,
+                          s->options.max_prediction_order, FF_LPC_TYPE_LEVINSON);
+        if (ret < 0)
+            return ret;
+        if (s->thread) {
+            job->input = av_frame_alloc();
+            if (!job->input)
+                return AVERROR(ENOMEM);
+        }
+    }
+
+    return 0;
 }
 
 
-static void init_frame(FlacEncodeContext *s, int nb_samples)
+static void init_frame(FlacEncodeContext *s, FlacEncodeJob *j, int nb_samples)
 {
     int i, ch;
     FlacFrame *frame;
 
-    frame = &s->frame;
+    frame = &j->frame;
 
     for (i = 0; i < 16; i++) {
         if (nb_samples == ff_flac_blocksize_table[i]) {
@@ -520,19 +580,20 @@ static void init_frame(FlacEncodeContext *s, int nb_samples)
 /**
  * Copy channel-interleaved input samples into separate subframes.
  */
-static void copy_samples(FlacEncodeContext *s, const void *samples)
+static void copy_samples(FlacEncodeContext *s, FlacEncodeJob *j,
+                         const void *samples)
 {
-    int i, j, ch;
+    int i, n, ch;
     FlacFrame *frame;
     int shift = av_get_bytes_per_sample(s->avctx->sample_fmt) * 8 -
                 s->avctx->bits_per_raw_sample;
 
 #define COPY_SAMPLES(bits) do {                                     \
     const int ## bits ## _t *samples0 = samples;                    \
-    frame = &s->frame;                                              \
-    for (i = 0, j = 0; i < frame->blocksize; i++)                   \
-        for (ch = 0; ch < s->channels; ch++, j++)                   \
-            frame->subframes[ch].samples[i] = samples0[j] >> shift; \
+    frame = &j->frame;                                              \
+    for (i = 0, n = 0; i < frame->blocksize; i++)                   \
+        for (ch = 0; ch < s->channels; ch++, n++)                   \
+            frame->subframes[ch].samples[i] = samples0[n] >> shift; \
 } while (0)
 
     if (s->avctx->sample_fmt == AV_SAMPLE_FMT_S16)
@@ -555,8 +616,8 @@ static uint64_t rice_count_exact(const int32_t *res, int n, int k)
 }
 
 
-static uint64_t subframe_count_exact(FlacEncodeContext *s, FlacSubframe *sub,
-                                     int pred_order)
+static uint64_t subframe_count_exact(FlacEncodeContext *s, FlacEncodeJob *j,
+                                     FlacSubframe *sub, int pred_order)
 {
     int p, porder, psize;
     int i, part_end;
@@ -572,7 +633,7 @@ static uint64_t subframe_count_exact(FlacEncodeContext *s, FlacSubframe *sub,
     if (sub->type == FLAC_SUBFRAME_CONSTANT) {
         count += sub->obits;
     } else if (sub->type == FLAC_SUBFRAME_VERBATIM) {
-        count += s->frame.blocksize * sub->obits;
+        count += j->frame.blocksize * sub->obits;
     } else {
         /* warm-up samples */
         count += pred_order * sub->obits;
@@ -586,7 +647,7 @@ static uint64_t subframe_count_exact(FlacEncodeContext *s, FlacSubframe *sub,
 
         /* partition order */
         porder = sub->rc.porder;
-        psize  = s->frame.blocksize >> porder;
+        psize  = j->frame.blocksize >> porder;
         count += 4;
 
         /* residual */
@@ -597,7 +658,7 @@ static uint64_t subframe_count_exact(FlacEncodeContext *s, FlacSubframe *sub,
             count += sub->rc.coding_mode;
             count += rice_count_exact(&sub->residual[i], part_end - i, k);
             i = part_end;
-            part_end = FFMIN(s->frame.blocksize, part_end + psize);
+            part_end = FFMIN(j->frame.blocksize, part_end + psize);
         }
     }
 
@@ -758,19 +819,19 @@ static int get_max_p_order(int max_porder, int n, int order)
 }
 
 
-static uint64_t find_subframe_rice_params(FlacEncodeContext *s,
+static uint64_t find_subframe_rice_params(FlacEncodeContext *s, FlacEncodeJob *j,
                                           FlacSubframe *sub, int pred_order)
 {
     int pmin = get_max_p_order(s->options.min_partition_order,
-                               s->frame.blocksize, pred_order);
+                               j->frame.blocksize, pred_order);
     int pmax = get_max_p_order(s->options.max_partition_order,
-                               s->frame.blocksize, pred_order);
+                               j->frame.blocksize, pred_order);
 
     uint64_t bits = 8 + pred_order * sub->obits + 2 + sub->rc.coding_mode;
     if (sub->type == FLAC_SUBFRAME_LPC)
         bits += 4 + 5 + pred_order * s->options.lpc_coeff_precision;
     bits += calc_rice_params(&sub->rc, sub->rc_udata, sub->rc_sums, pmin, pmax, sub->residual,
-                             s->frame.blocksize, pred_order, s->options.exact_rice_parameters);
+                             j->frame.blocksize, pred_order, s->options.exact_rice_parameters);
     return bits;
 }
 
@@ -947,10 +1008,10 @@ static int lpc_encode_choose_datapath(FlacEncodeContext *s, int32_t bps,
     sub->type = sub->type_code = FLAC_SUBFRAME_VERBATIM;    \
     if (sub->obits <= 32)                                   \
         memcpy(res, smp, n * sizeof(int32_t));              \
-    return subframe_count_exact(s, sub, 0);                 \
+    return subframe_count_exact(s, j, sub, 0);              \
 }
 
-static int encode_residual_ch(FlacEncodeContext *s, int ch)
+static int encode_residual_ch(FlacEncodeContext *s, FlacEncodeJob *j, int ch)
 {
     int i, n;
     int min_order, max_order, opt_order, omethod;
@@ -961,7 +1022,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
     int32_t *res, *smp;
     int64_t *smp_33bps;
 
-    frame     = &s->frame;
+    frame     = &j->frame;
     sub       = &frame->subframes[ch];
     res       = sub->residual;
     smp       = sub->samples;
@@ -975,7 +1036,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
                 break;
         if (i == n) {
             sub->type = sub->type_code = FLAC_SUBFRAME_CONSTANT;
-            return subframe_count_exact(s, sub, 0);
+            return subframe_count_exact(s, j, sub, 0);
         }
     } else {
         for (i = 1; i < n; i++)
@@ -984,7 +1045,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
         if (i == n) {
             sub->type = sub->type_code = FLAC_SUBFRAME_CONSTANT;
             res[0] = smp[0];
-            return subframe_count_exact(s, sub, 0);
+            return subframe_count_exact(s, j, sub, 0);
         }
     }
 
@@ -1015,7 +1076,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
                     continue;
             } else
                 encode_residual_fixed(res, smp, n, i);
-            bits[i] = find_subframe_rice_params(s, sub, i);
+            bits[i] = find_subframe_rice_params(s, j, sub, i);
             if (bits[i] < bits[opt_order])
                 opt_order = i;
         }
@@ -1033,9 +1094,9 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
                 encode_residual_fixed_with_residual_limit(res, smp, n, sub->order);
             else
                 encode_residual_fixed(res, smp, n, sub->order);
-            find_subframe_rice_params(s, sub, sub->order);
+            find_subframe_rice_params(s, j, sub, sub->order);
         }
-        return subframe_count_exact(s, sub, sub->order);
+        return subframe_count_exact(s, j, sub, sub->order);
     }
 
     /* LPC */
@@ -1048,7 +1109,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
         for (i = 0; i < n; i++)
             smp[i] = smp_33bps[i] >> 1;
 
-    opt_order = ff_lpc_calc_coefs(&s->lpc_ctx, smp, n, min_order, max_order,
+    opt_order = ff_lpc_calc_coefs(&j->lpc_ctx, smp, n, min_order, max_order,
                                   s->options.lpc_coeff_precision, coefs, shift, s->options.lpc_type,
                                   s->options.lpc_passes, omethod,
                                   MIN_LPC_SHIFT, MAX_LPC_SHIFT, 0);
@@ -1070,7 +1131,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
                 continue;
             if(lpc_encode_choose_datapath(s, sub->obits, res, smp, smp_33bps, n, order+1, coefs[order], shift[order]))
                 continue;
-            bits[i] = find_subframe_rice_params(s, sub, order+1);
+            bits[i] = find_subframe_rice_params(s, j, sub, order+1);
             if (bits[i] < bits[opt_index]) {
                 opt_index = i;
                 opt_order = order;
@@ -1085,7 +1146,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
         for (i = min_order-1; i < max_order; i++) {
             if(lpc_encode_choose_datapath(s, sub->obits, res, smp, smp_33bps, n, i+1, coefs[i], shift[i]))
                 continue;
-            bits[i] = find_subframe_rice_params(s, sub, i+1);
+            bits[i] = find_subframe_rice_params(s, j, sub, i+1);
             if (bits[i] < bits[opt_order])
                 opt_order = i;
         }
@@ -1104,7 +1165,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
                     continue;
                 if(lpc_encode_choose_datapath(s, sub->obits, res, smp, smp_33bps, n, i+1, coefs[i], shift[i]))
                     continue;
-                bits[i] = find_subframe_rice_params(s, sub, i+1);
+                bits[i] = find_subframe_rice_params(s, j, sub, i+1);
                 if (bits[i] < bits[opt_order])
                     opt_order = i;
             }
@@ -1142,7 +1203,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
 
                 if(lpc_encode_choose_datapath(s, sub->obits, res, smp, smp_33bps, n, opt_order, lpc_try, shift[opt_order-1]))
                     continue;
-                score = find_subframe_rice_params(s, sub, opt_order);
+                score = find_subframe_rice_params(s, j, sub, opt_order);
                 if (score < best_score) {
                     best_score = score;
                     memcpy(coefs[opt_order-1], lpc_try, sizeof(*coefs));
@@ -1164,13 +1225,13 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
         DEFAULT_TO_VERBATIM();
     }
 
-    find_subframe_rice_params(s, sub, sub->order);
+    find_subframe_rice_params(s, j, sub, sub->order);
 
-    return subframe_count_exact(s, sub, sub->order);
+    return subframe_count_exact(s, j, sub, sub->order);
 }
 
 
-static int count_frame_header(FlacEncodeContext *s)
+static int count_frame_header(FlacEncodeContext *s, FlacEncodeJob *j)
 {
     uint8_t av_unused tmp;
     int count;
@@ -1188,12 +1249,12 @@ static int count_frame_header(FlacEncodeContext *s)
     count = 32;
 
     /* coded frame number */
-    PUT_UTF8(s->frame_count, tmp, count += 8;)
+    PUT_UTF8(j->frame_count, tmp, count += 8;)
 
     /* explicit block size */
-    if (s->frame.bs_code[0] == 6)
+    if (j->frame.bs_code[0] == 6)
         count += 8;
-    else if (s->frame.bs_code[0] == 7)
+    else if (j->frame.bs_code[0] == 7)
         count += 16;
 
     /* explicit sample rate */
@@ -1206,15 +1267,15 @@ static int count_frame_header(FlacEncodeContext *s)
 }
 
 
-static int encode_frame(FlacEncodeContext *s)
+static int encode_frame(FlacEncodeContext *s, FlacEncodeJob *j)
 {
     int ch;
     uint64_t count;
 
-    count = count_frame_header(s);
+    count = count_frame_header(s, j);
 
     for (ch = 0; ch < s->channels; ch++)
-        count += encode_residual_ch(s, ch);
+        count += encode_residual_ch(s, j, ch);
 
     count += (8 - (count & 7)) & 7; // byte alignment
     count += 16;                    // CRC-16
@@ -1226,17 +1287,17 @@ static int encode_frame(FlacEncodeContext *s)
 }
 
 
-static void remove_wasted_bits(FlacEncodeContext *s)
+static void remove_wasted_bits(FlacEncodeContext *s, FlacEncodeJob *j)
 {
     int ch, i, wasted_bits;
 
     for (ch = 0; ch < s->channels; ch++) {
-        FlacSubframe *sub = &s->frame.subframes[ch];
+        FlacSubframe *sub = &j->frame.subframes[ch];
 
         if (sub->obits > 32) {
             int64_t v = 0;
-            for (i = 0; i < s->frame.blocksize; i++) {
-                v |= s->frame.samples_33bps[i];
+            for (i = 0; i < j->frame.blocksize; i++) {
+                v |= j->frame.samples_33bps[i];
                 if (v & 1)
                     break;
             }
@@ -1248,12 +1309,12 @@ static void remove_wasted_bits(FlacEncodeContext *s)
 
             /* If any wasted bits are found, samples are moved
              * from frame.samples_33bps to frame.subframes[ch] */
-            for (i = 0; i < s->frame.blocksize; i++)
-                sub->samples[i] = s->frame.samples_33bps[i] >> v;
+            for (i = 0; i < j->frame.blocksize; i++)
+                sub->samples[i] = j->frame.samples_33bps[i] >> v;
             wasted_bits = v;
         } else {
             int32_t v = 0;
-            for (i = 0; i < s->frame.blocksize; i++) {
+            for (i = 0; i < j->frame.blocksize; i++) {
                 v |= sub->samples[i];
                 if (v & 1)
                     break;
@@ -1264,7 +1325,7 @@ static void remove_wasted_bits(FlacEncodeContext *s)
 
             v = ff_ctz(v);
 
-            for (i = 0; i < s->frame.blocksize; i++)
+            for (i = 0; i < j->frame.blocksize; i++)
                 sub->samples[i] >>= v;
             wasted_bits = v;
         }
@@ -1336,14 +1397,14 @@ static int estimate_stereo_mode(const int32_t *left_ch, const int32_t *right_ch,
 /**
  * Perform stereo channel decorrelation.
  */
-static void channel_decorrelation(FlacEncodeContext *s)
+static void channel_decorrelation(FlacEncodeContext *s, FlacEncodeJob *j)
 {
     FlacFrame *frame;
     int32_t *left, *right;
     int64_t *side_33bps;
     int n;
 
-    frame      = &s->frame;
+    frame      = &j->frame;
     n          = frame->blocksize;
     left       = frame->subframes[0].samples;
     right      = frame->subframes[1].samples;
@@ -1410,40 +1471,40 @@ static void write_utf8(PutBitContext *pb, uint32_t val)
 }
 
 
-static void write_frame_header(FlacEncodeContext *s)
+static void write_frame_header(FlacEncodeContext *s, FlacEncodeJob *j)
 {
     FlacFrame *frame;
     int crc;
 
-    frame = &s->frame;
+    frame = &j->frame;
 
-    put_bits(&s->pb, 16, 0xFFF8);
-    put_bits(&s->pb, 4, frame->bs_code[0]);
-    put_bits(&s->pb, 4, s->sr_code[0]);
+    put_bits(&j->pb, 16, 0xFFF8);
+    put_bits(&j->pb, 4, frame->bs_code[0]);
+    put_bits(&j->pb, 4, s->sr_code[0]);
 
     if (frame->ch_mode == FLAC_CHMODE_INDEPENDENT)
-        put_bits(&s->pb, 4, s->channels-1);
+        put_bits(&j->pb, 4, s->channels-1);
     else
-        put_bits(&s->pb, 4, frame->ch_mode + FLAC_MAX_CHANNELS - 1);
+        put_bits(&j->pb, 4, frame->ch_mode + FLAC_MAX_CHANNELS - 1);
 
-    put_bits(&s->pb, 3, s->bps_code);
-    put_bits(&s->pb, 1, 0);
-    write_utf8(&s->pb, s->frame_count);
+    put_bits(&j->pb, 3, s->bps_code);
+    put_bits(&j->pb, 1, 0);
+    write_utf8(&j->pb, j->frame_count);
 
     if (frame->bs_code[0] == 6)
-        put_bits(&s->pb, 8, frame->bs_code[1]);
+        put_bits(&j->pb, 8, frame->bs_code[1]);
     else if (frame->bs_code[0] == 7)
-        put_bits(&s->pb, 16, frame->bs_code[1]);
+        put_bits(&j->pb, 16, frame->bs_code[1]);
 
     if (s->sr_code[0] == 12)
-        put_bits(&s->pb, 8, s->sr_code[1]);
+        put_bits(&j->pb, 8, s->sr_code[1]);
     else if (s->sr_code[0] > 12)
-        put_bits(&s->pb, 16, s->sr_code[1]);
+        put_bits(&j->pb, 16, s->sr_code[1]);
 
-    flush_put_bits(&s->pb);
-    crc = av_crc(av_crc_get_table(AV_CRC_8_ATM), 0, s->pb.buf,
-                 put_bytes_output(&s->pb));
-    put_bits(&s->pb, 8, crc);
+    flush_put_bits(&j->pb);
+    crc = av_crc(av_crc_get_table(AV_CRC_8_ATM), 0, j->pb.buf,
+                 put_bytes_output(&j->pb));
+    put_bits(&j->pb, 8, crc);
 }
 
 
@@ -1466,83 +1527,83 @@ static inline void set_sr_golomb_flac(PutBitContext *pb, int i, int k)
 }
 
 
-static void write_subframes(FlacEncodeContext *s)
+static void write_subframes(FlacEncodeContext *s, FlacEncodeJob *j)
 {
     int ch;
 
     for (ch = 0; ch < s->channels; ch++) {
-        FlacSubframe *sub = &s->frame.subframes[ch];
+        FlacSubframe *sub = &j->frame.subframes[ch];
         int p, porder, psize;
         int32_t *part_end;
         int32_t *res       =  sub->residual;
-        int32_t *frame_end = &sub->residual[s->frame.blocksize];
+        int32_t *frame_end = &sub->residual[j->frame.blocksize];
 
         /* subframe header */
-        put_bits(&s->pb, 1, 0);
-        put_bits(&s->pb, 6, sub->type_code);
-        put_bits(&s->pb, 1, !!sub->wasted);
+        put_bits(&j->pb, 1, 0);
+        put_bits(&j->pb, 6, sub->type_code);
+        put_bits(&j->pb, 1, !!sub->wasted);
         if (sub->wasted)
-            put_bits(&s->pb, sub->wasted, 1);
+            put_bits(&j->pb, sub->wasted, 1);
 
         /* subframe */
         if (sub->type == FLAC_SUBFRAME_CONSTANT) {
             if(sub->obits == 33)
-                put_sbits63(&s->pb, 33, s->frame.samples_33bps[0]);
+                put_sbits63(&j->pb, 33, j->frame.samples_33bps[0]);
             else if(sub->obits == 32)
-                put_bits32(&s->pb, res[0]);
+                put_bits32(&j->pb, res[0]);
             else
-                put_sbits(&s->pb, sub->obits, res[0]);
+                put_sbits(&j->pb, sub->obits, res[0]);
         } else if (sub->type == FLAC_SUBFRAME_VERBATIM) {
             if (sub->obits == 33) {
-                int64_t *res64 = s->frame.samples_33bps;
-                int64_t *frame_end64 = &s->frame.samples_33bps[s->frame.blocksize];
+                int64_t *res64 = j->frame.samples_33bps;
+                int64_t *frame_end64 = &j->frame.samples_33bps[j->frame.blocksize];
                 while (res64 < frame_end64)
-                    put_sbits63(&s->pb, 33, (*res64++));
+                    put_sbits63(&j->pb, 33, (*res64++));
             } else if (sub->obits == 32) {
                 while (res < frame_end)
-                    put_bits32(&s->pb, *res++);
+                    put_bits32(&j->pb, *res++);
             } else {
                 while (res < frame_end)
-                    put_sbits(&s->pb, sub->obits, *res++);
+                    put_sbits(&j->pb, sub->obits, *res++);
             }
         } else {
             /* warm-up samples */
             if (sub->obits == 33) {
                 for (int i = 0; i < sub->order; i++)
-                    put_sbits63(&s->pb, 33, s->frame.samples_33bps[i]);
+                    put_sbits63(&j->pb, 33, j->frame.samples_33bps[i]);
                 res += sub->order;
             } else if (sub->obits == 32) {
                 for (int i = 0; i < sub->order; i++)
-                    put_bits32(&s->pb, *res++);
+                    put_bits32(&j->pb, *res++);
             } else {
                 for (int i = 0; i < sub->order; i++)
-                    put_sbits(&s->pb, sub->obits, *res++);
+                    put_sbits(&j->pb, sub->obits, *res++);
             }
 
             /* LPC coefficients */
             if (sub->type == FLAC_SUBFRAME_LPC) {
                 int cbits = s->options.lpc_coeff_precision;
-                put_bits( &s->pb, 4, cbits-1);
-                put_sbits(&s->pb, 5, sub->shift);
+                put_bits( &j->pb, 4, cbits-1);
+                put_sbits(&j->pb, 5, sub->shift);
                 for (int i = 0; i < sub->order; i++)
-                    put_sbits(&s->pb, cbits, sub->coefs[i]);
+                    put_sbits(&j->pb, cbits, sub->coefs[i]);
             }
 
             /* rice-encoded block */
-            put_bits(&s->pb, 2, sub->rc.coding_mode - 4);
+            put_bits(&j->pb, 2, sub->rc.coding_mode - 4);
 
             /* partition order */
             porder  = sub->rc.porder;
-            psize   = s->frame.blocksize >> porder;
-            put_bits(&s->pb, 4, porder);
+            psize   = j->frame.blocksize >> porder;
+            put_bits(&j->pb, 4, porder);
 
             /* residual */
             part_end  = &sub->residual[psize];
             for (p = 0; p < 1 << porder; p++) {
                 int k = sub->rc.params[p];
-                put_bits(&s->pb, sub->rc.coding_mode, k);
+                put_bits(&j->pb, sub->rc.coding_mode, k);
                 while (res < part_end)
-                    set_sr_golomb_flac(&s->pb, *res++, k);
+                    set_sr_golomb_flac(&j->pb, *res++, k);
                 part_end = FFMIN(frame_end, part_end + psize);
             }
         }
@@ -1550,31 +1611,32 @@ static void write_subframes(FlacEncodeContext *s)
 }
 
 
-static void write_frame_footer(FlacEncodeContext *s)
+static void write_frame_footer(FlacEncodeContext *s, FlacEncodeJob *j)
 {
     int crc;
-    flush_put_bits(&s->pb);
-    crc = av_bswap16(av_crc(av_crc_get_table(AV_CRC_16_ANSI), 0, s->pb.buf,
-                            put_bytes_output(&s->pb)));
-    put_bits(&s->pb, 16, crc);
-    flush_put_bits(&s->pb);
+    flush_put_bits(&j->pb);
+    crc = av_bswap16(av_crc(av_crc_get_table(AV_CRC_16_ANSI), 0, j->pb.buf,
+                            put_bytes_output(&j->pb)));
+    put_bits(&j->pb, 16, crc);
+    flush_put_bits(&j->pb);
 }
 
 
-static int write_frame(FlacEncodeContext *s, AVPacket *avpkt)
+static int write_frame(FlacEncodeContext *s, FlacEncodeJob *j,
+                       uint8_t *buf, int buf_size)
 {
-    init_put_bits(&s->pb, avpkt->data, avpkt->size);
-    write_frame_header(s);
-    write_subframes(s);
-    write_frame_footer(s);
-    return put_bytes_output(&s->pb);
+    init_put_bits(&j->pb, buf, buf_size);
+    write_frame_header(s, j);
+    write_subframes(s, j);
+    write_frame_footer(s, j);
+    return put_bytes_output(&j->pb);
 }
 
 
 static int update_md5_sum(FlacEncodeContext *s, const void *samples)
 {
     const uint8_t *buf;
-    int buf_size = s->frame.blocksize * s->channels *
+    int buf_size = s->blocksize * s->channels *
                    ((s->avctx->bits_per_raw_sample + 7) / 8);
 
     if (s->avctx->bits_per_raw_sample > 16 || HAVE_BIGENDIAN) {
@@ -1595,7 +1657,7 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
         const int32_t *samples0 = samples;
         uint8_t *tmp            = s->md5_buffer;
 
-        for (i = 0; i < s->frame.blocksize * s->channels; i++) {
+        for (i = 0; i < s->blocksize * s->channels; i++) {
             int32_t v = samples0[i] >> 8;
             AV_WL24(tmp + 3*i, v);
         }
@@ -1606,7 +1668,7 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
         const int32_t *samples0 = samples;
         uint8_t *tmp            = s->md5_buffer;
 
-        for (i = 0; i < s->frame.blocksize * s->channels; i++)
+        for (i = 0; i < s->blocksize * s->channels; i++)
             AV_WL32(tmp + 4*i, samples0[i]);
         buf = s->md5_buffer;
     }
@@ -1616,13 +1678,193 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
 }
 
 
+static void update_max_framesize(FlacEncodeContext *s, int nb_samples)
+{
+    /* change max_framesize for small final frame */
+    if (nb_samples < s->blocksize) {
+        s->max_framesize = flac_get_max_frame_size(nb_samples,
+                                                   s->channels,
+                                                   s->avctx->bits_per_raw_sample);
+    }
+    s->blocksize = nb_samples;
+}
+
+
+/**
+ * Analyse the samples of one frame and choose its coding parameters.
+ * @return the size of the frame in bytes or a negative error code
+ */
+static int compress_frame(FlacEncodeContext *s, FlacEncodeJob *j,
+                          const AVFrame *frame)
+{
+    int frame_bytes;
+
+    init_frame(s, j, frame->nb_samples);
+
+    copy_samples(s, j, frame->data[0]);
+
+    channel_decorrelation(s, j);
+
+    remove_wasted_bits(s, j);
+
+    frame_bytes = encode_frame(s, j);
+
+    /* Fall back on verbatim mode if the compressed frame is larger than it
+       would be if encoded uncompressed. */
+    if (frame_bytes < 0 || frame_bytes > j->max_framesize) {
+        j->frame.verbatim_only = 1;
+        frame_bytes = encode_frame(s, j);
+        if (frame_bytes < 0) {
+            av_log(s->avctx, AV_LOG_ERROR, "Bad frame count\n");
+            return frame_bytes;
+        }
+    }
+
+    return frame_bytes;
+}
+
+
+static void update_frame_stats(FlacEncodeContext *s, const AVFrame *frame,
+                               int out_bytes)
+{
+    if (out_bytes > s->max_encoded_framesize)
+        s->max_encoded_framesize = out_bytes;
+    if (out_bytes < s->min_framesize)
+        s->min_framesize = out_bytes;
+
+    s->next_pts = frame->pts + ff_samples_to_time_base(s->avctx, frame->nb_samples);
+}
+
+
+/* Output packets may be delayed by frame threading, so the timestamps are
+ * set here instead of in the generic code. */
+static int set_packet_props(AVCodecContext *avctx, AVPacket *avpkt,
+                            const AVFrame *frame)
+{
+    avpkt->pts      = frame->pts;
+    avpkt->duration = frame->duration ? frame->duration :
+                      ff_samples_to_time_base(avctx, frame->nb_samples);
+    return ff_encode_reordered_opaque(avctx, avpkt, frame);
+}
+
+
+static void encode_frame_job(void *arg, int jobnr, int threadnr, int nb_jobs,
+                             int nb_threads)
+{
+    FlacEncodeContext *s = arg;
+    FlacEncodeJob *j = &s->jobs[jobnr];
+    int frame_bytes;
+
+    frame_bytes = compress_frame(s, j, j->input);
+    if (frame_bytes < 0) {
+        j->ret = frame_bytes;
+        return;
+    }
+
+    av_fast_malloc(&j->buf, &j->buf_size, frame_bytes);
+    if (!j->buf) {
+        j->ret = AVERROR(ENOMEM);
+        return;
+    }
+
+    j->bytes = write_frame(s, j, j->buf, frame_bytes);
+    j->ret   = 0;
+}
+
+
+/**
+ * Encode the queued frames in parallel. Everything that depends on the
+ * previous frames (frame number, MD5 sum, stream statistics) is done here
+ * in input order, so the output is identical to the single threaded path.
+ */
+static int encode_queued_frames(AVCodecContext *avctx)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+    int i, ret;
+
+    for (i = 0; i < s->nb_queued; i++) {
+        FlacEncodeJob *job   = &s->jobs[i];
+        const AVFrame *frame = job->input;
+
+        update_max_framesize(s, frame->nb_samples);
+
+        job->max_framesize = s->max_framesize;
+        job->frame_count   = s->frame_count++;
+        s->sample_count   += frame->nb_samples;
+        if ((ret = update_md5_sum(s, frame->data[0])) < 0) {
+            av_log(avctx, AV_LOG_ERROR, "Error updating MD5 checksum\n");
+            return ret;
+        }
+    }
+
+    avpriv_slicethread_execute(s->thread, s->nb_queued, 0);
+
+    for (i = 0; i < s->nb_queued; i++) {
+        if (s->jobs[i].ret < 0)
+            return s->jobs[i].ret;
+        update_frame_stats(s, s->jobs[i].input, s->jobs[i].bytes);
+    }
+
+    s->nb_encoded = s->nb_queued;
+    s->next_out   = 0;
+    s->nb_queued  = 0;
+    return 0;
+}
+
+
+static int encode_frame_threaded(AVCodecContext *avctx, AVPacket *avpkt,
+                                 const AVFrame *frame, int *got_packet_ptr)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+    FlacEncodeJob *job;
+    int ret;
+
+    if (frame) {
+        /* a job is reused only after its previous frame has been output */
+        av_assert0(s->nb_queued < s->next_out || s->next_out == s->nb_encoded);
+        job = &s->jobs[s->nb_queued++];
+        av_frame_unref(job->input);
+        ret = av_frame_ref(job->input, frame);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (s->next_out == s->nb_encoded) {
+        /* when flushing, encode whatever is queued */
+        if (frame && s->nb_queued < s->nb_jobs)
+            return 0;
+        ret = encode_queued_frames(avctx);
+        if (ret < 0)
+            return ret;
+    }
+
+    job = &s->jobs[s->next_out++];
+    ret = ff_get_encode_buffer(avctx, avpkt, job->bytes, 0);
+    if (ret < 0)
+        return ret;
+    memcpy(avpkt->data, job->buf, job->bytes);
+
+    ret = set_packet_props(avctx, avpkt, job->input);
+    if (ret < 0)
+        return ret;
+
+    *got_packet_ptr = 1;
+    return 0;
+}
+
+
 static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                              const AVFrame *frame, int *got_packet_ptr)
 {
     FlacEncodeContext *s;
+    FlacEncodeJob *job;
     int frame_bytes, out_bytes, ret;
 
     s = avctx->priv_data;
+    job = &s->jobs[0];
+
+    if (s->thread && (frame || s->nb_queued || s->next_out < s->nb_encoded))
+        return encode_frame_threaded(avctx, avpkt, frame, got_packet_ptr);
 
     /* when the last block is reached, update the header in extradata */
     if (!frame) {
@@ -1646,38 +1888,19 @@ static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
         return 0;
     }
 
-    /* change max_framesize for small final frame */
-    if (frame->nb_samples < s->frame.blocksize) {
-        s->max_framesize = flac_get_max_frame_size(frame->nb_samples,
-                                                   s->channels,
-                                                   avctx->bits_per_raw_sample);
-    }
-
-    init_frame(s, frame->nb_samples);
-
-    copy_samples(s, frame->data[0]);
+    update_max_framesize(s, frame->nb_samples);
 
-    channel_decorrelation(s);
+    job->max_framesize = s->max_framesize;
+    job->frame_count   = s->frame_count;
 
-    remove_wasted_bits(s);
-
-    frame_bytes = encode_frame(s);
-
-    /* Fall back on verbatim mode if the compressed frame is larger than it
-       would be if encoded uncompressed. */
-    if (frame_bytes < 0 || frame_bytes > s->max_framesize) {
-        s->frame.verbatim_only = 1;
-        frame_bytes = encode_frame(s);
-        if (frame_bytes < 0) {
-            av_log(avctx, AV_LOG_ERROR, "Bad frame count\n");
-            return frame_bytes;
-        }
-    }
+    frame_bytes = compress_frame(s, job, frame);
+    if (frame_bytes < 0)
+        return frame_bytes;
 
     if ((ret = ff_get_encode_buffer(avctx, avpkt, frame_bytes, 0)) < 0)
         return ret;
 
-    out_bytes = write_frame(s, avpkt);
+    out_bytes = write_frame(s, job, avpkt->data, avpkt->size);
 
     s->frame_count++;
     s->sample_count += frame->nb_samples;
@@ -1685,15 +1908,14 @@ static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
         av_log(avctx, AV_LOG_ERROR, "Error updating MD5 checksum\n");
         return ret;
     }
-    if (out_bytes > s->max_encoded_framesize)
-        s->max_encoded_framesize = out_bytes;
-    if (out_bytes < s->min_framesize)
-        s->min_framesize = out_bytes;
-
-    s->next_pts = frame->pts + ff_samples_to_time_base(avctx, frame->nb_samples);
+    update_frame_stats(s, frame, out_bytes);
 
     av_shrink_packet(avpkt, out_bytes);
 
+    ret = set_packet_props(avctx, avpkt, frame);
+    if (ret < 0)
+        return ret;
+
     *got_packet_ptr = 1;
     return 0;
 }
@@ -1703,9 +1925,16 @@ static av_cold int flac_encode_close(AVCodecContext *avctx)
 {
     FlacEncodeContext *s = avctx->priv_data;
 
+    avpriv_slicethread_free(&s->thread);
+    for (int i = 0; i < s->nb_jobs; i++) {
+        FlacEncodeJob *job = &s->jobs[i];
+        av_frame_free(&job->input);
+        av_freep(&job->buf);
+        ff_lpc_end(&job->lpc_ctx);
+    }
+    av_freep(&s->jobs);
     av_freep(&s->md5ctx);
     av_freep(&s->md5_buffer);
-    ff_lpc_end(&s->lpc_ctx);
     return 0;
 }
 
@@ -1754,7 +1983,7 @@ const FFCodec ff_flac_encoder = {
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_FLAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_SMALL_LAST_FRAME |
+                      AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_OTHER_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(FlacEncodeContext),
     .init           = flac_encode_init,
@@ -1764,5 +1993,5 @@ const FFCodec ff_flac_encoder = {
                                                      AV_SAMPLE_FMT_S32,
                                                      AV_SAMPLE_FMT_NONE },
     .p.priv_class   = &flac_encoder_class,
-    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_EOF_FLUSH,
+    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_AUTO_THREADS,
 };
@@ -161,6 +161,18 @@ av_cold int ff_frame_thread_encoder_init(AVCodecContext *avctx)
         }
     }
 
+    if (avctx->codec_id == AV_CODEC_ID_FFV1 &&
+        (avctx->gop_size > 1 || avctx->flags & AV_CODEC_FLAG_PASS1)) {
+        /* FFV1 frames are only independent if all of them are keyframes,
+         * and the first pass statistics are gathered across all frames.
+         * Fall back to slice threading. */
+        av_log(avctx, AV_LOG_DEBUG,
+               "Not using frame threads for FFV1 encoding with a GOP size above 1 "
+               "or in the first pass\n");
+        avctx->thread_type &= ~FF_THREAD_FRAME;
+        return 0;
+    }
+
     if(!avctx->thread_count) {
         avctx->thread_count = av_cpu_count();
         avctx->thread_count = FFMIN(avctx->thread_count, MAX_THREADS);
@@ -30,59 +30,23 @@
 #include "hevc.h"
 #include "h264.h"
 #include "h2645_parse.h"
+#include "startcode.h"
 #include "vvc.h"
 
-int ff_h2645_extract_rbsp(const uint8_t *src, int length,
+int ff_h2645_extract_rbsp(const StartCodeContext *sc,
+                          const uint8_t *src, int length,
                           H2645RBSP *rbsp, H2645NAL *nal, int small_padding)
 {
     int i, si, di;
     uint8_t *dst;
 
     nal->skipped_bytes = 0;
-#define STARTCODE_TEST                                                  \
-        if (i + 2 < length && src[i + 1] == 0 && src[i + 2] <= 3) {     \
-            if (src[i + 2] != 3 && src[i + 2] != 0) {                   \
-                /* startcode, so we must be past the end */             \
-                length = i;                                             \
-            }                                                           \
-            break;                                                      \
-        }
-#if HAVE_FAST_UNALIGNED
-#define FIND_FIRST_ZERO                                                 \
-        if (i > 0 && !src[i])                                           \
-            i--;                                                        \
-        while (src[i])                                                  \
-            i++
-#if HAVE_FAST_64BIT
-    for (i = 0; i + 1 < length; i += 9) {
-        if (!((~AV_RN64(src + i) &
-               (AV_RN64(src + i) - 0x0100010001000101ULL)) &
-              0x8000800080008080ULL))
-            continue;
-        FIND_FIRST_ZERO;
-        STARTCODE_TEST;
-        i -= 7;
-    }
-#else
-    for (i = 0; i + 1 < length; i += 5) {
-        if (!((~AV_RN32(src + i) &
-               (AV_RN32(src + i) - 0x01000101U)) &
-              0x80008080U))
-            continue;
-        FIND_FIRST_ZERO;
-        STARTCODE_TEST;
-        i -= 3;
-    }
-#endif /* HAVE_FAST_64BIT */
-#else
-    for (i = 0; i + 1 < length; i += 2) {
-        if (src[i])
-            continue;
-        if (i > 0 && src[i - 1] == 0)
-            i--;
-        STARTCODE_TEST;
+
+    i = sc->find_escape(src, length);
+    if (i < length && src[i + 2] != 3 && src[i + 2] != 0) {
+        /* startcode, so we must be past the end */
+        length = i;
     }
-#endif /* HAVE_FAST_UNALIGNED */
 
     if (i >= length - 1 && small_padding) { // no escaped 0
         nal->data     =
@@ -90,8 +54,7 @@ int ff_h2645_extract_rbsp(const uint8_t *src, int length,
         nal->size     =
         nal->raw_size = length;
         return length;
-    } else if (i > length)
-        i = length;
+    }
 
     dst = &rbsp->rbsp_buffer[rbsp->rbsp_buffer_size];
 
@@ -99,37 +62,40 @@ int ff_h2645_extract_rbsp(const uint8_t *src, int length,
     si = di = i;
     while (si + 2 < length) {
         // remove escapes (very rare 1:2^22)
-        if (src[si + 2] > 3) {
-            dst[di++] = src[si++];
-            dst[di++] = src[si++];
-        } else if (src[si] == 0 && src[si + 1] == 0 && src[si + 2] != 0) {
-            if (src[si + 2] == 3) { // escape
-                dst[di++] = 0;
-                dst[di++] = 0;
-                si       += 3;
-
-                if (nal->skipped_bytes_pos) {
-                    nal->skipped_bytes++;
-                    if (nal->skipped_bytes_pos_size < nal->skipped_bytes) {
-                        nal->skipped_bytes_pos_size *= 2;
-                        av_assert0(nal->skipped_bytes_pos_size >= nal->skipped_bytes);
-                        av_reallocp_array(&nal->skipped_bytes_pos,
-                                nal->skipped_bytes_pos_size,
-                                sizeof(*nal->skipped_bytes_pos));
-                        if (!nal->skipped_bytes_pos) {
-                            nal->skipped_bytes_pos_size = 0;
-                            return AVERROR(ENOMEM);
-                        }
+        int n = sc->find_escape(src + si, length - si);
+
+        memcpy(dst + di, src + si, n);
+        si += n;
+        di += n;
+        if (si + 2 >= length)
+            break;
+
+        if (src[si + 2] == 3) { // escape
+            dst[di++] = 0;
+            dst[di++] = 0;
+            si       += 3;
+
+            if (nal->skipped_bytes_pos) {
+                nal->skipped_bytes++;
+                if (nal->skipped_bytes_pos_size < nal->skipped_bytes) {
+                    nal->skipped_bytes_pos_size *= 2;
+                    av_assert0(nal->skipped_bytes_pos_size >= nal->skipped_bytes);
+                    av_reallocp_array(&nal->skipped_bytes_pos,
+                            nal->skipped_bytes_pos_size,
+                            sizeof(*nal->skipped_bytes_pos));
+                    if (!nal->skipped_bytes_pos) {
+                        nal->skipped_bytes_pos_size = 0;
+                        return AVERROR(ENOMEM);
                     }
-                    if (nal->skipped_bytes_pos)
-                        nal->skipped_bytes_pos[nal->skipped_bytes-1] = di - 1;
                 }
-                continue;
-            } else // next start code
-                goto nsc;
+                if (nal->skipped_bytes_pos)
+                    nal->skipped_bytes_pos[nal->skipped_bytes-1] = di - 1;
+            }
+        } else if (src[si + 2]) { // next start code
+            goto nsc;
+        } else { // 00 00 00, the escape can only start at the second zero
+            dst[di++] = src[si++];
         }
-
-        dst[di++] = src[si++];
     }
     while (si < length)
         dst[di++] = src[si++];
@@ -469,6 +435,9 @@ int ff_h2645_packet_split(H2645Packet *pkt, const uint8_t *buf, int length,
     int next_avc = is_nalff ? 0 : length;
     int64_t padding = small_padding ? 0 : MAX_MBPAIR_SIZE;
 
+    if (!pkt->startcode.find_escape)
+        ff_startcode_init(&pkt->startcode);
+
     bytestream2_init(&bc, buf, length);
     alloc_rbsp_buffer(&pkt->rbsp, length + padding, use_ref);
 
@@ -547,7 +516,8 @@ int ff_h2645_packet_split(H2645Packet *pkt, const uint8_t *buf, int length,
         }
         nal = &pkt->nals[pkt->nb_nals];
 
-        consumed = ff_h2645_extract_rbsp(bc.buffer, extract_length, &pkt->rbsp, nal, small_padding);
+        consumed = ff_h2645_extract_rbsp(&pkt->startcode, bc.buffer, extract_length,
+                                         &pkt->rbsp, nal, small_padding);
         if (consumed < 0)
             return consumed;
 
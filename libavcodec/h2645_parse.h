@@ -28,6 +28,7 @@
 #include "libavutil/log.h"
 #include "codec_id.h"
 #include "get_bits.h"
+#include "startcode.h"
 
 #define MAX_MBPAIR_SIZE (256*1024) // a tighter bound could be calculated if someone cares about a few bytes
 
@@ -85,12 +86,16 @@ typedef struct H2645Packet {
     int nb_nals;
     int nals_allocated;
     unsigned nal_buffer_size;
+    StartCodeContext startcode;
 } H2645Packet;
 
 /**
  * Extract the raw (unescaped) bitstream.
+ *
+ * @param sc start code functions, set up with ff_startcode_init()
  */
-int ff_h2645_extract_rbsp(const uint8_t *src, int length, H2645RBSP *rbsp,
+int ff_h2645_extract_rbsp(const StartCodeContext *sc,
+                          const uint8_t *src, int length, H2645RBSP *rbsp,
                           H2645NAL *nal, int small_padding);
 
 /**
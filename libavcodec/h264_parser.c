@@ -53,6 +53,7 @@ typedef struct H264ParseContext {
     ParseContext pc;
     H264ParamSets ps;
     H264DSPContext h264dsp;
+    StartCodeContext startcode;
     H264POCContext poc;
     H264SEIContext sei;
     int is_avc;
@@ -321,7 +322,8 @@ static inline int parse_nal_units(AVCodecParserContext *s,
             }
             break;
         }
-        consumed = ff_h2645_extract_rbsp(buf + buf_index, src_length, &rbsp, &nal, 1);
+        consumed = ff_h2645_extract_rbsp(&p->startcode, buf + buf_index, src_length,
+                                         &rbsp, &nal, 1);
         if (consumed < 0)
             break;
 
@@ -683,6 +685,7 @@ static av_cold int init(AVCodecParserContext *s)
     p->reference_dts = AV_NOPTS_VALUE;
     p->last_frame_num = INT_MAX;
     ff_h264dsp_init(&p->h264dsp, 8, 1);
+    ff_startcode_init(&p->startcode);
     return 0;
 }
 
@@ -66,6 +66,8 @@
 av_cold void ff_h264dsp_init(H264DSPContext *c, const int bit_depth,
                              const int chroma_format_idc)
 {
+    StartCodeContext startcode;
+
 #undef FUNC
 #define FUNC(a, depth) a ## _ ## depth ## _c
 
@@ -150,7 +152,8 @@ av_cold void ff_h264dsp_init(H264DSPContext *c, const int bit_depth,
         H264_DSP(8);
         break;
     }
-    c->startcode_find_candidate = ff_startcode_find_candidate_c;
+    ff_startcode_init(&startcode);
+    c->startcode_find_candidate = startcode.find_candidate;
 
 #if ARCH_AARCH64
     ff_h264dsp_init_aarch64(c, bit_depth, chroma_format_idc);
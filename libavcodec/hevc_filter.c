@@ -873,15 +873,15 @@ void ff_hevc_hls_filter(HEVCLocalContext *lc, int x, int y, int ctb_size)
             sao_filter_CTB(lc, s, x - ctb_size, y);
         if (y && x_end) {
             sao_filter_CTB(lc, s, x, y - ctb_size);
-            if (s->threads_type & FF_THREAD_FRAME )
+            if (s->threads_type & FF_THREAD_FRAME && !s->wpp_pool_active)
                 ff_thread_report_progress(&s->ref->tf, y, 0);
         }
         if (x_end && y_end) {
             sao_filter_CTB(lc, s, x , y);
-            if (s->threads_type & FF_THREAD_FRAME )
+            if (s->threads_type & FF_THREAD_FRAME && !s->wpp_pool_active)
                 ff_thread_report_progress(&s->ref->tf, y + ctb_size, 0);
         }
-    } else if (s->threads_type & FF_THREAD_FRAME && x_end)
+    } else if (s->threads_type & FF_THREAD_FRAME && !s->wpp_pool_active && x_end)
         ff_thread_report_progress(&s->ref->tf, y + ctb_size - 4, 0);
 }
 
@@ -0,0 +1,150 @@
+/*
+ * HEVC wavefront row progress for frame threads
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "config.h"
+
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "hevc_wpp.h"
+
+#if HAVE_THREADS
+
+int ff_hevc_wpp_progress_init(HEVCWPPProgress *p)
+{
+    int ret;
+
+    memset(p, 0, sizeof(*p));
+    if ((ret = pthread_mutex_init(&p->mutex, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&p->cond, NULL))) {
+        pthread_mutex_destroy(&p->mutex);
+        return AVERROR(ret);
+    }
+    p->init = 1;
+    return 0;
+}
+
+void ff_hevc_wpp_progress_free(HEVCWPPProgress *p)
+{
+    if (!p->init)
+        return;
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->mutex);
+    av_freep(&p->entries);
+    av_freep(&p->finished);
+    p->nb_entries        = 0;
+    p->entries_allocated = 0;
+    p->init              = 0;
+}
+
+int ff_hevc_wpp_progress_reset(HEVCWPPProgress *p, int nb_rows, int first_row)
+{
+    p->nb_entries = 0;
+    if (p->entries_allocated < nb_rows) {
+        av_freep(&p->entries);
+        av_freep(&p->finished);
+        p->entries_allocated = 0;
+        p->entries  = av_calloc(nb_rows, sizeof(*p->entries));
+        p->finished = av_calloc(nb_rows, sizeof(*p->finished));
+        if (!p->entries || !p->finished)
+            return AVERROR(ENOMEM);
+        p->entries_allocated = nb_rows;
+    } else {
+        memset(p->entries,  0, nb_rows * sizeof(*p->entries));
+        memset(p->finished, 0, nb_rows * sizeof(*p->finished));
+    }
+    p->nb_entries  = nb_rows;
+    p->nb_finished = 0;
+    p->first_row   = first_row;
+    return 0;
+}
+
+void ff_hevc_wpp_report_progress(HEVCWPPProgress *p, int row, int n)
+{
+    pthread_mutex_lock(&p->mutex);
+    p->entries[row] += n;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+}
+
+void ff_hevc_wpp_await_progress(HEVCWPPProgress *p, int row, int shift)
+{
+    if (!row)
+        return;
+
+    pthread_mutex_lock(&p->mutex);
+    while (p->entries[row - 1] - p->entries[row] < shift)
+        pthread_cond_wait(&p->cond, &p->mutex);
+    pthread_mutex_unlock(&p->mutex);
+}
+
+void ff_hevc_wpp_row_finished(HEVCWPPProgress *p, int row,
+                              ThreadFrame *tf, int log2_ctb_size)
+{
+    int last;
+
+    pthread_mutex_lock(&p->mutex);
+    p->finished[row] = 1;
+    last = p->nb_finished;
+    while (p->nb_finished < p->nb_entries && p->finished[p->nb_finished])
+        p->nb_finished++;
+
+    if (tf && p->nb_finished > last) {
+        int ctb_row = p->first_row + p->nb_finished - 1;
+        if (ctb_row >= 1)
+            ff_thread_report_progress(tf, (ctb_row - 1) << log2_ctb_size, 0);
+    }
+    pthread_mutex_unlock(&p->mutex);
+}
+
+#else
+
+int ff_hevc_wpp_progress_init(HEVCWPPProgress *p)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_hevc_wpp_progress_free(HEVCWPPProgress *p)
+{
+}
+
+int ff_hevc_wpp_progress_reset(HEVCWPPProgress *p, int nb_rows, int first_row)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_hevc_wpp_report_progress(HEVCWPPProgress *p, int row, int n)
+{
+}
+
+void ff_hevc_wpp_await_progress(HEVCWPPProgress *p, int row, int shift)
+{
+}
+
+void ff_hevc_wpp_row_finished(HEVCWPPProgress *p, int row,
+                              ThreadFrame *tf, int log2_ctb_size)
+{
+}
+
+#endif /* HAVE_THREADS */
@@ -0,0 +1,74 @@
+/*
+ * HEVC wavefront row progress for frame threads
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_HEVC_WPP_H
+#define AVCODEC_HEVC_WPP_H
+
+#include "config.h"
+
+#include "libavutil/thread.h"
+
+#include "threadframe.h"
+
+/**
+ * Row progress of the WPP slice currently decoded by one frame thread,
+ * used instead of the slice threading progress when the rows run on a
+ * worker pool shared between the frame threads.
+ */
+typedef struct HEVCWPPProgress {
+#if HAVE_THREADS
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+#endif
+    int init;
+    int *entries;       ///< CTBs decoded per row
+    uint8_t *finished;  ///< rows whose job has returned
+    int nb_entries;     ///< rows of the current slice
+    int entries_allocated;
+    int nb_finished;    ///< number of leading rows that have returned
+    int first_row;      ///< CTB row of the picture the slice starts at
+} HEVCWPPProgress;
+
+int  ff_hevc_wpp_progress_init(HEVCWPPProgress *p);
+void ff_hevc_wpp_progress_free(HEVCWPPProgress *p);
+
+/**
+ * Reset the progress for a slice with nb_rows rows starting at CTB row
+ * first_row of the picture.
+ */
+int  ff_hevc_wpp_progress_reset(HEVCWPPProgress *p, int nb_rows, int first_row);
+
+void ff_hevc_wpp_report_progress(HEVCWPPProgress *p, int row, int n);
+
+/**
+ * Wait until row - 1 is at least shift CTBs ahead of row.
+ */
+void ff_hevc_wpp_await_progress(HEVCWPPProgress *p, int row, int shift);
+
+/**
+ * Mark row as returned. Once all rows up to and including picture CTB row K
+ * have returned, the in-loop filters are done for everything above CTB row
+ * K - 1 and that much is reported on tf, if not NULL. Reporting happens with
+ * the progress lock held, so the reported value never goes backwards.
+ */
+void ff_hevc_wpp_row_finished(HEVCWPPProgress *p, int row,
+                              ThreadFrame *tf, int log2_ctb_size);
+
+#endif /* AVCODEC_HEVC_WPP_H */
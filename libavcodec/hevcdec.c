@@ -35,6 +35,7 @@
 #include "libavutil/md5.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/slicethread.h"
 #include "libavutil/timecode.h"
 
 #include "bswapdsp.h"
@@ -2586,6 +2587,24 @@ static int hls_slice_data(HEVCContext *s)
     s->avctx->execute(s->avctx, hls_decode_entry, NULL, &ret , 1, 0);
     return ret;
 }
+
+static void wpp_report_progress(const HEVCContext *s, int ctb_row, int thread, int n)
+{
+    /* Casting const away here is safe, the progress has its own lock. */
+    if (s->wpp_pool_active)
+        ff_hevc_wpp_report_progress((HEVCWPPProgress *)&s->wpp_progress, ctb_row, n);
+    else
+        ff_thread_report_progress2(s->avctx, ctb_row, thread, n);
+}
+
+static void wpp_await_progress(const HEVCContext *s, int ctb_row, int thread, int shift)
+{
+    if (s->wpp_pool_active)
+        ff_hevc_wpp_await_progress((HEVCWPPProgress *)&s->wpp_progress, ctb_row, shift);
+    else
+        ff_thread_await_progress2(s->avctx, ctb_row, thread, shift);
+}
+
 static int hls_decode_entry_wpp(AVCodecContext *avctxt, void *hevc_lclist,
                                 int job, int self_id)
 {
@@ -2612,13 +2631,13 @@ static int hls_decode_entry_wpp(AVCodecContext *avctxt, void *hevc_lclist,
 
         hls_decode_neighbour(lc, x_ctb, y_ctb, ctb_addr_ts);
 
-        ff_thread_await_progress2(s->avctx, ctb_row, thread, SHIFT_CTB_WPP);
+        wpp_await_progress(s, ctb_row, thread, SHIFT_CTB_WPP);
 
         /* atomic_load's prototype requires a pointer to non-const atomic variable
          * (due to implementations via mutexes, where reads involve writes).
          * Of course, casting const away here is nevertheless safe. */
         if (atomic_load((atomic_int*)&s->wpp_err)) {
-            ff_thread_report_progress2(s->avctx, ctb_row , thread, SHIFT_CTB_WPP);
+            wpp_report_progress(s, ctb_row, thread, SHIFT_CTB_WPP);
             return 0;
         }
 
@@ -2636,19 +2655,19 @@ static int hls_decode_entry_wpp(AVCodecContext *avctxt, void *hevc_lclist,
         ctb_addr_ts++;
 
         ff_hevc_save_states(lc, ctb_addr_ts);
-        ff_thread_report_progress2(s->avctx, ctb_row, thread, 1);
+        wpp_report_progress(s, ctb_row, thread, 1);
         ff_hevc_hls_filters(lc, x_ctb, y_ctb, ctb_size);
 
         if (!more_data && (x_ctb+ctb_size) < s->ps.sps->width && ctb_row != s->sh.num_entry_point_offsets) {
             /* Casting const away here is safe, because it is an atomic operation. */
             atomic_store((atomic_int*)&s->wpp_err, 1);
-            ff_thread_report_progress2(s->avctx, ctb_row ,thread, SHIFT_CTB_WPP);
+            wpp_report_progress(s, ctb_row, thread, SHIFT_CTB_WPP);
             return 0;
         }
 
         if ((x_ctb+ctb_size) >= s->ps.sps->width && (y_ctb+ctb_size) >= s->ps.sps->height ) {
             ff_hevc_hls_filter(lc, x_ctb, y_ctb, ctb_size);
-            ff_thread_report_progress2(s->avctx, ctb_row , thread, SHIFT_CTB_WPP);
+            wpp_report_progress(s, ctb_row, thread, SHIFT_CTB_WPP);
             return ctb_addr_ts;
         }
         ctb_addr_rs       = s->ps.pps->ctb_addr_ts_to_rs[ctb_addr_ts];
@@ -2658,17 +2677,27 @@ static int hls_decode_entry_wpp(AVCodecContext *avctxt, void *hevc_lclist,
             break;
         }
     }
-    ff_thread_report_progress2(s->avctx, ctb_row ,thread, SHIFT_CTB_WPP);
+    wpp_report_progress(s, ctb_row, thread, SHIFT_CTB_WPP);
 
     return 0;
 error:
     s->tab_slice_address[ctb_addr_rs] = -1;
     /* Casting const away here is safe, because it is an atomic operation. */
     atomic_store((atomic_int*)&s->wpp_err, 1);
-    ff_thread_report_progress2(s->avctx, ctb_row ,thread, SHIFT_CTB_WPP);
+    wpp_report_progress(s, ctb_row, thread, SHIFT_CTB_WPP);
     return ret;
 }
 
+static void hls_decode_entry_wpp_pool(void *priv, int job, int thread,
+                                      int nb_jobs, int nb_threads)
+{
+    HEVCContext *s = priv;
+
+    s->wpp_rets[job] = hls_decode_entry_wpp(s->avctx, s->HEVClcList, job, thread);
+    ff_hevc_wpp_row_finished(&s->wpp_progress, job, &s->ref->tf,
+                             s->ps.sps->log2_ctb_size);
+}
+
 static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
 {
     const uint8_t *data = nal->data;
@@ -2738,7 +2767,18 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     }
 
     atomic_store(&s->wpp_err, 0);
-    res = ff_slice_thread_allocz_entries(s->avctx, s->sh.num_entry_point_offsets + 1);
+    if (s->wpp_pool && !s->wpp_thread) {
+        res = avpriv_slicethread_create_pooled(&s->wpp_thread, s->wpp_pool, s,
+                                               hls_decode_entry_wpp_pool,
+                                               s->threads_number);
+        if (res < 0)
+            return res;
+    }
+    if (s->wpp_pool)
+        res = ff_hevc_wpp_progress_reset(&s->wpp_progress, s->sh.num_entry_point_offsets + 1,
+                                         s->sh.slice_ctb_addr_rs / s->ps.sps->ctb_width);
+    else
+        res = ff_slice_thread_allocz_entries(s->avctx, s->sh.num_entry_point_offsets + 1);
     if (res < 0)
         return res;
 
@@ -2746,8 +2786,17 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     if (!ret)
         return AVERROR(ENOMEM);
 
-    if (s->ps.pps->entropy_coding_sync_enabled_flag)
-        s->avctx->execute2(s->avctx, hls_decode_entry_wpp, s->HEVClcList, ret, s->sh.num_entry_point_offsets + 1);
+    if (s->ps.pps->entropy_coding_sync_enabled_flag) {
+        if (s->wpp_pool) {
+            /* The rows report frame progress themselves, see
+             * hls_decode_entry_wpp_pool(). */
+            s->wpp_rets        = ret;
+            s->wpp_pool_active = 1;
+            avpriv_slicethread_execute(s->wpp_thread, s->sh.num_entry_point_offsets + 1, 0);
+            s->wpp_pool_active = 0;
+        } else
+            s->avctx->execute2(s->avctx, hls_decode_entry_wpp, s->HEVClcList, ret, s->sh.num_entry_point_offsets + 1);
+    }
 
     for (i = 0; i <= s->sh.num_entry_point_offsets; i++)
         res += ret[i];
@@ -3529,6 +3578,10 @@ static av_cold int hevc_decode_free(AVCodecContext *avctx)
     av_freep(&s->HEVClc);
     av_freep(&s->HEVClcList);
 
+    avpriv_slicethread_free(&s->wpp_thread);
+    avpriv_slicethread_pool_unref(&s->wpp_pool);
+    ff_hevc_wpp_progress_free(&s->wpp_progress);
+
     ff_h2645_packet_uninit(&s->pkt);
 
     ff_hevc_reset_sei(&s->sei);
@@ -3637,6 +3690,9 @@ static int hevc_update_thread_context(AVCodecContext *dst,
     s->threads_number      = s0->threads_number;
     s->threads_type        = s0->threads_type;
 
+    if (s0->wpp_pool && !s->wpp_pool)
+        s->wpp_pool = avpriv_slicethread_pool_ref(s0->wpp_pool);
+
     if (s0->eos) {
         s->seq_decode = (s->seq_decode + 1) & HEVC_SEQUENCE_COUNTER_MASK;
         s->max_ra = INT_MAX;
@@ -3696,10 +3752,30 @@ static av_cold int hevc_decode_init(AVCodecContext *avctx)
     else
         s->threads_type = FF_THREAD_SLICE;
 
+    /* The rows of WPP slices can be decoded by a pool of workers, shared
+     * between all frame threads if there are any. Without frame threading,
+     * e.g. with low delay, the pool replaces the slice threads for them. */
+    if (s->wpp_threads > 0)
+        s->threads_number = s->wpp_threads + 1;
+
     ret = hevc_init_context(avctx);
     if (ret < 0)
         return ret;
 
+    if (s->wpp_threads > 0) {
+        ret = ff_hevc_wpp_progress_init(&s->wpp_progress);
+        if (ret < 0)
+            return ret;
+        if (!avctx->internal->is_copy) {
+            s->wpp_pool = avpriv_slicethread_pool_get_shared();
+            if (!s->wpp_pool) {
+                ret = avpriv_slicethread_pool_create(&s->wpp_pool, s->wpp_threads);
+                if (ret < 0)
+                    return ret;
+            }
+        }
+    }
+
     s->enable_parallel_tiles = 0;
     s->sei.picture_timing.picture_struct = 0;
     s->eos = 1;
@@ -3740,6 +3816,8 @@ static const AVOption options[] = {
         AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, PAR },
     { "strict-displaywin", "stricly apply default display window size", OFFSET(apply_defdispwin),
         AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, PAR },
+    { "wpp_threads", "Number of threads decoding WPP rows, shared by the frame threads", OFFSET(wpp_threads),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, PAR },
     { NULL },
 };
 
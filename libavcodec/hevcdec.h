@@ -38,6 +38,7 @@
 #include "hevc.h"
 #include "hevc_ps.h"
 #include "hevc_sei.h"
+#include "hevc_wpp.h"
 #include "hevcdsp.h"
 #include "h274.h"
 #include "threadframe.h"
@@ -583,6 +584,19 @@ typedef struct HEVCContext {
     int enable_parallel_tiles;
     atomic_int wpp_err;
 
+    /**
+     * WPP row workers, shared by all frame threads if frame threading is
+     * active, used when wpp_threads is set. This is the process-wide pool
+     * if av_thread_pool_set_shared() enabled one.
+     */
+    struct AVSliceThreadPool *wpp_pool;
+    struct AVSliceThread *wpp_thread;
+    int *wpp_rets;
+    HEVCWPPProgress wpp_progress;
+    int wpp_threads;
+    /** 1 while the rows of a WPP slice are running on wpp_pool */
+    int wpp_pool_active;
+
     const uint8_t *data;
 
     H2645Packet pkt;
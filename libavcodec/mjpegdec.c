@@ -30,11 +30,14 @@
  * MJPEG decoder.
  */
 
+#include <stdatomic.h>
+
 #include "config_components.h"
 
 #include "libavutil/display.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/avassert.h"
+#include "libavutil/mem_internal.h"
 #include "libavutil/opt.h"
 #include "avcodec.h"
 #include "blockdsp.h"
@@ -810,10 +813,11 @@ int ff_mjpeg_decode_sof(MJpegDecodeContext *s)
     return 0;
 }
 
-static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
+static inline int mjpeg_decode_dc(MJpegDecodeContext *s, GetBitContext *gb,
+                                  int dc_index)
 {
     int code;
-    code = get_vlc2(&s->gb, s->vlcs[0][dc_index].table, 9, 2);
+    code = get_vlc2(gb, s->vlcs[0][dc_index].table, 9, 2);
     if (code < 0 || code > 16) {
         av_log(s->avctx, AV_LOG_WARNING,
                "mjpeg_decode_dc: bad vlc: %d:%d (%p)\n",
@@ -822,47 +826,48 @@ static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
     }
 
     if (code)
-        return get_xbits(&s->gb, code);
+        return get_xbits(gb, code);
     else
         return 0;
 }
 
 /* decode block and dequantize */
-static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
+static int decode_block(MJpegDecodeContext *s, GetBitContext *gb,
+                        int16_t *block, int *last_dc, int component,
                         int dc_index, int ac_index, uint16_t *quant_matrix)
 {
     int code, i, j, level, val;
 
     /* DC coef */
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, gb, dc_index);
     if (val == 0xfffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
     }
-    val = val * (unsigned)quant_matrix[0] + s->last_dc[component];
+    val = val * (unsigned)quant_matrix[0] + last_dc[component];
     val = av_clip_int16(val);
-    s->last_dc[component] = val;
+    last_dc[component] = val;
     block[0] = val;
     /* AC coefs */
     i = 0;
-    {OPEN_READER(re, &s->gb);
+    {OPEN_READER(re, gb);
     do {
-        UPDATE_CACHE(re, &s->gb);
-        GET_VLC(code, re, &s->gb, s->vlcs[1][ac_index].table, 9, 2);
+        UPDATE_CACHE(re, gb);
+        GET_VLC(code, re, gb, s->vlcs[1][ac_index].table, 9, 2);
 
         i += ((unsigned)code) >> 4;
             code &= 0xf;
         if (code) {
             if (code > MIN_CACHE_BITS - 16)
-                UPDATE_CACHE(re, &s->gb);
+                UPDATE_CACHE(re, gb);
 
             {
-                int cache = GET_CACHE(re, &s->gb);
+                int cache = GET_CACHE(re, gb);
                 int sign  = (~cache) >> 31;
                 level     = (NEG_USR32(sign ^ cache,code) ^ sign) - sign;
             }
 
-            LAST_SKIP_BITS(re, &s->gb, code);
+            LAST_SKIP_BITS(re, gb, code);
 
             if (i > 63) {
                 av_log(s->avctx, AV_LOG_ERROR, "error count: %d\n", i);
@@ -872,7 +877,7 @@ static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
             block[j] = level * quant_matrix[i];
         }
     } while (i < 63);
-    CLOSE_READER(re, &s->gb);}
+    CLOSE_READER(re, gb);}
 
     return 0;
 }
@@ -883,7 +888,7 @@ static int decode_dc_progressive(MJpegDecodeContext *s, int16_t *block,
 {
     unsigned val;
     s->bdsp.clear_block(block);
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, &s->gb, dc_index);
     if (val == 0xfffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
@@ -1177,7 +1182,7 @@ static int ljpeg_decode_rgb_scan(MJpegDecodeContext *s, int nb_components, int p
                 topleft[i] = top[i];
                 top[i]     = buffer[mb_x][i];
 
-                dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                 if(dc == 0xFFFFF)
                     return -1;
 
@@ -1311,7 +1316,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for(j=0; j<n; j++) {
                         int pred, dc;
 
-                        dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                        dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                         if(dc == 0xFFFFF)
                             return -1;
                         if (   h * mb_x + x >= s->width
@@ -1382,7 +1387,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for (j = 0; j < n; j++) {
                         int pred;
 
-                        dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                        dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                         if(dc == 0xFFFFF)
                             return -1;
                         if (   h * mb_x + x >= s->width
@@ -1451,6 +1456,142 @@ static void shift_output(MJpegDecodeContext *s, uint8_t *ptr, int linesize)
     }
 }
 
+typedef struct RestartScan {
+    const uint8_t *buf;         ///< unescaped scan, restart_pos is relative to it
+    int start, end;             ///< entropy-coded data of the scan in buf
+    int nb_components;
+    int nb_segments;
+    int chroma_width, chroma_height;
+    uint8_t *data[MAX_COMPONENTS];
+    atomic_int nb_errors;
+} RestartScan;
+
+/**
+ * Return the number of restart intervals the current baseline scan can be
+ * split into for slice threading, or 0 if it has to be decoded serially.
+ */
+static int count_restart_segments(MJpegDecodeContext *s)
+{
+    int64_t nb_mbs = (int64_t)s->mb_width * s->mb_height;
+    int64_t nb_segments;
+
+    if (!(s->avctx->active_thread_type & FF_THREAD_SLICE) ||
+        s->avctx->thread_count <= 1 || s->restart_interval <= 0 ||
+        s->avctx->codec_id == AV_CODEC_ID_THP ||
+        s->gb.buffer != s->buffer || (get_bits_count(&s->gb) & 7))
+        return 0;
+
+    nb_segments = (nb_mbs + s->restart_interval - 1) / s->restart_interval;
+    /* each interval but the last has to end with its marker, anything
+     * else is left to the error resilience of the serial decoder */
+    if (nb_segments < 2 || s->nb_restart_pos != nb_segments - 1 ||
+        s->restart_pos[0] < get_bits_count(&s->gb) >> 3)
+        return 0;
+
+    return nb_segments;
+}
+
+static int decode_restart_segment(AVCodecContext *avctx, void *arg,
+                                  int jobnr, int threadnr)
+{
+    MJpegDecodeContext *s = avctx->priv_data;
+    RestartScan *rs = arg;
+    const int bytes_per_pixel = 1 + (s->bits > 8);
+    int start = jobnr ? s->restart_pos[jobnr - 1] + 2 : rs->start;
+    int end   = jobnr < rs->nb_segments - 1 ? s->restart_pos[jobnr] : rs->end;
+    int mb     = jobnr * s->restart_interval;
+    int mb_end = FFMIN(mb + s->restart_interval, s->mb_width * s->mb_height);
+    int last_dc[MAX_COMPONENTS];
+    GetBitContext gb;
+    LOCAL_ALIGNED_32(int16_t, block, [64]);
+
+    if (end < start || init_get_bits8(&gb, rs->buf + start, end - start) < 0)
+        goto fail;
+
+    for (int i = 0; i < rs->nb_components; i++)
+        last_dc[i] = 4 << s->bits;
+
+    for (; mb < mb_end; mb++) {
+        int mb_x = mb % s->mb_width;
+        int mb_y = mb / s->mb_width;
+
+        if (get_bits_left(&gb) < 0) {
+            av_log(avctx, AV_LOG_ERROR, "overread %d\n", -get_bits_left(&gb));
+            goto fail;
+        }
+        for (int i = 0; i < rs->nb_components; i++) {
+            int c = s->comp_index[i];
+            int h = s->h_scount[i];
+            int v = s->v_scount[i];
+            int width  = c == 1 || c == 2 ? rs->chroma_width  : s->width;
+            int height = c == 1 || c == 2 ? rs->chroma_height : s->height;
+
+            for (int j = 0; j < s->nb_blocks[i]; j++) {
+                int x = h * mb_x + j % h;
+                int y = v * mb_y + j / h;
+
+                s->bdsp.clear_block(block);
+                if (decode_block(s, &gb, block, last_dc, i,
+                                 s->dc_index[i], s->ac_index[i],
+                                 s->quant_matrixes[s->quant_sindex[i]]) < 0) {
+                    av_log(avctx, AV_LOG_ERROR, "error y=%d x=%d\n", mb_y, mb_x);
+                    goto fail;
+                }
+                if (8 * x < width && 8 * y < height && s->linesize[c]) {
+                    uint8_t *ptr = rs->data[c] +
+                                   ((s->linesize[c] * y * 8 +
+                                     x * 8 * bytes_per_pixel) >> avctx->lowres);
+                    if (s->interlaced && s->bottom_field)
+                        ptr += s->linesize[c] >> 1;
+                    s->idsp.idct_put(ptr, s->linesize[c], block);
+                    if (s->bits & 7)
+                        shift_output(s, ptr, s->linesize[c]);
+                }
+            }
+        }
+    }
+    return 0;
+
+fail:
+    atomic_fetch_add_explicit(&rs->nb_errors, 1, memory_order_relaxed);
+    return AVERROR_INVALIDDATA;
+}
+
+/**
+ * Decode a baseline scan with restart markers, one restart interval per
+ * slice thread job. The intervals are independent: each starts byte
+ * aligned after its RSTn marker with the DC predictors reset.
+ */
+static int mjpeg_decode_scan_restart(MJpegDecodeContext *s, int nb_components,
+                                     int nb_segments, uint8_t *const *data,
+                                     int chroma_width, int chroma_height)
+{
+    RestartScan rs = {
+        .buf           = s->gb.buffer,
+        .start         = get_bits_count(&s->gb) >> 3,
+        .end           = s->gb.size_in_bits >> 3,
+        .nb_components = nb_components,
+        .nb_segments   = nb_segments,
+        .chroma_width  = chroma_width,
+        .chroma_height = chroma_height,
+    };
+    int nb_errors;
+
+    memcpy(rs.data, data, sizeof(rs.data));
+    atomic_init(&rs.nb_errors, 0);
+
+    s->avctx->execute2(s->avctx, decode_restart_segment, &rs, NULL, nb_segments);
+
+    skip_bits_long(&s->gb, get_bits_left(&s->gb));
+    nb_errors = atomic_load_explicit(&rs.nb_errors, memory_order_relaxed);
+    if (nb_errors) {
+        av_log(s->avctx, AV_LOG_ERROR, "%d of %d restart intervals with errors\n",
+               nb_errors, nb_segments);
+        return AVERROR_INVALIDDATA;
+    }
+    return 0;
+}
+
 static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
                              int Al, const uint8_t *mb_bitmask,
                              int mb_bitmask_size,
@@ -1462,6 +1603,7 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
     int linesize[MAX_COMPONENTS];
     GetBitContext mb_bitmask_gb = {0}; // initialize to silence gcc warning
     int bytes_per_pixel = 1 + (s->bits > 8);
+    int nb_segments;
 
     if (mb_bitmask) {
         if (mb_bitmask_size != (s->mb_width * s->mb_height + 7)>>3) {
@@ -1486,6 +1628,11 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
         s->coefs_finished[c] |= 1;
     }
 
+    if (!mb_bitmask && !s->progressive &&
+        (nb_segments = count_restart_segments(s)))
+        return mjpeg_decode_scan_restart(s, nb_components, nb_segments, data,
+                                         chroma_width, chroma_height);
+
     for (mb_y = 0; mb_y < s->mb_height; mb_y++) {
         for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
             const int copy_mb = mb_bitmask && !get_bits1(&mb_bitmask_gb);
@@ -1527,7 +1674,7 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
 
                         } else {
                             s->bdsp.clear_block(s->block);
-                            if (decode_block(s, s->block, i,
+                            if (decode_block(s, &s->gb, s->block, s->last_dc, i,
                                              s->dc_index[i], s->ac_index[i],
                                              s->quant_matrixes[s->quant_sindex[i]]) < 0) {
                                 av_log(s->avctx, AV_LOG_ERROR,
@@ -2231,6 +2378,23 @@ found:
     return val;
 }
 
+static void add_restart_pos(MJpegDecodeContext *s, ptrdiff_t pos)
+{
+    int *tmp;
+
+    if (s->nb_restart_pos < 0)
+        return;
+    tmp = av_fast_realloc(s->restart_pos, &s->restart_pos_size,
+                          (s->nb_restart_pos + 1) * sizeof(*s->restart_pos));
+    if (!tmp) {
+        /* the scan is then decoded without slice threads */
+        s->nb_restart_pos = -1;
+        return;
+    }
+    s->restart_pos = tmp;
+    s->restart_pos[s->nb_restart_pos++] = pos;
+}
+
 int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                          const uint8_t **buf_ptr, const uint8_t *buf_end,
                          const uint8_t **unescaped_buf_ptr,
@@ -2248,6 +2412,11 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
         const uint8_t *src = *buf_ptr;
         const uint8_t *ptr = src;
         uint8_t *dst = s->buffer;
+        /* the restart markers are only needed to split the scan between
+         * slice threads, the bitstream reader skips them by itself */
+        int find_restart = s->avctx->active_thread_type & FF_THREAD_SLICE;
+
+        s->nb_restart_pos = 0;
 
         #define copy_data_segment(skip) do {       \
             ptrdiff_t length = (ptr - src) - (skip);  \
@@ -2286,6 +2455,9 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                         copy_data_segment(1);
                         if (x)
                             break;
+                    } else if (find_restart) {
+                        /* offset of the 0xFF of the marker in dst */
+                        add_restart_pos(s, (dst - s->buffer) + (ptr - src) - 2);
                     }
                 }
             }
@@ -2946,6 +3118,7 @@ av_cold int ff_mjpeg_decode_end(AVCodecContext *avctx)
     av_frame_free(&s->smv_frame);
 
     av_freep(&s->buffer);
+    av_freep(&s->restart_pos);
     av_freep(&s->stereo3d);
     av_freep(&s->ljpeg_buffer);
     s->ljpeg_buffer_size = 0;
@@ -3003,7 +3176,7 @@ const FFCodec ff_mjpeg_decoder = {
     .close          = ff_mjpeg_decode_end,
     FF_CODEC_DECODE_CB(ff_mjpeg_decode_frame),
     .flush          = decode_flush,
-    .p.capabilities = AV_CODEC_CAP_DR1,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_SLICE_THREADS,
     .p.max_lowres   = 3,
     .p.priv_class   = &mjpegdec_class,
     .p.profiles     = NULL_IF_CONFIG_SMALL(ff_mjpeg_profiles),
@@ -123,6 +123,9 @@ typedef struct MJpegDecodeContext {
 
     int restart_interval;
     int restart_count;
+    int *restart_pos;   ///< offsets of the RSTn markers in the unescaped scan, see ff_mjpeg_find_marker()
+    unsigned int restart_pos_size;
+    int nb_restart_pos;
 
     int buggy_avid;
     int cs_itu601;
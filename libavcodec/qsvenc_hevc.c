@@ -58,6 +58,7 @@ static int generate_fake_vps(QSVEncContext *q, AVCodecContext *avctx)
     GetBitContext gb;
     H2645RBSP sps_rbsp = { NULL };
     H2645NAL sps_nal = { NULL };
+    StartCodeContext startcode;
     HEVCSPS sps = { 0 };
     HEVCVPS vps = { 0 };
     uint8_t vps_buf[128], vps_rbsp_buf[128];
@@ -75,7 +76,9 @@ static int generate_fake_vps(QSVEncContext *q, AVCodecContext *avctx)
         return AVERROR(ENOMEM);
 
     /* parse the SPS */
-    ret = ff_h2645_extract_rbsp(avctx->extradata + 4, avctx->extradata_size - 4, &sps_rbsp, &sps_nal, 1);
+    ff_startcode_init(&startcode);
+    ret = ff_h2645_extract_rbsp(&startcode, avctx->extradata + 4, avctx->extradata_size - 4,
+                                &sps_rbsp, &sps_nal, 1);
     if (ret < 0) {
         av_log(avctx, AV_LOG_ERROR, "Error unescaping the SPS buffer\n");
         return ret;
@@ -25,7 +25,9 @@
  * @author Michael Niedermayer <michaelni@gmx.at>
  */
 
+#include "libavutil/attributes.h"
 #include "libavutil/intreadwrite.h"
+#include "libavutil/macros.h"
 #include "startcode.h"
 #include "config.h"
 
@@ -54,5 +56,60 @@ int ff_startcode_find_candidate_c(const uint8_t *buf, int size)
     for (; i < size; i++)
         if (!buf[i])
             break;
-    return i;
+    /* the word loop above may have stepped past the end */
+    return FFMIN(i, size);
+}
+
+int ff_startcode_find_escape_c(const uint8_t *buf, int size)
+{
+    int i;
+
+#define ESCAPE_TEST                                                     \
+        if (i + 2 < size && !buf[i + 1] && buf[i + 2] <= 3)             \
+            return i
+#if HAVE_FAST_UNALIGNED
+    /* look for a zero byte at every other position (i.e. for a candidate
+     * 00 00 pair), then back up to the first zero byte of the run */
+#define FIND_FIRST_ZERO                                                 \
+        if (i > 0 && !buf[i])                                           \
+            i--;                                                        \
+        while (buf[i])                                                  \
+            i++
+#if HAVE_FAST_64BIT
+    for (i = 0; i + 1 < size; i += 9) {
+        if (!((~AV_RN64(buf + i) &
+               (AV_RN64(buf + i) - 0x0100010001000101ULL)) &
+              0x8000800080008080ULL))
+            continue;
+        FIND_FIRST_ZERO;
+        ESCAPE_TEST;
+        i -= 7;
+    }
+#else
+    for (i = 0; i + 1 < size; i += 5) {
+        if (!((~AV_RN32(buf + i) &
+               (AV_RN32(buf + i) - 0x01000101U)) &
+              0x80008080U))
+            continue;
+        FIND_FIRST_ZERO;
+        ESCAPE_TEST;
+        i -= 3;
+    }
+#endif /* HAVE_FAST_64BIT */
+#else
+    for (i = 0; i + 1 < size; i += 2) {
+        if (buf[i])
+            continue;
+        if (i > 0 && !buf[i - 1])
+            i--;
+        ESCAPE_TEST;
+    }
+#endif /* HAVE_FAST_UNALIGNED */
+    return size;
+}
+
+av_cold void ff_startcode_init(StartCodeContext *c)
+{
+    c->find_candidate = ff_startcode_find_candidate_c;
+    c->find_escape    = ff_startcode_find_escape_c;
 }
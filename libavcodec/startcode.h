@@ -31,6 +31,29 @@ const uint8_t *avpriv_find_start_code(const uint8_t *p,
                                       const uint8_t *end,
                                       uint32_t *state);
 
+/**
+ * The functions below read past size, so buf must be followed by
+ * AV_INPUT_BUFFER_PADDING_SIZE bytes of padding, like packet data.
+ */
+typedef struct StartCodeContext {
+    /**
+     * Return the offset of the first zero byte in buf, or size if there is
+     * none.
+     */
+    int (*find_candidate)(const uint8_t *buf, int size);
+
+    /**
+     * Return the offset of the first 00 00 xx sequence with xx <= 3 that lies
+     * entirely within size bytes, i.e. of the next emulation prevention byte,
+     * start code or 00 00 00 of an H.264/HEVC NAL unit, or size if there is
+     * none.
+     */
+    int (*find_escape)(const uint8_t *buf, int size);
+} StartCodeContext;
+
+void ff_startcode_init(StartCodeContext *c);
+
 int ff_startcode_find_candidate_c(const uint8_t *buf, int size);
+int ff_startcode_find_escape_c(const uint8_t *buf, int size);
 
 #endif /* AVCODEC_STARTCODE_H */
@@ -27,10 +27,16 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <poll.h>
+#include "config.h"
+#if CONFIG_LIBDRM
+#include <drm_fourcc.h>
+#endif
 #include "libavcodec/avcodec.h"
+#include "libavutil/hwcontext.h"
 #include "libavutil/pixdesc.h"
 #include "v4l2_context.h"
 #include "v4l2_buffers.h"
+#include "v4l2_fmt.h"
 #include "v4l2_m2m.h"
 
 #define USEC_PER_SEC 1000000
@@ -337,6 +343,217 @@ static int v4l2_buffer_buf_to_swframe(AVFrame *frame, V4L2Buffer *avbuf)
     return 0;
 }
 
+static int v4l2_buffer_buf_to_drmframe(AVFrame *frame, V4L2Buffer *avbuf)
+{
+    V4L2m2mContext *s = buf_to_m2mctx(avbuf);
+    AVDRMFrameDescriptor *desc = &avbuf->drm_frame;
+    AVDRMLayerDescriptor *layer = &desc->layers[0];
+    struct v4l2_format *fmt = &avbuf->context->format;
+    const AVPixFmtDescriptor *pixdesc = av_pix_fmt_desc_get(avbuf->context->av_pix_fmt);
+    uint32_t pixelformat = V4L2_TYPE_IS_MULTIPLANAR(fmt->type) ?
+                           fmt->fmt.pix_mp.pixelformat : fmt->fmt.pix.pixelformat;
+    int height           = V4L2_TYPE_IS_MULTIPLANAR(fmt->type) ?
+                           fmt->fmt.pix_mp.height : fmt->fmt.pix.height;
+    int i, ret, nb_planes;
+
+    if (!pixdesc || !s->frames_ref)
+        return AVERROR(EINVAL);
+
+    layer->format = ff_v4l2_format_v4l2_to_drm(pixelformat);
+    if (!layer->format)
+        return AVERROR(EINVAL);
+
+    nb_planes = av_pix_fmt_count_planes(avbuf->context->av_pix_fmt);
+    if (nb_planes > AV_DRM_MAX_PLANES)
+        return AVERROR(EINVAL);
+
+    layer->nb_planes = nb_planes;
+    if (desc->nb_objects > 1) {
+        /* one buffer per plane */
+        if (desc->nb_objects < nb_planes)
+            return AVERROR(EINVAL);
+
+        for (i = 0; i < nb_planes; i++) {
+            layer->planes[i].object_index = i;
+            layer->planes[i].offset       = avbuf->planes[i].data_offset;
+            layer->planes[i].pitch        = avbuf->plane_info[i].bytesperline;
+        }
+    } else {
+        /* all planes in a single buffer, laid out as in v4l2_buffer_buf_to_swframe() */
+        ptrdiff_t offset = V4L2_TYPE_IS_MULTIPLANAR(fmt->type) ? avbuf->planes[0].data_offset : 0;
+
+        for (i = 0; i < nb_planes; i++) {
+            int pitch = avbuf->plane_info[0].bytesperline;
+            int h     = height;
+
+            if (i) {
+                /* interleaved chroma keeps the luma pitch */
+                if (nb_planes > 2)
+                    pitch = AV_CEIL_RSHIFT(pitch, pixdesc->log2_chroma_w);
+                h = AV_CEIL_RSHIFT(h, pixdesc->log2_chroma_h);
+            }
+
+            layer->planes[i].object_index = 0;
+            layer->planes[i].offset       = offset;
+            layer->planes[i].pitch        = pitch;
+            offset += (ptrdiff_t)pitch * h;
+        }
+    }
+    desc->nb_layers = 1;
+
+    frame->buf[0] = av_buffer_create((uint8_t *)desc, sizeof(*desc),
+                                     v4l2_free_buffer, avbuf, AV_BUFFER_FLAG_READONLY);
+    if (!frame->buf[0])
+        return AVERROR(ENOMEM);
+
+    ret = v4l2_buf_increase_ref(avbuf);
+    if (ret) {
+        av_buffer_unref(&frame->buf[0]);
+        return ret;
+    }
+
+    frame->hw_frames_ctx = av_buffer_ref(s->frames_ref);
+    if (!frame->hw_frames_ctx)
+        return AVERROR(ENOMEM);
+
+    frame->data[0] = (uint8_t *)desc;
+    frame->format  = AV_PIX_FMT_DRM_PRIME;
+
+    return 0;
+}
+
+static int v4l2_buffer_export_drm(V4L2Buffer *avbuf)
+{
+    V4L2m2mContext *s = buf_to_m2mctx(avbuf);
+    AVDRMFrameDescriptor *desc = &avbuf->drm_frame;
+    int i, ret;
+
+    if (avbuf->num_planes > AV_DRM_MAX_PLANES)
+        return AVERROR(EINVAL);
+
+    for (i = 0; i < avbuf->num_planes; i++) {
+        struct v4l2_exportbuffer expbuf = {
+            .type  = avbuf->buf.type,
+            .index = avbuf->buf.index,
+            .plane = i,
+            .flags = O_RDONLY,
+        };
+
+#ifdef O_CLOEXEC
+        expbuf.flags |= O_CLOEXEC;
+#endif
+
+        ret = ioctl(s->fd, VIDIOC_EXPBUF, &expbuf);
+        if (ret < 0)
+            return AVERROR(errno);
+
+        desc->objects[i].fd   = expbuf.fd;
+        desc->objects[i].size = avbuf->plane_info[i].length;
+#if CONFIG_LIBDRM
+        desc->objects[i].format_modifier = DRM_FORMAT_MOD_LINEAR;
+#endif
+        desc->nb_objects++;
+    }
+
+    return 0;
+}
+
+static int v4l2_buffer_drmframe_to_buf(const AVFrame *frame, V4L2Buffer *out)
+{
+    const AVDRMFrameDescriptor *desc = (const AVDRMFrameDescriptor *)frame->data[0];
+    const AVDRMLayerDescriptor *layer = &desc->layers[0];
+    struct v4l2_format *fmt = &out->context->format;
+    const AVPixFmtDescriptor *pixdesc = av_pix_fmt_desc_get(out->context->av_pix_fmt);
+    uint32_t pixelformat = V4L2_TYPE_IS_MULTIPLANAR(fmt->type) ?
+                           fmt->fmt.pix_mp.pixelformat : fmt->fmt.pix.pixelformat;
+    int height           = V4L2_TYPE_IS_MULTIPLANAR(fmt->type) ?
+                           fmt->fmt.pix_mp.height : fmt->fmt.pix.height;
+    int i, ret;
+
+    if (!pixdesc || desc->nb_layers != 1 ||
+        layer->format != ff_v4l2_format_v4l2_to_drm(pixelformat) ||
+        layer->nb_planes != av_pix_fmt_count_planes(out->context->av_pix_fmt))
+        goto layout_mismatch;
+
+    if (out->num_planes > 1) {
+        /* one buffer per plane */
+        if (layer->nb_planes != out->num_planes)
+            goto layout_mismatch;
+
+        for (i = 0; i < out->num_planes; i++) {
+            const AVDRMPlaneDescriptor *plane = &layer->planes[i];
+            const AVDRMObjectDescriptor *obj  = &desc->objects[plane->object_index];
+
+            if (plane->pitch != out->plane_info[i].bytesperline ||
+                plane->offset >= obj->size)
+                goto layout_mismatch;
+
+            out->planes[i].m.fd        = obj->fd;
+            out->planes[i].data_offset = plane->offset;
+            out->planes[i].length      = obj->size;
+            out->planes[i].bytesused   = obj->size;
+        }
+    } else {
+        /* all planes in a single buffer, laid out as in v4l2_buffer_swframe_to_buf() */
+        const AVDRMObjectDescriptor *obj = &desc->objects[layer->planes[0].object_index];
+        ptrdiff_t offset = layer->planes[0].offset;
+
+        if (offset && !V4L2_TYPE_IS_MULTIPLANAR(fmt->type))
+            goto layout_mismatch;
+
+        for (i = 0; i < layer->nb_planes; i++) {
+            int pitch = out->plane_info[0].bytesperline;
+            int h     = height;
+
+            if (i) {
+                /* interleaved chroma keeps the luma pitch */
+                if (layer->nb_planes > 2)
+                    pitch = AV_CEIL_RSHIFT(pitch, pixdesc->log2_chroma_w);
+                h = AV_CEIL_RSHIFT(h, pixdesc->log2_chroma_h);
+            }
+
+            if (layer->planes[i].object_index != layer->planes[0].object_index ||
+                layer->planes[i].offset != offset || layer->planes[i].pitch != pitch)
+                goto layout_mismatch;
+            offset += (ptrdiff_t)pitch * h;
+        }
+        if (offset > obj->size)
+            goto layout_mismatch;
+
+        if (V4L2_TYPE_IS_MULTIPLANAR(fmt->type)) {
+            out->planes[0].m.fd        = obj->fd;
+            out->planes[0].data_offset = layer->planes[0].offset;
+            out->planes[0].length      = obj->size;
+            out->planes[0].bytesused   = offset;
+        } else {
+            out->buf.m.fd      = obj->fd;
+            out->buf.length    = obj->size;
+            out->buf.bytesused = offset;
+        }
+    }
+
+    if (V4L2_TYPE_IS_MULTIPLANAR(fmt->type))
+        out->buf.length = out->num_planes;
+
+    /* the driver reads the dmabufs until the buffer is dequeued again */
+    if (!out->dmabuf_frame) {
+        out->dmabuf_frame = av_frame_alloc();
+        if (!out->dmabuf_frame)
+            return AVERROR(ENOMEM);
+    }
+    av_frame_unref(out->dmabuf_frame);
+    ret = av_frame_ref(out->dmabuf_frame, frame);
+    if (ret < 0)
+        return ret;
+
+    return 0;
+
+layout_mismatch:
+    av_log(logger(out), AV_LOG_ERROR, "%s: DRM frame layout does not match the V4L2 format\n",
+           out->context->name);
+    return AVERROR(EINVAL);
+}
+
 static int v4l2_buffer_swframe_to_buf(const AVFrame *frame, V4L2Buffer *out)
 {
     int i, ret;
@@ -412,6 +629,9 @@ int ff_v4l2_buffer_avframe_to_buf(const AVFrame *frame, V4L2Buffer *out)
 {
     v4l2_set_pts(out, frame->pts);
 
+    if (frame->format == AV_PIX_FMT_DRM_PRIME)
+        return v4l2_buffer_drmframe_to_buf(frame, out);
+
     return v4l2_buffer_swframe_to_buf(frame, out);
 }
 
@@ -422,7 +642,10 @@ int ff_v4l2_buffer_buf_to_avframe(AVFrame *frame, V4L2Buffer *avbuf)
     av_frame_unref(frame);
 
     /* 1. get references to the actual data */
-    ret = v4l2_buffer_buf_to_swframe(frame, avbuf);
+    if (buf_to_m2mctx(avbuf)->output_drm)
+        ret = v4l2_buffer_buf_to_drmframe(frame, avbuf);
+    else
+        ret = v4l2_buffer_buf_to_swframe(frame, avbuf);
     if (ret)
         return ret;
 
@@ -496,7 +719,7 @@ int ff_v4l2_buffer_initialize(V4L2Buffer* avbuf, int index)
     V4L2Context *ctx = avbuf->context;
     int ret, i;
 
-    avbuf->buf.memory = V4L2_MEMORY_MMAP;
+    avbuf->buf.memory = ctx->memory;
     avbuf->buf.type = ctx->type;
     avbuf->buf.index = index;
 
@@ -509,7 +732,9 @@ int ff_v4l2_buffer_initialize(V4L2Buffer* avbuf, int index)
     if (ret < 0)
         return AVERROR(errno);
 
-    if (V4L2_TYPE_IS_MULTIPLANAR(ctx->type)) {
+    if (V4L2_TYPE_IS_MULTIPLANAR(ctx->type) && ctx->memory == V4L2_MEMORY_DMABUF) {
+        avbuf->num_planes = ctx->format.fmt.pix_mp.num_planes;
+    } else if (V4L2_TYPE_IS_MULTIPLANAR(ctx->type)) {
         avbuf->num_planes = 0;
         /* in MP, the V4L2 API states that buf.length means num_planes */
         for (i = 0; i < avbuf->buf.length; i++) {
@@ -525,6 +750,10 @@ int ff_v4l2_buffer_initialize(V4L2Buffer* avbuf, int index)
             ctx->format.fmt.pix_mp.plane_fmt[i].bytesperline :
             ctx->format.fmt.pix.bytesperline;
 
+        /* imported dmabufs are attached on each enqueue */
+        if (ctx->memory == V4L2_MEMORY_DMABUF)
+            continue;
+
         if (V4L2_TYPE_IS_MULTIPLANAR(ctx->type)) {
             avbuf->plane_info[i].length = avbuf->buf.m.planes[i].length;
             avbuf->plane_info[i].mm_addr = mmap(NULL, avbuf->buf.m.planes[i].length,
@@ -546,6 +775,12 @@ int ff_v4l2_buffer_initialize(V4L2Buffer* avbuf, int index)
     if (V4L2_TYPE_IS_OUTPUT(ctx->type))
         return 0;
 
+    if (buf_to_m2mctx(avbuf)->output_drm) {
+        ret = v4l2_buffer_export_drm(avbuf);
+        if (ret < 0)
+            return ret;
+    }
+
     if (V4L2_TYPE_IS_MULTIPLANAR(ctx->type)) {
         avbuf->buf.m.planes = avbuf->planes;
         avbuf->buf.length   = avbuf->num_planes;
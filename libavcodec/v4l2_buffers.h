@@ -30,6 +30,7 @@
 
 #include "libavutil/buffer.h"
 #include "libavutil/frame.h"
+#include "libavutil/hwcontext_drm.h"
 #include "packet.h"
 
 enum V4L2Buffer_status {
@@ -66,6 +67,14 @@ typedef struct V4L2Buffer {
     int flags;
     enum V4L2Buffer_status status;
 
+    /* DMABUF export of the planes, when capture frames are output as
+     * AV_PIX_FMT_DRM_PRIME; nb_objects is 0 otherwise */
+    AVDRMFrameDescriptor drm_frame;
+
+    /* DRM PRIME frame whose dmabufs are queued in this OUTPUT buffer, when
+     * the context uses V4L2_MEMORY_DMABUF; released once it is dequeued */
+    AVFrame *dmabuf_frame;
+
 } V4L2Buffer;
 
 /**
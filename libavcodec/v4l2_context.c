@@ -289,7 +289,8 @@ static V4L2Buffer* v4l2_dequeue_v4l2buf(V4L2Context *ctx, int timeout)
                                                 "packets/frames.\n");
     }
 
-    /* if we are draining and there are no more capture buffers queued in the driver we are done */
+    /* if we are draining and there are no more capture buffers queued in the driver
+     * or held by the user (which will be queued again once released) we are done */
     if (!V4L2_TYPE_IS_OUTPUT(ctx->type) && ctx_to_m2mctx(ctx)->draining) {
         for (i = 0; i < ctx->num_buffers; i++) {
             /* capture buffer initialization happens during decode hence
@@ -300,6 +301,8 @@ static V4L2Buffer* v4l2_dequeue_v4l2buf(V4L2Context *ctx, int timeout)
 
             if (ctx->buffers[i].status == V4L2BUF_IN_DRIVER)
                 goto start;
+            if (ctx->buffers[i].status == V4L2BUF_RET_USER)
+                return NULL;
         }
         ctx->done = 1;
         return NULL;
@@ -372,7 +375,7 @@ start:
 
 dequeue:
         memset(&buf, 0, sizeof(buf));
-        buf.memory = V4L2_MEMORY_MMAP;
+        buf.memory = ctx->memory;
         buf.type = ctx->type;
         if (V4L2_TYPE_IS_MULTIPLANAR(ctx->type)) {
             memset(planes, 0, sizeof(planes));
@@ -407,6 +410,8 @@ dequeue:
         avbuf = &ctx->buffers[buf.index];
         avbuf->status = V4L2BUF_AVAILABLE;
         avbuf->buf = buf;
+        if (avbuf->dmabuf_frame)
+            av_frame_unref(avbuf->dmabuf_frame);
         if (V4L2_TYPE_IS_MULTIPLANAR(ctx->type)) {
             memcpy(avbuf->planes, planes, sizeof(planes));
             avbuf->buf.m.planes = avbuf->planes;
@@ -439,7 +444,7 @@ static V4L2Buffer* v4l2_getfree_v4l2buf(V4L2Context *ctx)
 static int v4l2_release_buffers(V4L2Context* ctx)
 {
     struct v4l2_requestbuffers req = {
-        .memory = V4L2_MEMORY_MMAP,
+        .memory = ctx->memory,
         .type = ctx->type,
         .count = 0, /* 0 -> unmaps buffers from the driver */
     };
@@ -454,6 +459,12 @@ static int v4l2_release_buffers(V4L2Context* ctx)
                 if (munmap(p->mm_addr, p->length) < 0)
                     av_log(logger(ctx), AV_LOG_ERROR, "%s unmap plane (%s))\n", ctx->name, av_err2str(AVERROR(errno)));
         }
+
+        for (j = 0; j < buffer->drm_frame.nb_objects; j++)
+            close(buffer->drm_frame.objects[j].fd);
+        buffer->drm_frame.nb_objects = 0;
+
+        av_frame_free(&buffer->dmabuf_frame);
     }
 
     return ioctl(ctx_to_m2mctx(ctx)->fd, VIDIOC_REQBUFS, &req);
@@ -720,9 +731,12 @@ int ff_v4l2_context_init(V4L2Context* ctx)
     if (ret)
         av_log(logger(ctx), AV_LOG_ERROR, "%s VIDIOC_G_FMT failed\n", ctx->name);
 
+    if (!ctx->memory)
+        ctx->memory = V4L2_MEMORY_MMAP;
+
     memset(&req, 0, sizeof(req));
     req.count = ctx->num_buffers;
-    req.memory = V4L2_MEMORY_MMAP;
+    req.memory = ctx->memory;
     req.type = ctx->type;
     ret = ioctl(s->fd, VIDIOC_REQBUFS, &req);
     if (ret < 0) {
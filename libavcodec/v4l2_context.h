@@ -65,6 +65,13 @@ typedef struct V4L2Context {
      */
     struct v4l2_format format;
 
+    /**
+     * Memory type of the buffers, see V4L2_MEMORY_* in videodev2.h.
+     * V4L2_MEMORY_MMAP is used if left at 0; V4L2_MEMORY_DMABUF is only
+     * supported for an output context fed with AV_PIX_FMT_DRM_PRIME frames.
+     */
+    enum v4l2_memory memory;
+
     /**
      * Width and height of the frames it produces (in case of a capture context, e.g. when decoding)
      * or accepts (in case of an output context, e.g. when encoding).
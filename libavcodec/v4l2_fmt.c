@@ -23,6 +23,10 @@
 
 #include <linux/videodev2.h>
 #include <search.h>
+#include "config.h"
+#if CONFIG_LIBDRM
+#include <drm_fourcc.h>
+#endif
 #include "v4l2_fmt.h"
 
 #define V4L2_FMT(x) V4L2_PIX_FMT_##x
@@ -139,3 +143,39 @@ enum AVPixelFormat ff_v4l2_format_v4l2_to_avfmt(uint32_t v4l2_fmt, enum AVCodecI
     }
     return AV_PIX_FMT_NONE;
 }
+
+uint32_t ff_v4l2_format_v4l2_to_drm(uint32_t v4l2_fmt)
+{
+#if CONFIG_LIBDRM
+    static const struct {
+        uint32_t v4l2_fmt;
+        uint32_t drm_fmt;
+    } drm_map[] = {
+        { V4L2_FMT(NV12),    DRM_FORMAT_NV12   },
+        { V4L2_FMT(NV21),    DRM_FORMAT_NV21   },
+        { V4L2_FMT(NV16),    DRM_FORMAT_NV16   },
+        { V4L2_FMT(NV61),    DRM_FORMAT_NV61   },
+        { V4L2_FMT(YUV420),  DRM_FORMAT_YUV420 },
+        { V4L2_FMT(YVU420),  DRM_FORMAT_YVU420 },
+#ifdef V4L2_PIX_FMT_NV12M
+        { V4L2_FMT(NV12M),   DRM_FORMAT_NV12   },
+#endif
+#ifdef V4L2_PIX_FMT_NV21M
+        { V4L2_FMT(NV21M),   DRM_FORMAT_NV21   },
+#endif
+#ifdef V4L2_PIX_FMT_NV16M
+        { V4L2_FMT(NV16M),   DRM_FORMAT_NV16   },
+#endif
+#ifdef V4L2_PIX_FMT_YUV420M
+        { V4L2_FMT(YUV420M), DRM_FORMAT_YUV420 },
+#endif
+    };
+    int i;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(drm_map); i++) {
+        if (drm_map[i].v4l2_fmt == v4l2_fmt)
+            return drm_map[i].drm_fmt;
+    }
+#endif
+    return 0;
+}
@@ -32,4 +32,10 @@ enum AVPixelFormat ff_v4l2_format_v4l2_to_avfmt(uint32_t v4l2_fmt, enum AVCodecI
 uint32_t ff_v4l2_format_avcodec_to_v4l2(enum AVCodecID avcodec);
 uint32_t ff_v4l2_format_avfmt_to_v4l2(enum AVPixelFormat avfmt);
 
+/**
+ * @return the DRM fourcc describing the memory layout of a V4L2 pixel
+ *         format, or 0 if it has none (or DRM support is not compiled in)
+ */
+uint32_t ff_v4l2_format_v4l2_to_drm(uint32_t v4l2_fmt);
+
 #endif /* AVCODEC_V4L2_FMT_H*/
@@ -239,7 +239,12 @@ int ff_v4l2_m2m_codec_reinit(V4L2m2mContext *s)
         return ret;
     }
 
-    /* 5. complete reinit */
+    /* 5. the frames context describes the old format; the decoder renegotiates
+     *    the output format and builds a new one when it restarts the capture */
+    av_buffer_unref(&s->frames_ref);
+    s->output_drm = 0;
+
+    /* 6. complete reinit */
     s->draining = 0;
     s->reinit = 0;
 
@@ -258,6 +263,8 @@ static void v4l2_m2m_destroy_context(void *opaque, uint8_t *context)
     av_frame_unref(s->frame);
     av_frame_free(&s->frame);
     av_packet_unref(&s->buf_pkt);
+    av_buffer_unref(&s->frames_ref);
+    av_buffer_unref(&s->device_ref);
 
     av_free(s);
 }
@@ -64,6 +64,11 @@ typedef struct V4L2m2mContext {
     /* Reference to self; only valid while codec is active. */
     AVBufferRef *self_ref;
 
+    /* export the capture buffers as AV_PIX_FMT_DRM_PRIME frames */
+    int output_drm;
+    AVBufferRef *device_ref;
+    AVBufferRef *frames_ref;
+
     /* reference back to V4L2m2mPriv */
     void *priv;
 } V4L2m2mContext;
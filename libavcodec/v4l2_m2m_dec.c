@@ -23,17 +23,82 @@
 
 #include <linux/videodev2.h>
 #include <sys/ioctl.h>
+#include <errno.h>
+#include <poll.h>
+#include "libavutil/hwcontext.h"
 #include "libavutil/pixfmt.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/opt.h"
 #include "libavcodec/avcodec.h"
 #include "codec_internal.h"
 #include "libavcodec/decode.h"
+#include "hwconfig.h"
 
 #include "v4l2_context.h"
 #include "v4l2_m2m.h"
 #include "v4l2_fmt.h"
 
+/**
+ * Let the user choose between DRM PRIME and software frames once the capture
+ * format is known, and set up the hardware frames context for the former.
+ */
+static int v4l2_get_output_format(AVCodecContext *avctx)
+{
+    V4L2m2mContext *s = ((V4L2m2mPriv*)avctx->priv_data)->context;
+    V4L2Context *const capture = &s->capture;
+    enum AVPixelFormat pix_fmts[] = { AV_PIX_FMT_DRM_PRIME, capture->av_pix_fmt, AV_PIX_FMT_NONE };
+    AVHWFramesContext *hwfc;
+    int ret;
+
+    s->output_drm     = 0;
+    avctx->pix_fmt    = capture->av_pix_fmt;
+    avctx->sw_pix_fmt = capture->av_pix_fmt;
+
+    /* the buffers can only be exported if DRM knows their layout */
+    if (capture->av_pix_fmt == AV_PIX_FMT_NONE ||
+        !ff_v4l2_format_v4l2_to_drm(capture->format.fmt.pix_mp.pixelformat))
+        return 0;
+
+    ret = ff_get_format(avctx, pix_fmts);
+    if (ret < 0)
+        return AVERROR(EINVAL);
+    avctx->pix_fmt = ret;
+    if (avctx->pix_fmt != AV_PIX_FMT_DRM_PRIME)
+        return 0;
+
+    if (!s->device_ref) {
+        s->device_ref = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_DRM);
+        if (!s->device_ref)
+            return AVERROR(ENOMEM);
+
+        ret = av_hwdevice_ctx_init(s->device_ref);
+        if (ret < 0) {
+            av_buffer_unref(&s->device_ref);
+            return ret;
+        }
+    }
+
+    av_buffer_unref(&s->frames_ref);
+    s->frames_ref = av_hwframe_ctx_alloc(s->device_ref);
+    if (!s->frames_ref)
+        return AVERROR(ENOMEM);
+
+    hwfc = (AVHWFramesContext*)s->frames_ref->data;
+    hwfc->format    = AV_PIX_FMT_DRM_PRIME;
+    hwfc->sw_format = capture->av_pix_fmt;
+    hwfc->width     = capture->width;
+    hwfc->height    = capture->height;
+    ret = av_hwframe_ctx_init(s->frames_ref);
+    if (ret < 0) {
+        av_buffer_unref(&s->frames_ref);
+        return ret;
+    }
+
+    s->output_drm = 1;
+
+    return 0;
+}
+
 static int v4l2_try_start(AVCodecContext *avctx)
 {
     V4L2m2mContext *s = ((V4L2m2mPriv*)avctx->priv_data)->context;
@@ -62,9 +127,8 @@ static int v4l2_try_start(AVCodecContext *avctx)
         return ret;
     }
 
-    /* 2.1 update the AVCodecContext */
-    avctx->pix_fmt = ff_v4l2_format_v4l2_to_avfmt(capture->format.fmt.pix_mp.pixelformat, AV_CODEC_ID_RAWVIDEO);
-    capture->av_pix_fmt = avctx->pix_fmt;
+    /* 2.1 update the capture context */
+    capture->av_pix_fmt = ff_v4l2_format_v4l2_to_avfmt(capture->format.fmt.pix_mp.pixelformat, AV_CODEC_ID_RAWVIDEO);
 
     /* 3. set the crop parameters */
     selection.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -83,7 +147,15 @@ static int v4l2_try_start(AVCodecContext *avctx)
         }
     }
 
-    /* 4. init the capture context now that we have the capture format */
+    /* 4. choose the output pixel format, which decides whether the capture
+     *    buffers are exported as DMABUFs */
+    ret = v4l2_get_output_format(avctx);
+    if (ret < 0) {
+        av_log(avctx, AV_LOG_ERROR, "can't set up the output format\n");
+        return ret;
+    }
+
+    /* 5. init the capture context now that we have the capture format */
     if (!capture->buffers) {
         ret = ff_v4l2_context_init(capture);
         if (ret) {
@@ -92,7 +164,7 @@ static int v4l2_try_start(AVCodecContext *avctx)
         }
     }
 
-    /* 5. start the capture process */
+    /* 6. start the capture process */
     ret = ff_v4l2_context_set_status(capture, VIDIOC_STREAMON);
     if (ret) {
         av_log(avctx, AV_LOG_DEBUG, "VIDIOC_STREAMON, on capture context\n");
@@ -133,46 +205,118 @@ static int v4l2_prepare_decoder(V4L2m2mContext *s)
     return 0;
 }
 
-static int v4l2_receive_frame(AVCodecContext *avctx, AVFrame *frame)
+/**
+ * Queue as many packets as the output context accepts.
+ *
+ * @return 0 when the output context is full or draining, AVERROR(EAGAIN)
+ *         when no more packets are available, a negative error otherwise
+ */
+static int v4l2_feed_output(AVCodecContext *avctx)
 {
     V4L2m2mContext *s = ((V4L2m2mPriv*)avctx->priv_data)->context;
-    V4L2Context *const capture = &s->capture;
     V4L2Context *const output = &s->output;
     int ret;
 
-    if (!s->buf_pkt.size) {
-        ret = ff_decode_get_packet(avctx, &s->buf_pkt);
-        if (ret < 0) {
-            if (ret == AVERROR(EAGAIN))
-                return ff_v4l2_context_dequeue_frame(capture, frame, 0);
-            else if (ret != AVERROR_EOF)
+    while (!s->draining) {
+        if (!s->buf_pkt.size) {
+            ret = ff_decode_get_packet(avctx, &s->buf_pkt);
+            if (ret < 0 && ret != AVERROR_EOF)
+                return ret;
+        }
+
+        ret = ff_v4l2_context_enqueue_packet(output, &s->buf_pkt);
+        /* no free buffer: keep the packet for the next iteration */
+        if (ret == AVERROR(EAGAIN))
+            return 0;
+        av_packet_unref(&s->buf_pkt);
+        if (ret < 0)
+            return ret;
+
+        if (!s->draining) {
+            ret = v4l2_try_start(avctx);
+            if (ret)
                 return ret;
         }
     }
 
-    if (s->draining)
-        goto dequeue;
+    return 0;
+}
 
-    ret = ff_v4l2_context_enqueue_packet(output, &s->buf_pkt);
-    if (ret < 0 && ret != AVERROR(EAGAIN))
-        goto fail;
+/**
+ * Block until a capture buffer or an event is ready, or until an output
+ * buffer is released if wait_output is set.
+ */
+static int v4l2_wait_events(V4L2m2mContext *s, int wait_output)
+{
+    struct pollfd pfd = {
+        .fd     = s->fd,
+        .events = POLLPRI,
+    };
+    int ret;
 
-    /* if EAGAIN don't unref packet and try to enqueue in the next iteration */
-    if (ret != AVERROR(EAGAIN))
-        av_packet_unref(&s->buf_pkt);
+    if (s->capture.streamon)
+        pfd.events |= POLLIN | POLLRDNORM;
+    if (wait_output)
+        pfd.events |= POLLOUT | POLLWRNORM;
+
+    for (;;) {
+        ret = poll(&pfd, 1, -1);
+        if (ret > 0)
+            break;
+        if (ret < 0 && errno == EINTR)
+            continue;
+        return AVERROR(errno);
+    }
 
-    if (!s->draining) {
-        ret = v4l2_try_start(avctx);
-        if (ret) {
-            /* cant recover */
-            if (ret != AVERROR(ENOMEM))
-                ret = 0;
+    /* no buffers queued on one side; let the caller come back later */
+    if (pfd.revents & POLLERR)
+        return AVERROR(EAGAIN);
+
+    return 0;
+}
+
+static int v4l2_receive_frame(AVCodecContext *avctx, AVFrame *frame)
+{
+    V4L2m2mContext *s = ((V4L2m2mPriv*)avctx->priv_data)->context;
+    V4L2Context *const capture = &s->capture;
+    int ret;
+
+    for (;;) {
+        /* 1. return decoded frames as soon as they are available */
+        ret = ff_v4l2_context_dequeue_frame(capture, frame, 0);
+        if (ret != AVERROR(EAGAIN))
+            return ret;
+
+        /* 2. restart the capture after a resolution change, which also runs
+         *    get_format again for the new capture format */
+        if (s->output.streamon && !capture->streamon) {
+            ret = v4l2_try_start(avctx);
+            if (ret < 0)
+                goto fail;
+        }
+
+        /* 3. keep the output queue full */
+        ret = v4l2_feed_output(avctx);
+        if (ret == AVERROR(EAGAIN)) {
+            /* a frame may have completed meanwhile, otherwise ask for more input */
+            return ff_v4l2_context_dequeue_frame(capture, frame, 0);
+        }
+        if (ret < 0)
             goto fail;
+
+        /* 4. the device has all the input it can take (or we are draining):
+         *    sleep until it makes progress */
+        ret = v4l2_wait_events(s, s->buf_pkt.size > 0);
+        if (ret < 0) {
+            if (ret != AVERROR(EAGAIN))
+                goto fail;
+            /* no capture buffer queued in the driver: this is not the end of
+             * the stream while draining, as the caller may still hold frames
+             * whose buffers are queued again once released */
+            return ff_v4l2_context_dequeue_frame(capture, frame, 0);
         }
     }
 
-dequeue:
-    return ff_v4l2_context_dequeue_frame(capture, frame, -1);
 fail:
     av_packet_unref(&s->buf_pkt);
     return ret;
@@ -230,6 +374,13 @@ static const AVOption options[] = {
     { NULL},
 };
 
+static const AVCodecHWConfigInternal *const v4l2_m2m_hw_configs[] = {
+#if CONFIG_LIBDRM
+    HW_CONFIG_INTERNAL(DRM_PRIME),
+#endif
+    NULL
+};
+
 #define M2MDEC_CLASS(NAME) \
     static const AVClass v4l2_m2m_ ## NAME ## _dec_class = { \
         .class_name = #NAME "_v4l2m2m_decoder", \
@@ -251,6 +402,7 @@ static const AVOption options[] = {
         FF_CODEC_RECEIVE_FRAME_CB(v4l2_receive_frame), \
         .close          = v4l2_decode_close, \
         .bsfs           = bsf_name, \
+        .hw_configs     = v4l2_m2m_hw_configs, \
         .p.capabilities = AV_CODEC_CAP_HARDWARE | AV_CODEC_CAP_DELAY | AV_CODEC_CAP_AVOID_PROBING, \
         .caps_internal  = FF_CODEC_CAP_NOT_INIT_THREADSAFE | \
                           FF_CODEC_CAP_INIT_CLEANUP, \
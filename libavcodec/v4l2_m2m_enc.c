@@ -26,10 +26,12 @@
 #include <search.h>
 #include "encode.h"
 #include "libavcodec/avcodec.h"
+#include "libavutil/hwcontext.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/pixfmt.h"
 #include "libavutil/opt.h"
 #include "codec_internal.h"
+#include "hwconfig.h"
 #include "profiles.h"
 #include "v4l2_context.h"
 #include "v4l2_m2m.h"
@@ -355,6 +357,19 @@ static av_cold int v4l2_encode_init(AVCodecContext *avctx)
     output->av_codec_id = AV_CODEC_ID_RAWVIDEO;
     output->av_pix_fmt = avctx->pix_fmt;
 
+    /* DRM PRIME frames are imported as dmabufs instead of being copied */
+    if (avctx->pix_fmt == AV_PIX_FMT_DRM_PRIME) {
+        AVHWFramesContext *frames;
+
+        if (!avctx->hw_frames_ctx) {
+            av_log(avctx, AV_LOG_ERROR, "DRM PRIME input requires a hw_frames_ctx\n");
+            return AVERROR(EINVAL);
+        }
+        frames = (AVHWFramesContext *)avctx->hw_frames_ctx->data;
+        output->av_pix_fmt = frames->sw_format;
+        output->memory     = V4L2_MEMORY_DMABUF;
+    }
+
     /* capture context */
     capture->av_codec_id = avctx->codec_id;
     capture->av_pix_fmt = AV_PIX_FMT_NONE;
@@ -372,7 +387,7 @@ static av_cold int v4l2_encode_init(AVCodecContext *avctx)
         v4l2_fmt_output = output->format.fmt.pix.pixelformat;
 
     pix_fmt_output = ff_v4l2_format_v4l2_to_avfmt(v4l2_fmt_output, AV_CODEC_ID_RAWVIDEO);
-    if (pix_fmt_output != avctx->pix_fmt) {
+    if (pix_fmt_output != output->av_pix_fmt) {
         const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt_output);
         av_log(avctx, AV_LOG_ERROR, "Encoder requires %s pixel format.\n", desc->name);
         return AVERROR(EINVAL);
@@ -411,6 +426,13 @@ static const FFCodecDefault v4l2_m2m_defaults[] = {
     { NULL },
 };
 
+static const AVCodecHWConfigInternal *const v4l2_m2m_enc_hw_configs[] = {
+#if CONFIG_LIBDRM
+    HW_CONFIG_ENCODER_FRAMES(DRM_PRIME, DRM),
+#endif
+    NULL
+};
+
 #define M2MENC_CLASS(NAME, OPTIONS_NAME) \
     static const AVClass v4l2_m2m_ ## NAME ## _enc_class = { \
         .class_name = #NAME "_v4l2m2m_encoder", \
@@ -432,6 +454,7 @@ static const FFCodecDefault v4l2_m2m_defaults[] = {
         FF_CODEC_RECEIVE_PACKET_CB(v4l2_receive_packet), \
         .close          = v4l2_encode_close, \
         .defaults       = v4l2_m2m_defaults, \
+        .hw_configs     = v4l2_m2m_enc_hw_configs, \
         .p.capabilities = AV_CODEC_CAP_HARDWARE | AV_CODEC_CAP_DELAY, \
         .caps_internal  = FF_CODEC_CAP_NOT_INIT_THREADSAFE | \
                           FF_CODEC_CAP_INIT_CLEANUP, \
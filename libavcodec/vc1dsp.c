@@ -973,6 +973,8 @@ static void sprite_v_double_twoscale_c(uint8_t *dst,
 
 av_cold void ff_vc1dsp_init(VC1DSPContext *dsp)
 {
+    StartCodeContext startcode;
+
     dsp->vc1_inv_trans_8x8    = vc1_inv_trans_8x8_c;
     dsp->vc1_inv_trans_4x8    = vc1_inv_trans_4x8_c;
     dsp->vc1_inv_trans_8x4    = vc1_inv_trans_8x4_c;
@@ -1030,7 +1032,8 @@ av_cold void ff_vc1dsp_init(VC1DSPContext *dsp)
     dsp->sprite_v_double_twoscale = sprite_v_double_twoscale_c;
 #endif /* CONFIG_WMV3IMAGE_DECODER || CONFIG_VC1IMAGE_DECODER */
 
-    dsp->startcode_find_candidate = ff_startcode_find_candidate_c;
+    ff_startcode_init(&startcode);
+    dsp->startcode_find_candidate = startcode.find_candidate;
     dsp->vc1_unescape_buffer      = vc1_unescape_buffer;
 
 #if ARCH_AARCH64
@@ -1713,6 +1713,16 @@ typedef struct AVFormatContext {
      * @return 0 on success, a negative AVERROR code on failure
      */
     int (*io_close2)(struct AVFormatContext *s, AVIOContext *pb);
+
+    /**
+     * Directory in which avformat_find_stream_info() caches the stream
+     * parameters it found, keyed on the input identity. When an entry
+     * matches, the stream analysis is skipped. Only used for regular
+     * files; NULL disables the cache.
+     *
+     * - demuxing: set by user
+     */
+    char *probe_cache;
 } AVFormatContext;
 
 /**
@@ -111,6 +111,18 @@ void ffio_init_context(FFIOContext *s,
  */
 int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsigned char **data);
 
+/**
+ * Read size bytes from AVIOContext as a reference to the memory of the
+ * underlying protocol, without copying them, if the protocol supports it.
+ * The referenced data is read-only and is followed by
+ * AV_INPUT_BUFFER_PADDING_SIZE zero bytes.
+ *
+ * @return size on success, AVERROR(ENOSYS) if the data cannot be
+ *         referenced, in which case nothing has been read, or another
+ *         AVERROR code
+ */
+int ffio_read_ref(AVIOContext *s, int size, AVBufferRef **buf);
+
 void ffio_fill(AVIOContext *s, int b, int64_t count);
 
 static av_always_inline void ffio_wfourcc(AVIOContext *pb, const uint8_t *s)
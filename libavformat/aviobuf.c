@@ -702,6 +702,37 @@ int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsig
     }
 }
 
+int ffio_read_ref(AVIOContext *s, int size, AVBufferRef **buf)
+{
+    URLContext *h = ffio_geturlcontext(s);
+    int64_t pos   = avio_tell(s);
+    int ret;
+
+    if (!h || !h->prot->url_get_buffer || s->write_flag || s->update_checksum ||
+        size <= 0 || pos < 0)
+        return AVERROR(ENOSYS);
+
+    ret = h->prot->url_get_buffer(h, pos, size, buf);
+    if (ret < 0)
+        return ret;
+
+    if (s->buf_end - s->buf_ptr >= size) {
+        s->buf_ptr += size;
+    } else {
+        /* skip the data without reading it into the buffer */
+        int64_t res = s->seek(s->opaque, pos + size, SEEK_SET);
+        if (res < 0) {
+            av_buffer_unref(buf);
+            return res;
+        }
+        ffiocontext(s)->seek_count++;
+        s->buf_end = s->buf_ptr = s->buf_ptr_max = s->buffer;
+        s->pos = pos + size;
+        s->eof_reached = 0;
+    }
+    return size;
+}
+
 int avio_read_partial(AVIOContext *s, unsigned char *buf, int size)
 {
     int len;
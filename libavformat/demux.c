@@ -26,6 +26,7 @@
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/dict.h"
+#include "libavutil/hash.h"
 #include "libavutil/internal.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/mathematics.h"
@@ -2443,6 +2444,47 @@ static int add_coded_side_data(AVStream *st, AVCodecContext *avctx)
     return 0;
 }
 
+/**
+ * Apply the stream parameters cached under key if they agree with the first
+ * packet of the input, which is left in the packet buffer.
+ *
+ * @return 1 if they were applied, 0 if they were not and the first packet
+ *         was read, a negative error code if no packet was read
+ */
+static int probe_cache_apply(AVFormatContext *ic, const char *key, AVPacket *pkt)
+{
+    FFFormatContext *const si = ffformatcontext(ic);
+    FFProbeCacheEntry *entry;
+    int ret = ff_probe_cache_load(ic, key, &entry);
+
+    if (ret < 0)
+        return ret;
+
+    do {
+        ret = read_frame_internal(ic, pkt);
+    } while (ret == AVERROR(EAGAIN) && !ff_check_interrupt(&ic->interrupt_callback));
+    if (ret < 0)
+        goto end;
+    ret = avpriv_packet_list_put(&si->packet_buffer, pkt, NULL, 0);
+    if (ret < 0) {
+        av_packet_unref(pkt);
+        goto end;
+    }
+
+    if (ff_probe_cache_check(ic, entry, &si->packet_buffer.tail->pkt) < 0) {
+        av_log(ic, AV_LOG_WARNING,
+               "The cached stream parameters do not match the input, analyzing it again\n");
+        ff_probe_cache_delete(ic, key);
+        ret = 0;
+    } else {
+        ret = ff_probe_cache_apply(ic, entry) >= 0;
+    }
+
+end:
+    ff_probe_cache_free(&entry);
+    return ret;
+}
+
 int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 {
     FFFormatContext *const si = ffformatcontext(ic);
@@ -2459,6 +2501,19 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     int64_t probesize = ic->probesize;
     int eof_reached = 0;
     int *missing_streams = av_opt_ptr(ic->iformat->priv_class, ic->priv_data, "missing_streams");
+    char cache_key[AV_HASH_MAX_SIZE * 2 + 1] = "";
+    int all_found = 1, cache_pkt = 0;
+
+    if (ic->probe_cache && ff_probe_cache_key(ic, cache_key, sizeof(cache_key)) >= 0) {
+        ret = probe_cache_apply(ic, cache_key, pkt1);
+        if (ret > 0) {
+            av_log(ic, AV_LOG_VERBOSE, "Using the cached stream parameters\n");
+            return compute_chapters_end(ic);
+        }
+        /* the packet read to check the entry is analyzed first */
+        cache_pkt = !ret;
+        ret = 0;
+    }
 
     flush_codecs = probesize > 0;
 
@@ -2629,27 +2684,32 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             break;
         }
 
-        /* NOTE: A new stream can be added there if no header in file
-         * (AVFMTCTX_NOHEADER). */
-        ret = read_frame_internal(ic, pkt1);
-        if (ret == AVERROR(EAGAIN))
-            continue;
+        if (cache_pkt) {
+            pkt = &si->packet_buffer.tail->pkt;
+            cache_pkt = 0;
+        } else {
+            /* NOTE: A new stream can be added there if no header in file
+             * (AVFMTCTX_NOHEADER). */
+            ret = read_frame_internal(ic, pkt1);
+            if (ret == AVERROR(EAGAIN))
+                continue;
 
-        if (ret < 0) {
-            /* EOF or error*/
-            eof_reached = 1;
-            break;
-        }
+            if (ret < 0) {
+                /* EOF or error*/
+                eof_reached = 1;
+                break;
+            }
 
-        if (!(ic->flags & AVFMT_FLAG_NOBUFFER)) {
-            ret = avpriv_packet_list_put(&si->packet_buffer,
-                                         pkt1, NULL, 0);
-            if (ret < 0)
-                goto unref_then_goto_end;
+            if (!(ic->flags & AVFMT_FLAG_NOBUFFER)) {
+                ret = avpriv_packet_list_put(&si->packet_buffer,
+                                             pkt1, NULL, 0);
+                if (ret < 0)
+                    goto unref_then_goto_end;
 
-            pkt = &si->packet_buffer.tail->pkt;
-        } else {
-            pkt = pkt1;
+                pkt = &si->packet_buffer.tail->pkt;
+            } else {
+                pkt = pkt1;
+            }
         }
 
         st  = ic->streams[pkt->stream_index];
@@ -2952,6 +3012,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                    "Could not find codec parameters for stream %d (%s): %s\n"
                    "Consider increasing the value for the 'analyzeduration' (%"PRId64") and 'probesize' (%"PRId64") options\n",
                    i, buf, errmsg, ic->max_analyze_duration, ic->probesize);
+            all_found = 0;
         } else {
             ret = 0;
         }
@@ -2978,6 +3039,15 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         sti->avctx_inited = 0;
     }
 
+    /* streams created while probing could not be matched on the next open */
+    if (cache_key[0] && all_found && ic->nb_streams &&
+        ic->nb_streams == orig_nb_streams) {
+        int err = ff_probe_cache_store(ic, cache_key);
+        if (err < 0)
+            av_log(ic, AV_LOG_WARNING, "Could not cache the stream parameters: %s\n",
+                   av_err2str(err));
+    }
+
 find_stream_info_err:
     for (unsigned i = 0; i < ic->nb_streams; i++) {
         AVStream *const st  = ic->streams[i];
@@ -238,4 +238,51 @@ int ff_get_extradata(void *logctx, AVCodecParameters *par, AVIOContext *pb, int
  */
 int ff_find_stream_index(const AVFormatContext *s, int id);
 
+typedef struct FFProbeCacheEntry FFProbeCacheEntry;
+
+/**
+ * Compute the key identifying the input in the probe cache: a hash of the
+ * url, the probing options and the device, inode, size and modification
+ * time of the file.
+ *
+ * @return >= 0 if OK, AVERROR(ENOSYS) if the input is not a regular file
+ */
+int ff_probe_cache_key(AVFormatContext *s, char *key, int key_size);
+
+/**
+ * Read the entry cached under key and check that it agrees with what the
+ * demuxer already knows about the streams of s.
+ *
+ * @return >= 0 if the entry was found and is usable, AVERROR_xxx otherwise
+ */
+int ff_probe_cache_load(AVFormatContext *s, const char *key,
+                        FFProbeCacheEntry **entry);
+
+/**
+ * Decode pkt with the cached parameters of its stream and check that the
+ * decoded frame agrees with them.
+ *
+ * @return >= 0 if they agree or could not be checked, AVERROR_INVALIDDATA
+ *         if they do not
+ */
+int ff_probe_cache_check(AVFormatContext *s, const FFProbeCacheEntry *entry,
+                         const AVPacket *pkt);
+
+/**
+ * Apply the stream parameters of entry to s.
+ */
+int ff_probe_cache_apply(AVFormatContext *s, FFProbeCacheEntry *entry);
+
+void ff_probe_cache_free(FFProbeCacheEntry **entry);
+
+/**
+ * Store the stream parameters of s under key.
+ */
+int ff_probe_cache_store(AVFormatContext *s, const char *key);
+
+/**
+ * Remove the entry cached under key.
+ */
+int ff_probe_cache_delete(AVFormatContext *s, const char *key);
+
 #endif /* AVFORMAT_DEMUX_H */
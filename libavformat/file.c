@@ -21,10 +21,15 @@
 
 #include "config_components.h"
 
+#include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
+#include "libavutil/buffer.h"
 #include "libavutil/file_open.h"
 #include "libavutil/internal.h"
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavcodec/defs.h"
 #include "avio.h"
 #if HAVE_DIRENT_H
 #include <dirent.h>
@@ -38,9 +43,17 @@
 #endif
 #include <sys/stat.h>
 #include <stdlib.h>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#if CONFIG_LIBURING
+#include <liburing.h>
+#endif
 #include "os_support.h"
 #include "url.h"
 
+#define FILE_READAHEAD (CONFIG_FILE_PROTOCOL && HAVE_PREAD && (HAVE_THREADS || CONFIG_LIBURING))
+
 /* Some systems may not have S_ISFIFO */
 #ifndef S_ISFIFO
 #  ifdef S_IFIFO
@@ -88,6 +101,20 @@
 
 /* standard file protocol */
 
+enum FileBlockState {
+    BLOCK_IDLE,
+    BLOCK_QUEUED,   ///< submitted, not yet picked up by a worker
+    BLOCK_READING,
+    BLOCK_DONE,
+};
+
+typedef struct FileBlock {
+    uint8_t *data;
+    int64_t pos;    ///< file offset the block was requested for
+    int size;       ///< bytes read, or an AVERROR code
+    enum FileBlockState state;
+} FileBlock;
+
 typedef struct FileContext {
     const AVClass *class;
     int fd;
@@ -97,6 +124,32 @@ typedef struct FileContext {
     int seekable;
 #if HAVE_DIRENT_H
     DIR *dir;
+#endif
+    int use_mmap;
+    AVBufferRef *map;   ///< the whole file, if mapped
+    int64_t map_pos;
+    int readahead;
+    int readahead_size;
+#if FILE_READAHEAD
+    /* The blocks form a ring covering consecutive ranges of the file, starting
+     * with blocks[head], which contains pos. Each block is requested again for
+     * the range after the last one as soon as it has been consumed. */
+    FileBlock *blocks;
+    uint8_t *block_data;
+    int head;
+    int64_t pos;        ///< read position seen by the caller
+    int64_t next_pos;   ///< file offset of the range after the last block
+    int use_uring;
+#if CONFIG_LIBURING
+    struct io_uring ring;
+#endif
+#if HAVE_THREADS
+    pthread_t *workers;
+    int nb_workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int abort_request;
+#endif
 #endif
 } FileContext;
 
@@ -105,6 +158,9 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "mmap", "map the file into memory and return packets referencing it", offsetof(FileContext, use_mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "readahead", "number of reads kept in flight ahead of the read position", offsetof(FileContext, readahead), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, AV_OPT_FLAG_DECODING_PARAM },
+    { "readahead_size", "size of each readahead read", offsetof(FileContext, readahead_size), AV_OPT_TYPE_INT, { .i64 = 1 << 20 }, 4096, 1 << 28, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -135,11 +191,29 @@ static const AVClass fd_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+#if FILE_READAHEAD
+static int readahead_read(FileContext *c, unsigned char *buf, int size);
+static int64_t readahead_seek(FileContext *c, int64_t pos, int whence);
+static void readahead_close(FileContext *c);
+#endif
+
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+    if (c->map) {
+        if (c->map_pos >= c->map->size)
+            return AVERROR_EOF;
+        size = FFMIN(size, c->map->size - c->map_pos);
+        memcpy(buf, c->map->data + c->map_pos, size);
+        c->map_pos += size;
+        return size;
+    }
+#if FILE_READAHEAD
+    if (c->blocks)
+        return readahead_read(c, buf, size);
+#endif
     ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
@@ -218,7 +292,12 @@ static int fd_dup(URLContext *h, int oldfd)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
-    int ret = close(c->fd);
+    int ret;
+    av_buffer_unref(&c->map);
+#if FILE_READAHEAD
+    readahead_close(c);
+#endif
+    ret = close(c->fd);
     return (ret == -1) ? AVERROR(errno) : 0;
 }
 
@@ -234,6 +313,21 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
         return ret < 0 ? AVERROR(errno) : (S_ISFIFO(st.st_mode) ? 0 : st.st_size);
     }
 
+    if (c->map) {
+        if (whence == SEEK_CUR)
+            pos += c->map_pos;
+        else if (whence == SEEK_END)
+            pos += c->map->size;
+        else if (whence != SEEK_SET)
+            return AVERROR(EINVAL);
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        return c->map_pos = pos;
+    }
+#if FILE_READAHEAD
+    if (c->blocks)
+        return readahead_seek(c, pos, whence);
+#endif
     ret = lseek(c->fd, pos, whence);
 
     return ret < 0 ? AVERROR(errno) : ret;
@@ -277,6 +371,481 @@ static int file_move(URLContext *h_src, URLContext *h_dst)
     return 0;
 }
 
+#if HAVE_MMAP
+/* Packets smaller than this are cheaper to copy than to map. */
+#define MAP_MIN_SIZE (64 * 1024)
+
+static void file_unmap(void *opaque, uint8_t *data)
+{
+    munmap(data, (size_t)(uintptr_t)opaque);
+}
+
+static void file_unmap_range(void *opaque, uint8_t *data)
+{
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+
+    munmap((void *)((uintptr_t)data & ~(page - 1)), (size_t)(uintptr_t)opaque);
+}
+
+static int file_map(FileContext *c, int64_t size)
+{
+    void *data;
+
+    if (size > SIZE_MAX)
+        return AVERROR(ENOMEM);
+    data = mmap(NULL, size, PROT_READ, MAP_SHARED, c->fd, 0);
+    if (data == MAP_FAILED)
+        return AVERROR(errno);
+    c->map = av_buffer_create(data, size, file_unmap, (void *)(uintptr_t)size,
+                              AV_BUFFER_FLAG_READONLY);
+    if (!c->map) {
+        munmap(data, size);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+/**
+ * Map the pages holding the range privately, so that the padding after it
+ * can be zeroed. Only the page the padding starts in gets copied. Ranges
+ * whose padding would extend past the last page of the file are copied.
+ */
+static int file_get_buffer(URLContext *h, int64_t pos, int size, AVBufferRef **buf)
+{
+    FileContext *c = h->priv_data;
+    int64_t page = sysconf(_SC_PAGESIZE);
+    int64_t start, len;
+    uint8_t *base;
+
+    if (!c->map || size < MAP_MIN_SIZE || pos < 0 || page <= 0 ||
+        pos + size + AV_INPUT_BUFFER_PADDING_SIZE >
+        FFALIGN((int64_t)c->map->size, page))
+        return AVERROR(ENOSYS);
+
+    start = pos & ~(page - 1);
+    len   = FFALIGN(pos + size + AV_INPUT_BUFFER_PADDING_SIZE, page) - start;
+    if (len > SIZE_MAX)
+        return AVERROR(ENOSYS);
+
+    base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, c->fd, start);
+    if (base == MAP_FAILED)
+        return AVERROR(errno);
+    memset(base + (pos - start) + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    *buf = av_buffer_create(base + (pos - start), size, file_unmap_range,
+                            (void *)(uintptr_t)len, AV_BUFFER_FLAG_READONLY);
+    if (!*buf) {
+        munmap(base, len);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+#else
+static int file_get_buffer(URLContext *h, int64_t pos, int size, AVBufferRef **buf)
+{
+    return AVERROR(ENOSYS);
+}
+#endif
+
+#if FILE_READAHEAD
+
+static void readahead_lock(FileContext *c)
+{
+#if HAVE_THREADS
+    if (c->nb_workers)
+        pthread_mutex_lock(&c->mutex);
+#endif
+}
+
+static void readahead_unlock(FileContext *c)
+{
+#if HAVE_THREADS
+    if (c->nb_workers)
+        pthread_mutex_unlock(&c->mutex);
+#endif
+}
+
+#if CONFIG_LIBURING
+static int uring_reap(FileContext *c)
+{
+    struct io_uring_cqe *cqe;
+    FileBlock *b;
+    int ret;
+
+    do {
+        ret = io_uring_wait_cqe(&c->ring, &cqe);
+    } while (ret == -EINTR);
+    if (ret < 0)
+        return AVERROR(-ret);
+
+    /* cancel requests carry no block */
+    b = io_uring_cqe_get_data(cqe);
+    if (b) {
+        b->size  = cqe->res < 0 ? AVERROR(-cqe->res) : cqe->res;
+        b->state = BLOCK_DONE;
+    }
+    io_uring_cqe_seen(&c->ring, cqe);
+    return 0;
+}
+#endif
+
+#if HAVE_THREADS
+static int read_block(FileContext *c, const FileBlock *b)
+{
+    int size = 0;
+
+    while (size < c->readahead_size) {
+        ssize_t ret = pread(c->fd, b->data + size, c->readahead_size - size,
+                            b->pos + size);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return size ? size : AVERROR(errno);
+        }
+        if (!ret)
+            break;
+        size += ret;
+    }
+    return size;
+}
+
+static void *readahead_worker(void *arg)
+{
+    FileContext *c = arg;
+
+    pthread_mutex_lock(&c->mutex);
+    while (!c->abort_request) {
+        FileBlock *b = NULL;
+        int size;
+
+        /* serve the block that will be needed first */
+        for (int i = 0; i < c->readahead; i++) {
+            FileBlock *cur = &c->blocks[(c->head + i) % c->readahead];
+            if (cur->state == BLOCK_QUEUED) {
+                b = cur;
+                break;
+            }
+        }
+        if (!b) {
+            pthread_cond_wait(&c->cond, &c->mutex);
+            continue;
+        }
+
+        b->state = BLOCK_READING;
+        pthread_mutex_unlock(&c->mutex);
+        size = read_block(c, b);
+        pthread_mutex_lock(&c->mutex);
+        b->size  = size;
+        b->state = BLOCK_DONE;
+        pthread_cond_broadcast(&c->cond);
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return NULL;
+}
+#endif
+
+static void submit_block(FileContext *c, FileBlock *b, int64_t pos)
+{
+    b->pos   = pos;
+    b->state = BLOCK_QUEUED;
+#if CONFIG_LIBURING
+    if (c->use_uring) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&c->ring);
+        int ret = AVERROR(EAGAIN);
+
+        if (sqe) {
+            io_uring_prep_read(sqe, c->fd, b->data, c->readahead_size, pos);
+            io_uring_sqe_set_data(sqe, b);
+            ret = io_uring_submit(&c->ring);
+            ret = ret < 0 ? AVERROR(-ret) : 0;
+        }
+        if (ret < 0) {
+            b->size  = ret;
+            b->state = BLOCK_DONE;
+        }
+        return;
+    }
+#endif
+#if HAVE_THREADS
+    pthread_cond_broadcast(&c->cond);
+#endif
+}
+
+static int wait_block(FileContext *c, FileBlock *b)
+{
+    av_assert1(b->state != BLOCK_IDLE);
+    while (b->state != BLOCK_DONE) {
+#if CONFIG_LIBURING
+        if (c->use_uring) {
+            int ret = uring_reap(c);
+            if (ret < 0)
+                return ret;
+            continue;
+        }
+#endif
+#if HAVE_THREADS
+        pthread_cond_wait(&c->cond, &c->mutex);
+#endif
+    }
+    return 0;
+}
+
+/**
+ * Drop all requests; reads that have already started are waited for, as
+ * their buffers cannot be reused before.
+ */
+static int cancel_blocks(FileContext *c)
+{
+#if CONFIG_LIBURING
+    if (c->use_uring) {
+        int pending = 0;
+
+        for (int i = 0; i < c->readahead; i++) {
+            FileBlock *b = &c->blocks[i];
+            struct io_uring_sqe *sqe;
+
+            if (b->state != BLOCK_QUEUED)
+                continue;
+            pending = 1;
+            if ((sqe = io_uring_get_sqe(&c->ring))) {
+                io_uring_prep_cancel64(sqe, (uintptr_t)b, 0);
+                io_uring_sqe_set_data(sqe, NULL);
+            }
+        }
+        if (pending)
+            io_uring_submit(&c->ring);
+        for (int i = 0; i < c->readahead; i++) {
+            FileBlock *b = &c->blocks[i];
+            int ret = b->state == BLOCK_QUEUED ? wait_block(c, b) : 0;
+            if (ret < 0)
+                return ret;
+        }
+    }
+#endif
+#if HAVE_THREADS
+    if (c->nb_workers) {
+        for (int i = 0; i < c->readahead; i++) {
+            FileBlock *b = &c->blocks[i];
+            if (b->state == BLOCK_QUEUED)
+                b->state = BLOCK_IDLE;
+            while (b->state == BLOCK_READING)
+                pthread_cond_wait(&c->cond, &c->mutex);
+        }
+    }
+#endif
+    for (int i = 0; i < c->readahead; i++)
+        c->blocks[i].state = BLOCK_IDLE;
+    return 0;
+}
+
+/* request the idle blocks for the ranges following the last one */
+static void fill_blocks(FileContext *c)
+{
+    for (int i = 0; i < c->readahead; i++) {
+        FileBlock *b = &c->blocks[(c->head + i) % c->readahead];
+        if (b->state == BLOCK_IDLE) {
+            submit_block(c, b, c->next_pos);
+            c->next_pos += c->readahead_size;
+        }
+    }
+}
+
+static int restart_blocks(FileContext *c, int64_t pos)
+{
+    int ret = cancel_blocks(c);
+    if (ret < 0)
+        return ret;
+    c->head     = 0;
+    c->next_pos = pos;
+    fill_blocks(c);
+    return 0;
+}
+
+static void advance_blocks(FileContext *c)
+{
+    c->blocks[c->head].state = BLOCK_IDLE;
+    c->head = (c->head + 1) % c->readahead;
+    fill_blocks(c);
+}
+
+static int readahead_read(FileContext *c, unsigned char *buf, int size)
+{
+    int ret;
+
+    readahead_lock(c);
+    for (;;) {
+        FileBlock *b = &c->blocks[c->head];
+        int64_t off  = c->pos - b->pos;
+
+        if ((ret = wait_block(c, b)) < 0)
+            break;
+        if (b->size < 0) {
+            ret = b->size;
+            restart_blocks(c, c->pos);
+            break;
+        }
+        if (off < b->size) {
+            ret = FFMIN(size, b->size - off);
+            memcpy(buf, b->data + off, ret);
+            c->pos += ret;
+            if (c->pos == b->pos + c->readahead_size)
+                advance_blocks(c);
+            break;
+        }
+        if (!b->size) {
+            ret = AVERROR_EOF;
+            break;
+        }
+        /* short read before the end of the file, continue from pos */
+        if ((ret = restart_blocks(c, c->pos)) < 0)
+            break;
+    }
+    readahead_unlock(c);
+
+    return ret;
+}
+
+static int64_t readahead_seek(FileContext *c, int64_t pos, int whence)
+{
+    int64_t ret = 0;
+
+    readahead_lock(c);
+    if (whence == SEEK_CUR) {
+        pos += c->pos;
+    } else if (whence == SEEK_END) {
+        struct stat st;
+        if (fstat(c->fd, &st) < 0) {
+            ret = AVERROR(errno);
+            goto end;
+        }
+        pos += st.st_size;
+    } else if (whence != SEEK_SET) {
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    if (pos < 0) {
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    if (pos >= c->blocks[c->head].pos && pos < c->next_pos) {
+        /* keep the requests for the data after pos */
+        while (pos >= c->blocks[c->head].pos + c->readahead_size) {
+            if ((ret = wait_block(c, &c->blocks[c->head])) < 0)
+                goto end;
+            advance_blocks(c);
+        }
+    } else if ((ret = restart_blocks(c, pos - pos % c->readahead_size)) < 0) {
+        goto end;
+    }
+    c->pos = ret = pos;
+
+end:
+    readahead_unlock(c);
+    return ret;
+}
+
+static void readahead_close(FileContext *c)
+{
+    if (!c->blocks)
+        return;
+
+    readahead_lock(c);
+    cancel_blocks(c);
+    readahead_unlock(c);
+
+#if CONFIG_LIBURING
+    if (c->use_uring)
+        io_uring_queue_exit(&c->ring);
+#endif
+#if HAVE_THREADS
+    if (c->nb_workers) {
+        pthread_mutex_lock(&c->mutex);
+        c->abort_request = 1;
+        pthread_cond_broadcast(&c->cond);
+        pthread_mutex_unlock(&c->mutex);
+        for (int i = 0; i < c->nb_workers; i++)
+            pthread_join(c->workers[i], NULL);
+        pthread_cond_destroy(&c->cond);
+        pthread_mutex_destroy(&c->mutex);
+        c->nb_workers = 0;
+    }
+    av_freep(&c->workers);
+#endif
+    av_freep(&c->blocks);
+    av_freep(&c->block_data);
+}
+
+static int readahead_init(URLContext *h, FileContext *c)
+{
+    int ret;
+
+    c->blocks     = av_calloc(c->readahead, sizeof(*c->blocks));
+    c->block_data = av_malloc_array(c->readahead, c->readahead_size);
+    if (!c->blocks || !c->block_data) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int i = 0; i < c->readahead; i++)
+        c->blocks[i].data = c->block_data + (size_t)i * c->readahead_size;
+
+#if CONFIG_LIBURING
+    /* room for a cancel request per read */
+    ret = io_uring_queue_init(2 * c->readahead, &c->ring, 0);
+    if (!ret)
+        c->use_uring = 1;
+    else
+        av_log(h, AV_LOG_VERBOSE, "io_uring unavailable: %s\n", av_err2str(AVERROR(-ret)));
+#endif
+#if HAVE_THREADS
+    if (!c->use_uring) {
+        c->workers = av_calloc(c->readahead, sizeof(*c->workers));
+        if (!c->workers) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        if ((ret = pthread_mutex_init(&c->mutex, NULL))) {
+            ret = AVERROR(ret);
+            goto fail;
+        }
+        if ((ret = pthread_cond_init(&c->cond, NULL))) {
+            pthread_mutex_destroy(&c->mutex);
+            ret = AVERROR(ret);
+            goto fail;
+        }
+        for (int i = 0; i < c->readahead; i++) {
+            if ((ret = pthread_create(&c->workers[i], NULL, readahead_worker, c))) {
+                if (!c->nb_workers) {
+                    pthread_cond_destroy(&c->cond);
+                    pthread_mutex_destroy(&c->mutex);
+                }
+                ret = AVERROR(ret);
+                goto fail;
+            }
+            c->nb_workers++;
+        }
+    }
+#endif
+    av_log(h, AV_LOG_DEBUG, "%d reads of %d bytes in flight using %s\n",
+           c->readahead, c->readahead_size, c->use_uring ? "io_uring" : "threads");
+
+    readahead_lock(c);
+    c->pos = 0;
+    ret = restart_blocks(c, 0);
+    readahead_unlock(c);
+    if (ret < 0)
+        goto fail;
+
+    return 0;
+fail:
+    readahead_close(c);
+    av_freep(&c->block_data);
+    return ret;
+}
+
+#endif /* FILE_READAHEAD */
+
 static int file_open(URLContext *h, const char *filename, int flags)
 {
     FileContext *c = h->priv_data;
@@ -315,6 +884,31 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (c->seekable >= 0)
         h->is_streamed = !c->seekable;
 
+    if (c->use_mmap && !(flags & AVIO_FLAG_WRITE) && !h->is_streamed && !c->follow &&
+        !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+#if HAVE_MMAP
+        int ret = file_map(c, st.st_size);
+        if (ret < 0)
+            av_log(h, AV_LOG_WARNING, "Cannot map the file, reading it instead: %s\n",
+                   av_err2str(ret));
+#else
+        av_log(h, AV_LOG_WARNING, "mmap is not supported on this platform\n");
+#endif
+    }
+
+    if (c->readahead && !c->map && !(flags & AVIO_FLAG_WRITE) && !h->is_streamed && !c->follow &&
+        !fstat(fd, &st) && S_ISREG(st.st_mode)) {
+#if FILE_READAHEAD
+        int ret = readahead_init(h, c);
+        if (ret < 0) {
+            close(fd);
+            return ret;
+        }
+#else
+        av_log(h, AV_LOG_WARNING, "readahead is not supported on this platform\n");
+#endif
+    }
+
     return 0;
 }
 
@@ -410,6 +1004,7 @@ const URLProtocol ff_file_protocol = {
     .url_seek            = file_seek,
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
+    .url_get_buffer      = file_get_buffer,
     .url_check           = file_check,
     .url_delete          = file_delete,
     .url_move            = file_move,
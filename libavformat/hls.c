@@ -37,6 +37,7 @@
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/dict.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "avformat.h"
 #include "demux.h"
@@ -85,6 +86,40 @@ struct segment {
 };
 
 struct rendition;
+struct playlist;
+
+enum PrefetchState {
+    PREFETCH_IDLE,
+    PREFETCH_QUEUED,
+    PREFETCH_RUNNING,
+    PREFETCH_DONE,
+};
+
+/*
+ * A segment downloaded ahead of the reader by a worker thread. Each slot
+ * has its own connection, which is kept open for the next segments when
+ * using persistent HTTP connections.
+ */
+struct prefetch_slot {
+    struct playlist *pls;
+    enum PrefetchState state;
+    int64_t seq_no;
+    char *url;
+    int64_t url_offset;
+    int64_t size;
+    AVDictionary *opts;
+    char *cookies; /* set by the server, for c->avio_opts */
+    AVIOContext *pb;
+    uint8_t *data;
+    size_t len;
+    size_t allocated;
+    int error;
+    int abort;
+    int release; /* clear the slot once the worker is done with it */
+#if HAVE_THREADS
+    pthread_t thread;
+#endif
+};
 
 enum PlaylistType {
     PLS_TYPE_UNSPECIFIED,
@@ -171,6 +206,19 @@ struct playlist {
      * playlist, if any. */
     int n_init_sections;
     struct segment **init_sections;
+
+    /* Segments downloaded ahead, the current one being read from
+     * cur_prefetch when set. */
+    int n_prefetch;
+    struct prefetch_slot *prefetch;
+    struct prefetch_slot *cur_prefetch;
+    size_t prefetch_pos;
+    int64_t prefetch_buffered;
+    int prefetch_exit;
+#if HAVE_THREADS
+    pthread_mutex_t prefetch_mutex;
+    pthread_cond_t prefetch_cond;
+#endif
 };
 
 /*
@@ -226,6 +274,8 @@ typedef struct HLSContext {
     int http_multiple;
     int http_seekable;
     int seg_max_retry;
+    int prefetch;
+    int64_t prefetch_size;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
 } HLSContext;
@@ -259,11 +309,59 @@ static void free_init_section_list(struct playlist *pls)
     pls->n_init_sections = 0;
 }
 
+#if HAVE_THREADS
+/* Called with prefetch_mutex held. */
+static void prefetch_clear_slot(struct playlist *pls, struct prefetch_slot *slot)
+{
+    pls->prefetch_buffered -= slot->len;
+    av_freep(&slot->data);
+    av_freep(&slot->url);
+    av_freep(&slot->cookies);
+    av_dict_free(&slot->opts);
+    slot->len       = 0;
+    slot->allocated = 0;
+    slot->error     = 0;
+    slot->abort     = 0;
+    slot->release   = 0;
+    slot->state     = PREFETCH_IDLE;
+}
+#endif
+
+static void prefetch_free(struct playlist *pls)
+{
+#if HAVE_THREADS
+    int i;
+
+    if (!pls->n_prefetch)
+        return;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    pls->prefetch_exit = 1;
+    for (i = 0; i < pls->n_prefetch; i++)
+        pls->prefetch[i].abort = 1;
+    pthread_cond_broadcast(&pls->prefetch_cond);
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    for (i = 0; i < pls->n_prefetch; i++) {
+        struct prefetch_slot *slot = &pls->prefetch[i];
+        pthread_join(slot->thread, NULL);
+        avio_closep(&slot->pb);
+        prefetch_clear_slot(pls, slot);
+    }
+    pthread_cond_destroy(&pls->prefetch_cond);
+    pthread_mutex_destroy(&pls->prefetch_mutex);
+    av_freep(&pls->prefetch);
+    pls->n_prefetch   = 0;
+    pls->cur_prefetch = NULL;
+#endif
+}
+
 static void free_playlist_list(HLSContext *c)
 {
     int i;
     for (i = 0; i < c->n_playlists; i++) {
         struct playlist *pls = c->playlists[i];
+        prefetch_free(pls);
         free_segment_list(pls);
         free_init_section_list(pls);
         av_freep(&pls->main_streams);
@@ -619,8 +717,28 @@ static int ensure_playlist(HLSContext *c, struct playlist **pls, const char *url
     return 0;
 }
 
+/* Segments prefetched by worker threads are opened directly instead of
+ * through the io_open/io_close2 callbacks, which need not be thread safe. */
+static int hls_io_open(AVFormatContext *s, AVIOContext **pb, const char *url,
+                       AVDictionary **options, int direct)
+{
+    if (direct)
+        return ffio_open_whitelist(pb, url, AVIO_FLAG_READ, &s->interrupt_callback,
+                                   options, s->protocol_whitelist, s->protocol_blacklist);
+    return s->io_open(s, pb, url, AVIO_FLAG_READ, options);
+}
+
+static void hls_io_close(AVFormatContext *s, AVIOContext **pb, int direct)
+{
+    if (direct)
+        avio_closep(pb);
+    else
+        ff_format_io_close(s, pb);
+}
+
 static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
-                              const char *url, AVDictionary **options)
+                              const char *url, AVDictionary **options,
+                              int direct)
 {
 #if !CONFIG_HTTP_PROTOCOL
     return AVERROR_PROTOCOL_NOT_FOUND;
@@ -631,14 +749,15 @@ static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
     (*pb)->eof_reached = 0;
     ret = ff_http_do_new_request2(uc, url, options);
     if (ret < 0) {
-        ff_format_io_close(s, pb);
+        hls_io_close(s, pb, direct);
     }
     return ret;
 #endif
 }
 
 static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out,
+                    int direct)
 {
     HLSContext *c = s->priv_data;
     AVDictionary *tmp = NULL;
@@ -689,7 +808,7 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     av_dict_copy(&tmp, opts2, 0);
 
     if (is_http && c->http_persistent && *pb) {
-        ret = open_url_keepalive(c->ctx, pb, url, &tmp);
+        ret = open_url_keepalive(c->ctx, pb, url, &tmp, direct);
         if (ret == AVERROR_EXIT) {
             av_dict_free(&tmp);
             return ret;
@@ -700,10 +819,10 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
                     url, av_err2str(ret));
             av_dict_copy(&tmp, *opts, 0);
             av_dict_copy(&tmp, opts2, 0);
-            ret = s->io_open(s, pb, url, AVIO_FLAG_READ, &tmp);
+            ret = hls_io_open(s, pb, url, &tmp, direct);
         }
     } else {
-        ret = s->io_open(s, pb, url, AVIO_FLAG_READ, &tmp);
+        ret = hls_io_open(s, pb, url, &tmp, direct);
     }
     if (ret >= 0) {
         // update cookies on http response with setcookies.
@@ -749,7 +868,7 @@ static int parse_playlist(HLSContext *c, const char *url,
 
     if (is_http && !in && c->http_persistent && c->playlist_pb) {
         in = c->playlist_pb;
-        ret = open_url_keepalive(c->ctx, &c->playlist_pb, url, NULL);
+        ret = open_url_keepalive(c->ctx, &c->playlist_pb, url, NULL, 0);
         if (ret == AVERROR_EXIT) {
             return ret;
         } else if (ret < 0) {
@@ -1056,6 +1175,382 @@ static struct segment *next_segment(struct playlist *pls)
     return pls->segments[n];
 }
 
+#if HAVE_THREADS
+#define PREFETCH_CHUNK_SIZE (64 * 1024)
+
+/* Called with prefetch_mutex held. */
+static void prefetch_release(struct playlist *pls, struct prefetch_slot *slot)
+{
+    if (slot->state == PREFETCH_RUNNING) {
+        slot->abort   = 1;
+        slot->release = 1;
+    } else {
+        prefetch_clear_slot(pls, slot);
+    }
+    if (slot == pls->cur_prefetch)
+        pls->cur_prefetch = NULL;
+    pthread_cond_broadcast(&pls->prefetch_cond);
+}
+
+static struct prefetch_slot *prefetch_find(struct playlist *pls, int64_t seq_no)
+{
+    int i;
+
+    for (i = 0; i < pls->n_prefetch; i++) {
+        struct prefetch_slot *slot = &pls->prefetch[i];
+        if (slot->state != PREFETCH_IDLE && !slot->release && slot->seq_no == seq_no)
+            return slot;
+    }
+    return NULL;
+}
+
+/* Called with prefetch_mutex held. Waits for a change of state, for at most
+ * 100 ms so that the interrupt callback is honoured. */
+static int prefetch_wait(HLSContext *c, struct playlist *pls)
+{
+    int64_t t = av_gettime() + 100000;
+    struct timespec tv = { .tv_sec  =  t / 1000000,
+                           .tv_nsec = (t % 1000000) * 1000 };
+
+    if (ff_check_interrupt(c->interrupt_callback))
+        return AVERROR_EXIT;
+    pthread_cond_timedwait(&pls->prefetch_cond, &pls->prefetch_mutex, &tv);
+    return 0;
+}
+
+static int prefetch_open(HLSContext *c, struct prefetch_slot *slot)
+{
+    struct playlist *pls = slot->pls;
+    AVDictionary *opts = NULL;
+    AVDictionaryEntry *e;
+    char *cookies = NULL;
+    int ret, is_http = 0;
+
+    if (c->http_persistent)
+        av_dict_set(&opts, "multiple_requests", "1", 0);
+
+    if (slot->size >= 0) {
+        av_dict_set_int(&opts, "offset", slot->url_offset, 0);
+        av_dict_set_int(&opts, "end_offset", slot->url_offset + slot->size, 0);
+    }
+
+    av_log(pls->parent, AV_LOG_VERBOSE, "HLS prefetch for url '%s', offset %"PRId64", playlist %d\n",
+           slot->url, slot->url_offset, pls->index);
+
+    if ((e = av_dict_get(slot->opts, "cookies", NULL, 0)) &&
+        !(cookies = av_strdup(e->value))) {
+        av_dict_free(&opts);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = open_url(pls->parent, &slot->pb, slot->url, &slot->opts, opts, &is_http, 1);
+
+    /* see open_input() */
+    if (ret == 0 && !is_http && slot->url_offset) {
+        int64_t seekret = avio_seek(slot->pb, slot->url_offset, SEEK_SET);
+        if (seekret < 0) {
+            ret = seekret;
+            avio_closep(&slot->pb);
+        }
+    }
+
+    /* Only hand cookies updated by the response back, so that the copy taken
+     * when the slot was queued does not overwrite newer ones. */
+    if (ret >= 0 && (e = av_dict_get(slot->opts, "cookies", NULL, 0)) &&
+        (!cookies || strcmp(cookies, e->value))) {
+        char *new_cookies = av_strdup(e->value);
+        if (!new_cookies)
+            ret = AVERROR(ENOMEM);
+        pthread_mutex_lock(&pls->prefetch_mutex);
+        slot->cookies = new_cookies;
+        pthread_mutex_unlock(&pls->prefetch_mutex);
+    }
+
+    av_free(cookies);
+    av_dict_free(&opts);
+    return ret;
+}
+
+static void *prefetch_worker(void *arg)
+{
+    struct prefetch_slot *slot = arg;
+    struct playlist *pls = slot->pls;
+    HLSContext *c = pls->parent->priv_data;
+
+    ff_thread_setname("hls-prefetch");
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    while (1) {
+        int ret;
+
+        while (slot->state != PREFETCH_QUEUED && !pls->prefetch_exit)
+            pthread_cond_wait(&pls->prefetch_cond, &pls->prefetch_mutex);
+        if (pls->prefetch_exit)
+            break;
+        slot->state = PREFETCH_RUNNING;
+        pthread_mutex_unlock(&pls->prefetch_mutex);
+
+        ret = prefetch_open(c, slot);
+
+        pthread_mutex_lock(&pls->prefetch_mutex);
+        while (ret >= 0) {
+            size_t left = slot->size >= 0 ? slot->size - slot->len : PREFETCH_CHUNK_SIZE;
+            int size = FFMIN(left, PREFETCH_CHUNK_SIZE);
+            uint8_t *dst;
+
+            /* the segment being read is never held back by the limit */
+            while (!slot->abort && slot != pls->cur_prefetch &&
+                   pls->prefetch_buffered >= c->prefetch_size)
+                pthread_cond_wait(&pls->prefetch_cond, &pls->prefetch_mutex);
+            if (slot->abort || !size)
+                break;
+
+            if (slot->allocated - slot->len < size) {
+                size_t allocated = slot->size >= 0 ? slot->size :
+                                   FFMAX(2 * slot->allocated, slot->len + size);
+                uint8_t *data = av_realloc(slot->data, allocated);
+                if (!data) {
+                    ret = AVERROR(ENOMEM);
+                    break;
+                }
+                slot->data      = data;
+                slot->allocated = allocated;
+            }
+            dst = slot->data + slot->len;
+
+            pthread_mutex_unlock(&pls->prefetch_mutex);
+            ret = avio_read_partial(slot->pb, dst, size);
+            pthread_mutex_lock(&pls->prefetch_mutex);
+
+            if (ret > 0) {
+                slot->len               += ret;
+                pls->prefetch_buffered  += ret;
+                pthread_cond_broadcast(&pls->prefetch_cond);
+            } else if (!ret) {
+                ret = AVERROR_EOF;
+            }
+        }
+        slot->error = ret == AVERROR_EOF ? 0 : FFMIN(ret, 0);
+        pthread_mutex_unlock(&pls->prefetch_mutex);
+
+        /* keep the connection only if the response was read to the end */
+        if (slot->error < 0 || slot->abort || !c->http_persistent ||
+            !av_strstart(slot->url, "http", NULL))
+            avio_closep(&slot->pb);
+
+        pthread_mutex_lock(&pls->prefetch_mutex);
+        slot->state = PREFETCH_DONE;
+        if (slot->release)
+            prefetch_clear_slot(pls, slot);
+        pthread_cond_broadcast(&pls->prefetch_cond);
+    }
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    return NULL;
+}
+
+static int prefetch_init(HLSContext *c, struct playlist *pls)
+{
+    /* one slot for the segment being read, plus the ones ahead of it */
+    int nb_slots = c->prefetch + 1;
+    int i, ret;
+
+    pls->prefetch = av_calloc(nb_slots, sizeof(*pls->prefetch));
+    if (!pls->prefetch)
+        return AVERROR(ENOMEM);
+    if ((ret = pthread_mutex_init(&pls->prefetch_mutex, NULL))) {
+        av_freep(&pls->prefetch);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&pls->prefetch_cond, NULL))) {
+        pthread_mutex_destroy(&pls->prefetch_mutex);
+        av_freep(&pls->prefetch);
+        return AVERROR(ret);
+    }
+    pls->prefetch_exit = 0;
+
+    for (i = 0; i < nb_slots; i++) {
+        struct prefetch_slot *slot = &pls->prefetch[i];
+        slot->pls = pls;
+        if ((ret = pthread_create(&slot->thread, NULL, prefetch_worker, slot))) {
+            /* let prefetch_free() stop the workers started so far */
+            pls->n_prefetch = i;
+            if (i)
+                prefetch_free(pls);
+            else {
+                pthread_cond_destroy(&pls->prefetch_cond);
+                pthread_mutex_destroy(&pls->prefetch_mutex);
+                av_freep(&pls->prefetch);
+            }
+            return AVERROR(ret);
+        }
+    }
+    pls->n_prefetch = nb_slots;
+    return 0;
+}
+
+/* Queue the current segment and the c->prefetch ones following it, dropping
+ * the slots that fell out of the window, e.g. after a seek. */
+static void prefetch_schedule(HLSContext *c, struct playlist *pls)
+{
+    int64_t end = FFMIN(pls->cur_seq_no + pls->n_prefetch,
+                        pls->start_seq_no + pls->n_segments);
+    int64_t seq_no;
+    int i;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    for (i = 0; i < pls->n_prefetch; i++) {
+        struct prefetch_slot *slot = &pls->prefetch[i];
+        if (slot->state != PREFETCH_IDLE && !slot->release &&
+            (slot->seq_no < pls->cur_seq_no || slot->seq_no >= end))
+            prefetch_release(pls, slot);
+    }
+
+    for (seq_no = FFMAX(pls->cur_seq_no, pls->start_seq_no); seq_no < end; seq_no++) {
+        struct segment *seg = pls->segments[seq_no - pls->start_seq_no];
+        struct prefetch_slot *slot = NULL;
+
+        if (seg->key_type != KEY_NONE || prefetch_find(pls, seq_no))
+            continue;
+        for (i = 0; i < pls->n_prefetch && !slot; i++)
+            if (pls->prefetch[i].state == PREFETCH_IDLE)
+                slot = &pls->prefetch[i];
+        if (!slot)
+            break;
+
+        slot->url = av_strdup(seg->url);
+        if (!slot->url || av_dict_copy(&slot->opts, c->avio_opts, 0) < 0) {
+            prefetch_clear_slot(pls, slot);
+            break;
+        }
+        slot->seq_no     = seq_no;
+        slot->url_offset = seg->url_offset;
+        slot->size       = seg->size;
+        slot->state      = PREFETCH_QUEUED;
+    }
+    pthread_cond_broadcast(&pls->prefetch_cond);
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+}
+
+/* Start reading the current segment from its prefetch slot. Returns 1 if it
+ * is prefetched, 0 if it has to be opened directly and a negative error if
+ * downloading it failed. */
+static int prefetch_start_segment(HLSContext *c, struct playlist *pls)
+{
+    struct prefetch_slot *slot;
+    int ret = 0;
+
+    if (!pls->n_prefetch) {
+        ret = prefetch_init(c, pls);
+        if (ret < 0) {
+            av_log(pls->parent, AV_LOG_WARNING,
+                   "Failed to start segment prefetching: %s\n", av_err2str(ret));
+            c->prefetch = 0;
+            return 0;
+        }
+    }
+
+    prefetch_schedule(c, pls);
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    slot = prefetch_find(pls, pls->cur_seq_no);
+    if (slot) {
+        pls->cur_prefetch = slot;
+        pls->prefetch_pos = 0;
+        pthread_cond_broadcast(&pls->prefetch_cond);
+        while (!slot->len && slot->state != PREFETCH_DONE) {
+            if ((ret = prefetch_wait(c, pls)) < 0)
+                break;
+        }
+        if (ret >= 0 && !slot->len && slot->error < 0)
+            ret = slot->error;
+        if (ret >= 0 && slot->cookies) {
+            /* the same update open_input() does for segments it opens */
+            av_dict_set(&c->avio_opts, "cookies", slot->cookies, AV_DICT_DONT_STRDUP_VAL);
+            slot->cookies = NULL;
+        }
+        if (ret < 0)
+            prefetch_release(pls, slot);
+        else
+            ret = 1;
+    }
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    return ret;
+}
+
+static int prefetch_read(HLSContext *c, struct playlist *pls,
+                         uint8_t *buf, int buf_size)
+{
+    struct prefetch_slot *slot = pls->cur_prefetch;
+    int ret = 0;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    while (pls->prefetch_pos == slot->len && slot->state != PREFETCH_DONE) {
+        if ((ret = prefetch_wait(c, pls)) < 0)
+            break;
+    }
+    if (ret >= 0) {
+        if (pls->prefetch_pos < slot->len) {
+            ret = FFMIN(buf_size, slot->len - pls->prefetch_pos);
+            memcpy(buf, slot->data + pls->prefetch_pos, ret);
+            pls->prefetch_pos += ret;
+        } else {
+            ret = slot->error < 0 ? slot->error : AVERROR_EOF;
+        }
+    }
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    return ret;
+}
+
+/* Drop the current and the queued segments, e.g. on seek. */
+static void prefetch_reset(struct playlist *pls)
+{
+    int i;
+
+    if (!pls->n_prefetch)
+        return;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    for (i = 0; i < pls->n_prefetch; i++) {
+        struct prefetch_slot *slot = &pls->prefetch[i];
+        if (slot->state != PREFETCH_IDLE && !slot->release)
+            prefetch_release(pls, slot);
+    }
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+}
+
+static void prefetch_end_segment(struct playlist *pls)
+{
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    prefetch_release(pls, pls->cur_prefetch);
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+}
+#else
+static int prefetch_start_segment(HLSContext *c, struct playlist *pls)
+{
+    av_log(pls->parent, AV_LOG_WARNING,
+           "Segment prefetching is not supported without threads\n");
+    c->prefetch = 0;
+    return 0;
+}
+
+static int prefetch_read(HLSContext *c, struct playlist *pls,
+                         uint8_t *buf, int buf_size)
+{
+    return AVERROR_BUG;
+}
+
+static void prefetch_reset(struct playlist *pls)
+{
+}
+
+static void prefetch_end_segment(struct playlist *pls)
+{
+}
+#endif /* HAVE_THREADS */
+
 static int read_from_url(struct playlist *pls, struct segment *seg,
                          uint8_t *buf, int buf_size)
 {
@@ -1065,7 +1560,10 @@ static int read_from_url(struct playlist *pls, struct segment *seg,
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->cur_prefetch && !pls->input)
+        ret = prefetch_read(pls->parent->priv_data, pls, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1295,7 +1793,7 @@ static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg,
     if (seg->key_type == KEY_AES_128 || seg->key_type == KEY_SAMPLE_AES) {
         if (strcmp(seg->key, pls->key_url)) {
             AVIOContext *pb = NULL;
-            if (open_url(pls->parent, &pb, seg->key, &c->avio_opts, opts, NULL) == 0) {
+            if (open_url(pls->parent, &pb, seg->key, &c->avio_opts, opts, NULL, 0) == 0) {
                 ret = avio_read(pb, pls->key, sizeof(pls->key));
                 if (ret != sizeof(pls->key)) {
                     av_log(pls->parent, AV_LOG_ERROR, "Unable to read key file %s\n",
@@ -1322,13 +1820,13 @@ static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg,
         av_dict_set(&opts, "key", key, 0);
         av_dict_set(&opts, "iv", iv, 0);
 
-        ret = open_url(pls->parent, in, url, &c->avio_opts, opts, &is_http);
+        ret = open_url(pls->parent, in, url, &c->avio_opts, opts, &is_http, 0);
         if (ret < 0) {
             goto cleanup;
         }
         ret = 0;
     } else {
-        ret = open_url(pls->parent, in, seg->url, &c->avio_opts, opts, &is_http);
+        ret = open_url(pls->parent, in, seg->url, &c->avio_opts, opts, &is_http, 0);
     }
 
     /* Seek to the requested position. If this was a HTTP request, the offset
@@ -1480,7 +1978,7 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if ((!v->input && !v->cur_prefetch) || (c->http_persistent && v->input_read_done)) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1551,7 +2049,16 @@ reload:
         if (ret)
             return ret;
 
-        if (c->http_multiple == 1 && v->input_next_requested) {
+        if (c->prefetch && (ret = prefetch_start_segment(c, v)) != 0) {
+            if (ret > 0) {
+                /* a connection kept open for the previous segment is not
+                 * needed anymore */
+                ff_format_io_close(v->parent, &v->input);
+                v->input_read_done = 0;
+                v->cur_seg_offset  = 0;
+                ret = 0;
+            }
+        } else if (c->http_multiple == 1 && v->input_next_requested) {
             FFSWAP(AVIOContext *, v->input, v->input_next);
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
@@ -1580,7 +2087,7 @@ reload:
         just_opened = 1;
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1590,7 +2097,7 @@ reload:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !v->input_next_requested && !c->prefetch &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1623,7 +2130,9 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->cur_prefetch && !v->input) {
+        prefetch_end_segment(v);
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -2241,6 +2750,7 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             pls->input_read_done = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
+            prefetch_reset(pls);
             pls->needed = 0;
             changed = 1;
             av_log(s, AV_LOG_INFO, "No longer receiving playlist %d\n", i);
@@ -2497,6 +3007,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        prefetch_reset(pls);
         av_packet_unref(pls->pkt);
         pb->eof_reached = 0;
         /* Clear any buffered data */
@@ -2586,6 +3097,10 @@ static const AVOption hls_options[] = {
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {"seg_max_retry", "Maximum number of times to reload a segment on error.",
      OFFSET(seg_max_retry), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch", "Number of segments downloaded in parallel, ahead of the one being read",
+        OFFSET(prefetch), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 16, FLAGS},
+    {"prefetch_size", "Maximum number of bytes buffered by prefetching per playlist",
+        OFFSET(prefetch_size), AV_OPT_TYPE_INT64, {.i64 = 64 << 20}, 0, INT64_MAX, FLAGS},
     {NULL}
 };
 
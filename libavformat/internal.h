@@ -540,6 +540,13 @@ int ff_get_line(AVIOContext *s, char *buf, int maxlen);
  */
 int ff_get_chomp_line(AVIOContext *s, char *buf, int maxlen);
 
+/**
+ * Like av_get_packet(), but make the packet reference the data of the
+ * underlying protocol instead of copying it when possible, see
+ * ffio_read_ref(). Only for callers that do not modify the packet data.
+ */
+int ff_get_packet_ref(AVIOContext *s, AVPacket *pkt, int size);
+
 #define SPACE_CHARS " \t\r\n"
 
 /**
@@ -163,6 +163,20 @@ typedef struct MOVIndexRange {
     int64_t end;
 } MOVIndexRange;
 
+/**
+ * Lookup state of a stream using a compact index, kept between calls so
+ * that sequential sample accesses do not search the tables again.
+ */
+typedef struct MOVSampleCursor {
+    int64_t sample;           ///< last resolved sample, -1 if none
+    unsigned int stts_index;  ///< stts entry of the last looked up sample
+    unsigned int stsc_index;  ///< stsc entry of the last resolved sample
+    unsigned int chunk;       ///< chunk of the last resolved sample
+    int64_t pos;              ///< position of the last resolved sample
+    unsigned int size;        ///< size of the last resolved sample
+    AVIndexEntry entry;       ///< index entry of the last resolved sample
+} MOVSampleCursor;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int pb_is_copied;
@@ -235,6 +249,18 @@ typedef struct MOVStreamContext {
     int nb_frames_for_fps;
     int64_t duration_for_fps;
 
+    /**
+     * Compact index: the samples are resolved from the stts, stsc, stco,
+     * stsz and stss tables instead of being expanded into an AVIndex.
+     */
+    int compact_index;
+    unsigned int compact_nb_samples;
+    unsigned int *compact_stts_first;  ///< first sample of each stts entry
+    int64_t *compact_stts_dts;         ///< dts of the first sample of each stts entry
+    unsigned int *compact_stsc_first;  ///< first sample of each stsc entry
+    int compact_key_off;
+    MOVSampleCursor compact_cursor;
+
     /** extradata array (and size) for multiple stsd */
     uint8_t **extradata;
     int *extradata_size;
@@ -319,6 +345,9 @@ typedef struct MOVContext {
     int have_read_mfra_size;
     uint32_t mfra_size;
     uint32_t max_stts_delta;
+    int compact_index;
+    int lazy_frag_index;
+    uint64_t fragment_duration; ///< from mehd, in movie timescale
     int is_still_picture_avif;
     int primary_item_id;
     struct {
@@ -81,6 +81,7 @@ typedef struct MOVParseTableEntry {
 
 static int mov_read_default(MOVContext *c, AVIOContext *pb, MOVAtom atom);
 static int mov_read_mfra(MOVContext *c, AVIOContext *f);
+static void mov_expand_compact_index(MOVContext *c, AVStream *st);
 static int64_t add_ctts_entry(MOVCtts** ctts_data, unsigned int* ctts_count, unsigned int* allocated_size,
                               int count, int duration);
 
@@ -1259,6 +1260,11 @@ static int mov_read_moov(MOVContext *c, AVIOContext *pb, MOVAtom atom)
 
     if ((ret = mov_read_default(c, pb, atom)) < 0)
         return ret;
+    /* samples of fragmented files are added to the AVIndex as the fragments are read */
+    if (c->trex_data) {
+        for (int i = 0; i < c->fc->nb_streams; i++)
+            mov_expand_compact_index(c, c->fc->streams[i]);
+    }
     /* we parsed the 'moov' atom, we can terminate the parsing as soon as we find the 'mdat' */
     /* so we don't parse the whole file if over a network */
     c->found_moov=1;
@@ -3683,10 +3689,369 @@ static int64_t add_ctts_entry(MOVCtts** ctts_data, unsigned int* ctts_count, uns
 }
 
 #define MAX_REORDER_DELAY 16
+/**
+ * Find the last entry of a sorted table that is not greater than val.
+ *
+ * @return the index of the entry, -1 if all entries are greater than val
+ */
+static int64_t mov_find_last_le(const unsigned *tab, unsigned int count, int64_t val)
+{
+    int64_t lo = -1, hi = count;
+
+    while (hi - lo > 1) {
+        int64_t mid = (lo + hi) >> 1;
+        if (tab[mid] <= val)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int mov_table_is_sorted(const unsigned *tab, unsigned int count)
+{
+    for (unsigned i = 1; i < count; i++)
+        if (tab[i] <= tab[i - 1])
+            return 0;
+    return 1;
+}
+
+/**
+ * Check whether the samples of a stream can be resolved from its sample
+ * tables, i.e. whether mov_build_index() would create exactly one index
+ * entry per sample that is not modified afterwards.
+ */
+static int mov_compact_index_usable(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (!mov->compact_index || mov->trex_data)
+        return 0;
+    if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
+        st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+        return 0;
+    if (!sc->sample_count || !sc->chunk_count || !sc->stts_count || !sc->stsc_count ||
+        (sc->rap_group_count && sc->rap_group))
+        return 0;
+    /* uncompressed audio chunk demuxing */
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+        sc->stts_count == 1 && sc->stts_data[0].duration == 1)
+        return 0;
+
+    /* mov_fix_index() must leave the index alone */
+    if (sc->elst_count && !mov->ignore_editlist && mov->advanced_editlist &&
+        (sc->elst_count > 1 || sc->elst_data[0].time || sc->elst_data[0].rate != 1.0f ||
+         mov->time_scale <= 0 || st->duration <= 0 ||
+         av_rescale(sc->elst_data[0].duration, sc->time_scale, mov->time_scale) < st->duration))
+        return 0;
+
+    for (unsigned i = 0; i < sc->stts_count; i++)
+        if (!sc->stts_data[i].count)
+            return 0;
+    if (sc->stsc_data[0].first != 1)
+        return 0;
+    for (unsigned i = 0; i < sc->stsc_count; i++)
+        if (!sc->stsc_data[i].count || (i && sc->stsc_data[i].first <= sc->stsc_data[i - 1].first) ||
+            (sc->pseudo_stream_id != -1 && sc->stsc_data[i].id - 1 != sc->pseudo_stream_id))
+            return 0;
+    if ((sc->keyframe_count && sc->keyframes[0] < 0) ||
+        !mov_table_is_sorted((const unsigned *)sc->keyframes, sc->keyframe_count) ||
+        !mov_table_is_sorted(sc->stps_data, sc->stps_count))
+        return 0;
+
+    return 1;
+}
+
+static unsigned int mov_compact_stts_index(MOVStreamContext *sc, unsigned int sample)
+{
+    const unsigned *first = sc->compact_stts_first;
+    unsigned int i = sc->compact_cursor.stts_index;
+
+    /* sequential accesses stay in the same or move to the next entry */
+    if (sample >= first[i]) {
+        if (i + 1 == sc->stts_count || sample < first[i + 1])
+            return i;
+        if (i + 2 == sc->stts_count || sample < first[i + 2])
+            return i + 1;
+    }
+    return mov_find_last_le(first, sc->stts_count, sample);
+}
+
+static int64_t mov_compact_sample_dts(MOVStreamContext *sc, unsigned int sample)
+{
+    unsigned int i = mov_compact_stts_index(sc, sample);
+
+    sc->compact_cursor.stts_index = i;
+    return sc->compact_stts_dts[i] +
+           (int64_t)(sample - sc->compact_stts_first[i]) * sc->stts_data[i].duration;
+}
+
+/**
+ * @return the last keyframe not after sample, -1 if there is none
+ */
+static int64_t mov_compact_prev_keyframe(AVStream *st, unsigned int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int64_t key = -1, idx;
+
+    if (!sc->keyframe_absent) {
+        if (!sc->keyframe_count)
+            return sample;
+        idx = mov_find_last_le((const unsigned *)sc->keyframes, sc->keyframe_count,
+                               (int64_t)sample + sc->compact_key_off);
+        if (idx >= 0)
+            key = sc->keyframes[idx] - sc->compact_key_off;
+    }
+    if (sc->stps_count) {
+        idx = mov_find_last_le(sc->stps_data, sc->stps_count,
+                               (int64_t)sample + sc->compact_key_off);
+        if (idx >= 0)
+            key = FFMAX(key, (int64_t)sc->stps_data[idx] - sc->compact_key_off);
+    } else if (sc->keyframe_absent) {
+        return st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO ? sample : 0;
+    }
+    return key;
+}
+
+/**
+ * @return the first keyframe not before sample, compact_nb_samples if there
+ *         is none
+ */
+static int64_t mov_compact_next_keyframe(AVStream *st, unsigned int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int64_t key = sc->compact_nb_samples, idx;
+
+    if (!sc->keyframe_absent) {
+        if (!sc->keyframe_count)
+            return sample;
+        idx = mov_find_last_le((const unsigned *)sc->keyframes, sc->keyframe_count,
+                               (int64_t)sample + sc->compact_key_off - 1) + 1;
+        if (idx < sc->keyframe_count)
+            key = sc->keyframes[idx] - sc->compact_key_off;
+    }
+    if (sc->stps_count) {
+        idx = mov_find_last_le(sc->stps_data, sc->stps_count,
+                               (int64_t)sample + sc->compact_key_off - 1) + 1;
+        if (idx < sc->stps_count)
+            key = FFMIN(key, (int64_t)sc->stps_data[idx] - sc->compact_key_off);
+    } else if (sc->keyframe_absent) {
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || !sample)
+            return sample;
+    }
+    return FFMIN(key, sc->compact_nb_samples);
+}
+
+/**
+ * Resolve the index entry of a sample from the sample tables. The returned
+ * entry is valid until the next call for the same stream.
+ */
+static AVIndexEntry *mov_compact_get_entry(AVStream *st, unsigned int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVSampleCursor *cur = &sc->compact_cursor;
+    unsigned int size, stsc_index, chunk, chunk_sample;
+    int64_t pos, key;
+
+    if (cur->sample == sample)
+        return &cur->entry;
+
+    if (cur->sample >= 0 && sample == cur->sample + 1) {
+        /* next sample: same chunk, or the first sample of the next one */
+        stsc_index = cur->stsc_index;
+        if (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
+            sample >= sc->compact_stsc_first[stsc_index + 1])
+            stsc_index++;
+    } else {
+        stsc_index = mov_find_last_le(sc->compact_stsc_first, sc->stsc_count, sample);
+    }
+    chunk        = sc->stsc_data[stsc_index].first - 1 +
+                   (sample - sc->compact_stsc_first[stsc_index]) / sc->stsc_data[stsc_index].count;
+    chunk_sample = (sample - sc->compact_stsc_first[stsc_index]) % sc->stsc_data[stsc_index].count;
+
+    if (!chunk_sample) {
+        pos = sc->chunk_offsets[chunk];
+    } else if (cur->sample >= 0 && sample == cur->sample + 1) {
+        pos = cur->pos + cur->size;
+    } else if (sc->stsz_sample_size > 0) {
+        pos = sc->chunk_offsets[chunk] + (int64_t)chunk_sample * sc->stsz_sample_size;
+    } else {
+        pos = sc->chunk_offsets[chunk];
+        for (unsigned i = sample - chunk_sample; i < sample; i++)
+            pos += sc->sample_sizes[i];
+    }
+    size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[sample];
+    key  = mov_compact_prev_keyframe(st, sample);
+
+    cur->sample     = sample;
+    cur->stsc_index = stsc_index;
+    cur->chunk      = chunk;
+    cur->pos        = pos;
+    cur->size       = size;
+
+    cur->entry.pos          = pos;
+    cur->entry.timestamp    = mov_compact_sample_dts(sc, sample);
+    cur->entry.size         = size;
+    cur->entry.min_distance = key >= 0 ? sample - key : sample;
+    cur->entry.flags        = key == sample ? AVINDEX_KEYFRAME : 0;
+
+    return &cur->entry;
+}
+
+/**
+ * Same as ff_index_search_timestamp() on the index mov_build_index() would
+ * have created.
+ */
+static int mov_compact_search_timestamp(AVStream *st, int64_t wanted_timestamp, int flags)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int64_t a = -1, b = sc->compact_nb_samples, m;
+
+    if (b && mov_compact_sample_dts(sc, b - 1) < wanted_timestamp)
+        a = b - 1;
+
+    while (b - a > 1) {
+        int64_t timestamp;
+
+        m = (a + b) >> 1;
+        timestamp = mov_compact_sample_dts(sc, m);
+        if (timestamp >= wanted_timestamp)
+            b = m;
+        if (timestamp <= wanted_timestamp)
+            a = m;
+    }
+    m = (flags & AVSEEK_FLAG_BACKWARD) ? a : b;
+
+    if (!(flags & AVSEEK_FLAG_ANY) && m >= 0 && m < sc->compact_nb_samples)
+        m = (flags & AVSEEK_FLAG_BACKWARD) ? mov_compact_prev_keyframe(st, m)
+                                           : mov_compact_next_keyframe(st, m);
+
+    if (m == sc->compact_nb_samples)
+        return -1;
+    return m;
+}
+
+/**
+ * Set up the compact index of a stream; the counterpart of the sample loop
+ * of mov_build_index().
+ */
+static int mov_build_compact_index(MOVContext *mov, AVStream *st, int64_t start_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    uint64_t stream_size = 0;
+    int64_t dts = start_dts, nb_samples = 0;
+
+    sc->compact_stts_first = av_malloc_array(sc->stts_count, sizeof(*sc->compact_stts_first));
+    sc->compact_stts_dts   = av_malloc_array(sc->stts_count, sizeof(*sc->compact_stts_dts));
+    sc->compact_stsc_first = av_malloc_array(sc->stsc_count, sizeof(*sc->compact_stsc_first));
+    if (!sc->compact_stts_first || !sc->compact_stts_dts || !sc->compact_stsc_first)
+        return AVERROR(ENOMEM);
+
+    for (unsigned i = 0; i < sc->stts_count; i++) {
+        sc->compact_stts_first[i] = FFMIN(nb_samples, UINT_MAX);
+        sc->compact_stts_dts[i]   = dts;
+        nb_samples += sc->stts_data[i].count;
+        dts        += (int64_t)sc->stts_data[i].count * sc->stts_data[i].duration;
+    }
+
+    /* samples described by the chunks, with the stsz checks of mov_build_index() */
+    nb_samples = 0;
+    for (unsigned i = 0; i < sc->stsc_count; i++) {
+        unsigned last = mov_stsc_index_valid(i, sc->stsc_count) ?
+                        sc->stsc_data[i + 1].first - 1 : sc->chunk_count;
+
+        sc->compact_stsc_first[i] = FFMIN(nb_samples, UINT_MAX);
+        for (unsigned c = sc->stsc_data[i].first - 1; c < last; c++) {
+            int64_t next_offset = c + 1 < sc->chunk_count ? sc->chunk_offsets[c + 1] : INT64_MAX;
+
+            if (next_offset > sc->chunk_offsets[c] && sc->sample_size > 0 &&
+                sc->sample_size < sc->stsz_sample_size &&
+                sc->stsc_data[i].count * (int64_t)sc->stsz_sample_size > next_offset - sc->chunk_offsets[c]) {
+                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
+                sc->stsz_sample_size = sc->sample_size;
+            }
+            if (sc->stsz_sample_size > 0 && sc->stsz_sample_size < sc->sample_size) {
+                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
+                sc->stsz_sample_size = sc->sample_size;
+            }
+        }
+        nb_samples += (int64_t)(last - (sc->stsc_data[i].first - 1)) * sc->stsc_data[i].count;
+    }
+    if (nb_samples > sc->sample_count)
+        av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
+    nb_samples = FFMIN(nb_samples, sc->sample_count);
+
+    if (sc->stsz_sample_size > 0) {
+        if (sc->stsz_sample_size > 0x3FFFFFFF) {
+            av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sc->stsz_sample_size);
+            nb_samples = 0;
+        }
+        stream_size = nb_samples * sc->stsz_sample_size;
+    } else {
+        for (int64_t i = 0; i < nb_samples; i++) {
+            if ((unsigned)sc->sample_sizes[i] > 0x3FFFFFFF) {
+                av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sc->sample_sizes[i]);
+                nb_samples = i;
+                break;
+            }
+            stream_size += sc->sample_sizes[i];
+        }
+    }
+
+    sc->compact_nb_samples     = nb_samples;
+    sc->compact_key_off        = (sc->keyframe_count && sc->keyframes[0] > 0) ||
+                                 (sc->stps_count && sc->stps_data[0] > 0);
+    sc->compact_cursor.sample  = -1;
+    sc->compact_index          = 1;
+
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        for (unsigned i = 0; i < FFMIN(nb_samples, 99); i++)
+            ff_rfps_add_frame(mov->fc, st, mov_compact_sample_dts(sc, i));
+
+    if (st->duration > 0)
+        st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+
+    av_log(mov->fc, AV_LOG_DEBUG, "stream %d: compact index of %u samples\n",
+           st->index, sc->compact_nb_samples);
+
+    return 0;
+}
+
+static void mov_free_compact_index(MOVStreamContext *sc)
+{
+    av_freep(&sc->compact_stts_first);
+    av_freep(&sc->compact_stts_dts);
+    av_freep(&sc->compact_stsc_first);
+    sc->compact_nb_samples = 0;
+    sc->compact_index      = 0;
+}
+
+static int mov_nb_samples(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    return sc->compact_index ? sc->compact_nb_samples : ffstream(st)->nb_index_entries;
+}
+
+static AVIndexEntry *mov_get_sample(AVStream *st, int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    return sc->compact_index ? mov_compact_get_entry(st, sample) :
+                               &ffstream(st)->index_entries[sample];
+}
+
+static int64_t mov_get_sample_dts(AVStream *st, int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    return sc->compact_index ? mov_compact_sample_dts(sc, sample) :
+                               ffstream(st)->index_entries[sample].timestamp;
+}
+
 static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
 {
     MOVStreamContext *msc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int ctts_ind = 0;
     int ctts_sample = 0;
     int64_t pts_buf[MAX_REORDER_DELAY + 1]; // Circular buffer to sort pts.
@@ -3699,14 +4064,14 @@ static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
     if (st->codecpar->video_delay <= 0 && msc->ctts_data &&
         st->codecpar->codec_id == AV_CODEC_ID_H264) {
         st->codecpar->video_delay = 0;
-        for (int ind = 0; ind < sti->nb_index_entries && ctts_ind < msc->ctts_count; ++ind) {
+        for (int ind = 0; ind < mov_nb_samples(st) && ctts_ind < msc->ctts_count; ++ind) {
             // Point j to the last elem of the buffer and insert the current pts there.
             j = buf_start;
             buf_start = (buf_start + 1);
             if (buf_start == MAX_REORDER_DELAY + 1)
                 buf_start = 0;
 
-            pts_buf[j] = sti->index_entries[ind].timestamp + msc->ctts_data[ctts_ind].duration;
+            pts_buf[j] = mov_get_sample_dts(st, ind) + msc->ctts_data[ctts_ind].duration;
 
             // The timestamps that are already in the sorted buffer, and are greater than the
             // current pts, are exactly the timestamps that need to be buffered to output PTS
@@ -4232,9 +4597,16 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
             sc->start_pad = start_time;
     }
 
+    if (!sti->nb_index_entries && !sc->compact_index && mov_compact_index_usable(mov, st)) {
+        if (mov_build_compact_index(mov, st, current_dts - sc->dts_shift) < 0)
+            mov_free_compact_index(sc);
+    }
+
     /* only use old uncompressed audio chunk demuxing when stts specifies it */
-    if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
-          sc->stts_count == 1 && sc->stts_data[0].duration == 1)) {
+    if (sc->compact_index) {
+        /* samples are resolved from the sample tables when reading */
+    } else if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+                 sc->stts_count == 1 && sc->stts_data[0].duration == 1)) {
         unsigned int current_sample = 0;
         unsigned int stts_sample = 0;
         unsigned int sample_size;
@@ -4483,8 +4855,8 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     }
 
     // Update start time of the stream.
-    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries > 0) {
-        st->start_time = sti->index_entries[0].timestamp + sc->dts_shift;
+    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && mov_nb_samples(st) > 0) {
+        st->start_time = mov_get_sample_dts(st, 0) + sc->dts_shift;
         if (sc->ctts_data) {
             st->start_time += sc->ctts_data[0].duration;
         }
@@ -4493,6 +4865,31 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     mov_estimate_video_delay(mov, st);
 }
 
+/**
+ * Replace the compact index of a stream by a full AVIndex, for the code that
+ * adds samples to it.
+ */
+static void mov_expand_compact_index(MOVContext *c, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (!sc->compact_index)
+        return;
+
+    mov_free_compact_index(sc);
+    mov_build_index(c, st);
+
+    av_freep(&sc->chunk_offsets);
+    av_freep(&sc->sample_sizes);
+    av_freep(&sc->keyframes);
+    av_freep(&sc->stts_data);
+    av_freep(&sc->stps_data);
+    av_freep(&sc->elst_data);
+    av_freep(&sc->rap_group);
+    av_freep(&sc->sync_group);
+    av_freep(&sc->sgpd_sync);
+}
+
 static int test_same_origin(const char *src, const char *ref) {
     char src_proto[64];
     char ref_proto[64];
@@ -4734,6 +5131,10 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         && sc->time_scale == st->codecpar->sample_rate) {
             ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL;
     }
+    /* a compact index resolves the samples from the tables */
+    if (sc->compact_index)
+        return 0;
+
     /* Do not need those anymore. */
     av_freep(&sc->chunk_offsets);
     av_freep(&sc->sample_sizes);
@@ -5156,6 +5557,14 @@ static int mov_read_chap(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     return 0;
 }
 
+static int mov_read_mehd(MOVContext *c, AVIOContext *pb, MOVAtom atom)
+{
+    int version = avio_r8(pb);
+    avio_rb24(pb); /* flags */
+    c->fragment_duration = version ? avio_rb64(pb) : avio_rb32(pb);
+    return 0;
+}
+
 static int mov_read_trex(MOVContext *c, AVIOContext *pb, MOVAtom atom)
 {
     MOVTrackExt *trex;
@@ -7840,6 +8249,7 @@ static const MOVParseTableEntry mov_default_parse_table[] = {
 { MKTAG('j','p','2','h'), mov_read_jp2h },
 { MKTAG('m','d','a','t'), mov_read_mdat },
 { MKTAG('m','d','h','d'), mov_read_mdhd },
+{ MKTAG('m','e','h','d'), mov_read_mehd },
 { MKTAG('m','d','i','a'), mov_read_default },
 { MKTAG('m','e','t','a'), mov_read_meta },
 { MKTAG('m','i','n','f'), mov_read_default },
@@ -8012,15 +8422,19 @@ static int mov_read_default(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         } else {
             int64_t start_pos = avio_tell(pb);
             int64_t left;
+            int frag_on_demand;
             int err = parse(c, pb, a);
             if (err < 0) {
                 c->atom_depth --;
                 return err;
             }
+            /* stop at the first fragment if the following ones are read
+             * through next_root_atom rather than all parsed here */
+            frag_on_demand = !(pb->seekable & AVIO_SEEKABLE_NORMAL) || c->fc->flags & AVFMT_FLAG_IGNIDX ||
+                             c->frag_index.complete || (c->lazy_frag_index && c->trex_data);
             if (c->found_moov && c->found_mdat && a.size <= INT64_MAX - start_pos &&
-                ((!(pb->seekable & AVIO_SEEKABLE_NORMAL) || c->fc->flags & AVFMT_FLAG_IGNIDX || c->frag_index.complete) ||
-                 start_pos + a.size == avio_size(pb))) {
-                if (!(pb->seekable & AVIO_SEEKABLE_NORMAL) || c->fc->flags & AVFMT_FLAG_IGNIDX || c->frag_index.complete)
+                (frag_on_demand || start_pos + a.size == avio_size(pb))) {
+                if (frag_on_demand)
                     c->next_root_atom = start_pos + a.size;
                 c->atom_depth --;
                 return 0;
@@ -8168,9 +8582,9 @@ static void mov_read_chapters(AVFormatContext *s)
 
         if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             st->disposition |= AV_DISPOSITION_ATTACHED_PIC | AV_DISPOSITION_TIMED_THUMBNAILS;
-            if (sti->nb_index_entries) {
+            if (mov_nb_samples(st)) {
                 // Retrieve the first frame, if possible
-                AVIndexEntry *sample = &sti->index_entries[0];
+                AVIndexEntry *sample = mov_get_sample(st, 0);
                 if (avio_seek(sc->pb, sample->pos, SEEK_SET) != sample->pos) {
                     av_log(s, AV_LOG_ERROR, "Failed to retrieve first frame\n");
                     goto finish;
@@ -8376,6 +8790,7 @@ static int mov_read_close(AVFormatContext *s)
         av_freep(&sc->open_key_samples);
         av_freep(&sc->display_matrix);
         av_freep(&sc->index_ranges);
+        mov_free_compact_index(sc);
 
         if (sc->extradata)
             for (j = 0; j < sc->stsd_count; j++)
@@ -8759,6 +9174,18 @@ static int mov_read_header(AVFormatContext *s)
             break;
         }
     }
+    /* only the first fragment has been read, take the duration from mehd */
+    if (mov->lazy_frag_index && mov->trex_data && !mov->frag_index.complete &&
+        mov->fragment_duration && mov->time_scale > 0) {
+        for (i = 0; i < s->nb_streams; i++) {
+            AVStream *st = s->streams[i];
+            MOVStreamContext *sc = st->priv_data;
+            int64_t duration = av_rescale(mov->fragment_duration, sc->time_scale, mov->time_scale);
+            if (duration > st->duration)
+                st->duration = duration;
+        }
+    }
+
     ff_configure_buffers_for_index(s, AV_TIME_BASE);
 
     for (i = 0; i < mov->frag_index.nb_items; i++)
@@ -8775,10 +9202,9 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     int i;
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
-        FFStream *const avsti = ffstream(avst);
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avsti->nb_index_entries) {
-            AVIndexEntry *current_sample = &avsti->index_entries[msc->current_sample];
+        if (msc->pb && msc->current_sample < mov_nb_samples(avst)) {
+            AVIndexEntry *current_sample = mov_get_sample(avst, msc->current_sample);
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             av_log(s, AV_LOG_TRACE, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
             if (!sample || (!(s->pb->seekable & AVIO_SEEKABLE_NORMAL) && current_sample->pos < sample->pos) ||
@@ -8930,6 +9356,8 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 
         if (st->codecpar->codec_id == AV_CODEC_ID_EIA_608 && sample->size > 8)
             ret = get_eia608_packet(sc->pb, pkt, sample->size);
+        else if (!mov->aax_mode && !mov->decryption_key) /* decrypted in place */
+            ret = ff_get_packet_ref(sc->pb, pkt, sample->size);
         else
             ret = av_get_packet(sc->pb, pkt, sample->size);
         if (ret < 0) {
@@ -8981,8 +9409,8 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
             sc->ctts_sample = 0;
         }
     } else {
-        int64_t next_dts = (sc->current_sample < ffstream(st)->nb_index_entries) ?
-            ffstream(st)->index_entries[sc->current_sample].timestamp : st->duration;
+        int64_t next_dts = (sc->current_sample < mov_nb_samples(st)) ?
+            mov_get_sample_dts(st, sc->current_sample) : st->duration;
 
         if (next_dts >= pkt->dts)
             pkt->duration = next_dts - pkt->dts;
@@ -9028,13 +9456,41 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
     return 0;
 }
 
+/**
+ * Parse the fragments following the ones read so far until st has a sample
+ * after timestamp or the end of the file is reached. Fragments are always
+ * parsed in file order, so next_root_atom stays the end of the indexed part.
+ */
+static int mov_read_fragments_until(AVFormatContext *s, AVStream *st, int64_t timestamp)
+{
+    MOVContext *mov = s->priv_data;
+    FFStream *const sti = ffstream(st);
+    int ret;
+
+    while (mov->next_root_atom &&
+           (!sti->nb_index_entries ||
+            sti->index_entries[sti->nb_index_entries - 1].timestamp <= timestamp)) {
+        ret = mov_switch_root(s, mov->next_root_atom, -1);
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
 static int mov_seek_fragment(AVFormatContext *s, AVStream *st, int64_t timestamp)
 {
     MOVContext *mov = s->priv_data;
     int index;
 
-    if (!mov->frag_index.complete)
+    if (!mov->frag_index.complete) {
+        if (mov->lazy_frag_index && mov->trex_data &&
+            (s->pb->seekable & AVIO_SEEKABLE_NORMAL) && !(s->flags & AVFMT_FLAG_IGNIDX))
+            return mov_read_fragments_until(s, st, timestamp);
         return 0;
+    }
 
     index = search_frag_timestamp(s, &mov->frag_index, st, timestamp);
     if (index < 0)
@@ -9067,7 +9523,6 @@ static int is_open_key_sample(const MOVStreamContext *sc, int sample)
 static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pts)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int64_t key_sample_dts, key_sample_pts;
 
     if (st->codecpar->codec_id != AV_CODEC_ID_HEVC)
@@ -9076,7 +9531,7 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
     if (sample >= sc->sample_offsets_count)
         return 1;
 
-    key_sample_dts = sti->index_entries[sample].timestamp;
+    key_sample_dts = mov_get_sample_dts(st, sample);
     key_sample_pts = key_sample_dts + sc->sample_offsets[sample] + sc->dts_shift;
 
     /*
@@ -9093,7 +9548,6 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
 static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp, int flags)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int sample, time_sample, ret;
     unsigned int i;
 
@@ -9106,9 +9560,12 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
         return ret;
 
     for (;;) {
-        sample = av_index_search_timestamp(st, timestamp, flags);
+        if (sc->compact_index)
+            sample = mov_compact_search_timestamp(st, timestamp, flags);
+        else
+            sample = av_index_search_timestamp(st, timestamp, flags);
         av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-        if (sample < 0 && sti->nb_index_entries && timestamp < sti->index_entries[0].timestamp)
+        if (sample < 0 && mov_nb_samples(st) && timestamp < mov_get_sample_dts(st, 0))
             sample = 0;
         if (sample < 0) /* not sure what to do */
             return AVERROR_INVALIDDATA;
@@ -9155,9 +9612,8 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
 static int64_t mov_get_skip_samples(AVStream *st, int sample)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
-    int64_t first_ts = sti->index_entries[0].timestamp;
-    int64_t ts = sti->index_entries[sample].timestamp;
+    int64_t first_ts = mov_get_sample_dts(st, 0);
+    int64_t ts = mov_get_sample_dts(st, sample);
     int64_t off;
 
     if (st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
@@ -9188,7 +9644,7 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
 
     if (mc->seek_individually) {
         /* adjust seek timestamp to found sample timestamp */
-        int64_t seek_timestamp = sti->index_entries[sample].timestamp;
+        int64_t seek_timestamp = mov_get_sample_dts(st, sample);
         sti->skip_samples = mov_get_skip_samples(st, sample);
 
         for (i = 0; i < s->nb_streams; i++) {
@@ -9275,6 +9731,10 @@ static const AVOption mov_options[] = {
     { "enable_drefs", "Enable external track support.", OFFSET(enable_drefs), AV_OPT_TYPE_BOOL,
         {.i64 = 0}, 0, 1, FLAGS },
     { "max_stts_delta", "treat offsets above this value as invalid", OFFSET(max_stts_delta), AV_OPT_TYPE_INT, {.i64 = UINT_MAX-48000*10 }, 0, UINT_MAX, .flags = AV_OPT_FLAG_DECODING_PARAM },
+    { "compact_index", "Resolve samples from the sample tables instead of building a full index", OFFSET(compact_index), AV_OPT_TYPE_BOOL,
+        {.i64 = 0}, 0, 1, FLAGS },
+    { "lazy_frag_index", "Index fragments when reading or seeking reaches them instead of on open", OFFSET(lazy_frag_index), AV_OPT_TYPE_BOOL,
+        {.i64 = 0}, 0, 1, FLAGS },
 
     { NULL },
 };
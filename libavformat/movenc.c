@@ -37,6 +37,7 @@
 #include "avc.h"
 #include "evc.h"
 #include "libavcodec/ac3_parser_internal.h"
+#include "libavcodec/codec_desc.h"
 #include "libavcodec/dnxhddata.h"
 #include "libavcodec/flac.h"
 #include "libavcodec/get_bits.h"
@@ -80,6 +81,7 @@ static const AVOption options[] = {
     { "frag_custom", "Flush fragments on caller requests", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FRAG_CUSTOM}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "isml", "Create a live smooth streaming feed (for pushing to a publishing point)", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_ISML}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "faststart", "Run a second pass to put the index (moov atom) at the beginning of the file", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FASTSTART}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
+    { "reserve_moov", "With faststart, reserve an estimated moov size ahead of the data to avoid the second pass", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_RESERVE_MOOV}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "omit_tfhd_offset", "Omit the base data offset in tfhd atoms", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_OMIT_TFHD_OFFSET}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "disable_chpl", "Disable Nero chapter atom", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_DISABLE_CHPL}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "default_base_moof", "Set the default-base-is-moof flag in tfhd atoms", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_DEFAULT_BASE_MOOF}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
@@ -6950,6 +6952,93 @@ static int mov_create_dvd_sub_decoder_specific_info(MOVTrack *track,
     return 0;
 }
 
+/**
+ * Estimate the number of samples of a stream from its duration,
+ * or return -1 if it is not known.
+ */
+static int64_t estimate_nb_samples(const AVStream *st)
+{
+    const AVCodecParameters *par = st->codecpar;
+    AVRational rate;
+
+    if (is_cover_image(st))
+        return 1;
+    if (st->duration <= 0 || st->time_base.num <= 0 || st->time_base.den <= 0)
+        return -1;
+
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO &&
+        st->avg_frame_rate.num > 0 && st->avg_frame_rate.den > 0) {
+        rate = st->avg_frame_rate;
+    } else if (par->codec_type == AVMEDIA_TYPE_AUDIO && par->sample_rate > 0 &&
+               par->frame_size > 0) {
+        rate = (AVRational){ par->sample_rate, par->frame_size };
+    } else if (par->codec_type == AVMEDIA_TYPE_AUDIO &&
+               av_get_bits_per_sample(par->codec_id)) {
+        /* constant sample size, one table entry per packet of
+         * usually no less than 20 ms */
+        rate = (AVRational){ 50, 1 };
+    } else {
+        return -1;
+    }
+
+    return av_rescale_rnd(st->duration,
+                          (int64_t)st->time_base.num * rate.num,
+                          (int64_t)st->time_base.den * rate.den, AV_ROUND_UP);
+}
+
+/**
+ * Estimate an upper bound for the size of the moov atom from the stream
+ * durations, so that faststart can reserve the space ahead of the mdat
+ * instead of moving all the data in a second pass.
+ * Must be called before the stream time bases are changed.
+ * @return the estimate, or 0 if some stream does not allow one
+ */
+static int estimate_moov_size(AVFormatContext *s)
+{
+    const AVDictionaryEntry *t = NULL;
+    int64_t total = 0, size = 4096;
+    int i;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        int64_t nb_samples = estimate_nb_samples(s->streams[i]);
+        if (nb_samples < 0)
+            return 0;
+        total += nb_samples;
+    }
+
+    for (i = 0; i < s->nb_streams; i++) {
+        const AVStream *st = s->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+        const AVCodecDescriptor *desc = avcodec_descriptor_get(par->codec_id);
+        int64_t nb_samples = estimate_nb_samples(st);
+        /* a new chunk only starts when another track interleaves */
+        int64_t nb_chunks = FFMIN(nb_samples, total - nb_samples + 1);
+
+        size += 1024 + 2LL * par->extradata_size;
+        /* stsc and co64 entries */
+        size += nb_chunks * 20;
+        /* stsz entries, unless the sample size is constant */
+        if (par->codec_type != AVMEDIA_TYPE_AUDIO || par->frame_size > 0 ||
+            !av_get_bits_per_sample(par->codec_id))
+            size += nb_samples * 4;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO &&
+            !(desc && desc->props & AV_CODEC_PROP_INTRA_ONLY)) {
+            /* stss, assuming no more than one keyframe in 8 frames */
+            size += nb_samples / 2;
+            /* ctts */
+            if (!desc || desc->props & AV_CODEC_PROP_REORDER)
+                size += nb_samples * 8;
+        }
+    }
+
+    while ((t = av_dict_iterate(s->metadata, t)))
+        size += strlen(t->key) + strlen(t->value) + 32;
+    size += s->nb_chapters * 64LL;
+    size += size / 16;
+
+    return size <= INT_MAX ? size : 0;
+}
+
 static int mov_init(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -7010,6 +7099,15 @@ static int mov_init(AVFormatContext *s)
 
     if (mov->flags & FF_MOV_FLAG_FASTSTART) {
         mov->reserved_moov_size = -1;
+        if (mov->flags & FF_MOV_FLAG_RESERVE_MOOV &&
+            !(mov->flags & FF_MOV_FLAG_FRAGMENT) && mov->mode != MODE_AVIF &&
+            !(mov->flags & FF_MOV_FLAG_RTP_HINT)) {
+            int size = estimate_moov_size(s);
+            if (size > 0) {
+                av_log(s, AV_LOG_VERBOSE, "Reserving %d bytes for the moov atom\n", size);
+                mov->reserved_moov_size = size;
+            }
+        }
     }
 
     if (mov->use_editlist < 0) {
@@ -7454,7 +7552,7 @@ static int mov_write_header(AVFormatContext *s)
             !mov->max_fragment_duration && !mov->max_fragment_size)
             mov->flags |= FF_MOV_FLAG_FRAG_KEYFRAME;
     } else if (mov->mode != MODE_AVIF) {
-        if (mov->flags & FF_MOV_FLAG_FASTSTART)
+        if (mov->flags & FF_MOV_FLAG_FASTSTART && mov->reserved_moov_size < 0)
             mov->reserved_header_pos = avio_tell(pb);
         mov_write_mdat_tag(pb, mov);
     }
@@ -7674,7 +7772,23 @@ static int mov_write_trailer(AVFormatContext *s)
         }
         avio_seek(pb, mov->reserved_moov_size > 0 ? mov->reserved_header_pos : moov_pos, SEEK_SET);
 
-        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+        if (mov->flags & FF_MOV_FLAG_FASTSTART && mov->reserved_moov_size > 0) {
+            int moov_size = get_moov_size(s);
+            if (moov_size < 0)
+                return moov_size;
+            if (moov_size > mov->reserved_moov_size - 8) {
+                /* the estimate was too small, turn the reserved space into
+                 * a free atom and insert the moov in front of it */
+                av_log(s, AV_LOG_VERBOSE, "Reserved %d bytes, but the moov atom needs %d\n",
+                       mov->reserved_moov_size, moov_size);
+                avio_wb32(pb, mov->reserved_moov_size);
+                ffio_wfourcc(pb, "free");
+                avio_seek(pb, moov_pos, SEEK_SET);
+                mov->reserved_moov_size = -1;
+            }
+        }
+
+        if (mov->flags & FF_MOV_FLAG_FASTSTART && mov->reserved_moov_size < 0) {
             av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
             res = shift_data(s);
             if (res < 0)
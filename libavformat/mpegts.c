@@ -2912,24 +2912,39 @@ static int mpegts_resync(AVFormatContext *s, int seekback, const uint8_t *curren
     avio_seek(pb, -back, SEEK_CUR);
 
     for (i = 0; i < ts->resync_size; i++) {
-        c = avio_r8(pb);
-        if (avio_feof(pb))
-            return AVERROR_EOF;
-        if (c == 0x47) {
-            int new_packet_size, ret;
-            avio_seek(pb, -1, SEEK_CUR);
-            pos = avio_tell(pb);
-            ret = ffio_ensure_seekback(pb, PROBE_PACKET_MAX_BUF);
-            if (ret < 0)
-                return ret;
-            new_packet_size = get_packet_size(s);
-            if (new_packet_size > 0 && new_packet_size != ts->raw_packet_size) {
-                av_log(ts->stream, AV_LOG_WARNING, "changing packet size to %d\n", new_packet_size);
-                ts->raw_packet_size = new_packet_size;
+        int avail = FFMIN(pb->buf_end - pb->buf_ptr, ts->resync_size - i);
+        int new_packet_size, ret;
+
+        /* scan what is buffered in one go, avio_r8() refills the buffer */
+        if (avail > 0) {
+            const uint8_t *sync = memchr(pb->buf_ptr, 0x47, avail);
+            if (!sync) {
+                avio_skip(pb, avail);
+                i += avail - 1;
+                continue;
             }
-            avio_seek(pb, pos, SEEK_SET);
-            return 0;
+            i += sync - pb->buf_ptr;
+            avio_skip(pb, sync - pb->buf_ptr);
+        } else {
+            c = avio_r8(pb);
+            if (avio_feof(pb))
+                return AVERROR_EOF;
+            if (c != 0x47)
+                continue;
+            avio_seek(pb, -1, SEEK_CUR);
         }
+
+        pos = avio_tell(pb);
+        ret = ffio_ensure_seekback(pb, PROBE_PACKET_MAX_BUF);
+        if (ret < 0)
+            return ret;
+        new_packet_size = get_packet_size(s);
+        if (new_packet_size > 0 && new_packet_size != ts->raw_packet_size) {
+            av_log(ts->stream, AV_LOG_WARNING, "changing packet size to %d\n", new_packet_size);
+            ts->raw_packet_size = new_packet_size;
+        }
+        avio_seek(pb, pos, SEEK_SET);
+        return 0;
     }
     av_log(s, AV_LOG_ERROR,
            "max resync size reached, could not find sync byte\n");
@@ -2971,6 +2986,54 @@ static void finished_reading_packet(AVFormatContext *s, int raw_packet_size)
         avio_skip(pb, skip);
 }
 
+/**
+ * @return the number of packets at the start of buf that begin with a sync byte
+ */
+static int count_synced_packets(const uint8_t *buf, int nb_packets)
+{
+    int i = 0;
+
+    /* check four packets at a time, a run without errors is the common case */
+    for (; i + 4 <= nb_packets; i += 4) {
+        const uint8_t *p = buf + i * TS_PACKET_SIZE;
+        if ((p[0]                  ^ 0x47) | (p[    TS_PACKET_SIZE] ^ 0x47) |
+            (p[2 * TS_PACKET_SIZE] ^ 0x47) | (p[3 * TS_PACKET_SIZE] ^ 0x47))
+            break;
+    }
+    for (; i < nb_packets; i++)
+        if (buf[i * TS_PACKET_SIZE] != 0x47)
+            break;
+    return i;
+}
+
+/**
+ * Handle the 188 byte packets that are already in the I/O buffer in place,
+ * up to the first one without a sync byte, which is left to read_packet().
+ * @return the number of packets handled, 0 if read_packet() has to be used
+ */
+static int handle_buffered_packets(MpegTSContext *ts, int max_packets, int *ret)
+{
+    AVIOContext *pb = ts->stream->pb;
+    int nb = FFMIN((pb->buf_end - pb->buf_ptr) / TS_PACKET_SIZE, max_packets);
+    int64_t pos;
+    int i = 0;
+
+    nb = count_synced_packets(pb->buf_ptr, nb);
+    if (!nb)
+        return 0;
+
+    pos = avio_tell(pb);
+    while (i < nb) {
+        const uint8_t *packet = pb->buf_ptr;
+        pb->buf_ptr += TS_PACKET_SIZE;
+        pos         += TS_PACKET_SIZE;
+        i++;
+        if ((*ret = handle_packet(ts, packet, pos)) || ts->stop_parse)
+            break;
+    }
+    return i;
+}
+
 static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
 {
     AVFormatContext *s = ts->stream;
@@ -3012,6 +3075,17 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
         if (ts->stop_parse > 0)
             break;
 
+        if (ts->raw_packet_size == TS_PACKET_SIZE) {
+            int max = nb_packets ? FFMIN(nb_packets - packet_num, INT_MAX) : INT_MAX;
+            int n   = handle_buffered_packets(ts, max, &ret);
+            if (ret != 0)
+                break;
+            if (n > 0) {
+                packet_num += n - 1;
+                continue;
+            }
+        }
+
         ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             break;
@@ -0,0 +1,581 @@
+/*
+ * Cache of the stream parameters found by avformat_find_stream_info()
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Each entry is a small text file in the cache directory, named after a hash
+ * of the input identity. The first line describes the format context and
+ * each following line one stream, as key=value pairs separated by ';'.
+ */
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/dict.h"
+#include "libavutil/hash.h"
+#include "libavutil/mem.h"
+#include "libavutil/random_seed.h"
+#include "libavcodec/avcodec.h"
+#include "libavcodec/codec_par.h"
+
+#include "avformat.h"
+#include "avio_internal.h"
+#include "demux.h"
+#include "internal.h"
+#include "os_support.h"
+#include "url.h"
+
+#define CACHE_VERSION   2
+#define CACHE_MAX_SIZE  (16 << 20)
+
+#ifndef S_ISREG
+#   define S_ISREG(m) (((m) & S_IFMT) == S_IFREG)
+#endif
+
+struct FFProbeCacheEntry {
+    /* the format line, then one line per stream */
+    AVDictionary **dicts;
+    AVCodecParameters **pars;
+    unsigned nb_streams;
+};
+
+enum FieldType {
+    FIELD_INT,
+    FIELD_INT64,
+    FIELD_UINT32,
+    FIELD_RATIONAL,
+};
+
+typedef struct CacheField {
+    const char *name;
+    size_t offset;
+    enum FieldType type;
+} CacheField;
+
+#define PAR(name, type) { #name, offsetof(AVCodecParameters, name), FIELD_ ## type }
+static const CacheField par_fields[] = {
+    PAR(codec_type,            INT),
+    PAR(codec_id,              INT),
+    PAR(codec_tag,             UINT32),
+    PAR(format,                INT),
+    PAR(bit_rate,              INT64),
+    PAR(bits_per_coded_sample, INT),
+    PAR(bits_per_raw_sample,   INT),
+    PAR(profile,               INT),
+    PAR(level,                 INT),
+    PAR(width,                 INT),
+    PAR(height,                INT),
+    PAR(sample_aspect_ratio,   RATIONAL),
+    PAR(framerate,             RATIONAL),
+    PAR(field_order,           INT),
+    PAR(color_range,           INT),
+    PAR(color_primaries,       INT),
+    PAR(color_trc,             INT),
+    PAR(color_space,           INT),
+    PAR(chroma_location,       INT),
+    PAR(video_delay,           INT),
+    PAR(sample_rate,           INT),
+    PAR(block_align,           INT),
+    PAR(frame_size,            INT),
+    PAR(initial_padding,       INT),
+    PAR(trailing_padding,      INT),
+    PAR(seek_preroll,          INT),
+};
+
+#define ST(name, type) { "st_" #name, offsetof(AVStream, name), FIELD_ ## type }
+static const CacheField stream_fields[] = {
+    ST(start_time,             INT64),
+    ST(duration,               INT64),
+    ST(nb_frames,              INT64),
+    ST(disposition,            INT),
+    ST(sample_aspect_ratio,    RATIONAL),
+    ST(r_frame_rate,           RATIONAL),
+    ST(avg_frame_rate,         RATIONAL),
+};
+
+#define FMT(name, type) { #name, offsetof(AVFormatContext, name), FIELD_ ## type }
+static const CacheField format_fields[] = {
+    FMT(start_time,                 INT64),
+    FMT(duration,                   INT64),
+    FMT(bit_rate,                   INT64),
+    FMT(duration_estimation_method, INT),
+};
+
+static int set_fields(AVDictionary **dict, const void *obj,
+                      const CacheField *fields, int nb_fields)
+{
+    char buf[64];
+    int ret = 0;
+
+    for (int i = 0; i < nb_fields && ret >= 0; i++) {
+        const uint8_t *p = (const uint8_t *)obj + fields[i].offset;
+
+        switch (fields[i].type) {
+        case FIELD_INT:
+            snprintf(buf, sizeof(buf), "%d", *(const int *)p);
+            break;
+        case FIELD_INT64:
+            snprintf(buf, sizeof(buf), "%"PRId64, *(const int64_t *)p);
+            break;
+        case FIELD_UINT32:
+            snprintf(buf, sizeof(buf), "%"PRIu32, *(const uint32_t *)p);
+            break;
+        case FIELD_RATIONAL: {
+            const AVRational *q = (const AVRational *)p;
+            snprintf(buf, sizeof(buf), "%d/%d", q->num, q->den);
+            break;
+        }
+        }
+        ret = av_dict_set(dict, fields[i].name, buf, 0);
+    }
+    return ret;
+}
+
+static int get_fields(const AVDictionary *dict, void *obj,
+                      const CacheField *fields, int nb_fields)
+{
+    for (int i = 0; i < nb_fields; i++) {
+        const AVDictionaryEntry *e = av_dict_get(dict, fields[i].name, NULL, 0);
+        uint8_t *p = (uint8_t *)obj + fields[i].offset;
+        int64_t v;
+        AVRational q;
+
+        if (!e)
+            return AVERROR_INVALIDDATA;
+
+        switch (fields[i].type) {
+        case FIELD_INT:
+        case FIELD_INT64:
+        case FIELD_UINT32:
+            if (sscanf(e->value, "%"SCNd64, &v) != 1)
+                return AVERROR_INVALIDDATA;
+            if (fields[i].type == FIELD_INT)
+                *(int *)p = v;
+            else if (fields[i].type == FIELD_UINT32)
+                *(uint32_t *)p = v;
+            else
+                *(int64_t *)p = v;
+            break;
+        case FIELD_RATIONAL:
+            if (sscanf(e->value, "%d/%d", &q.num, &q.den) != 2)
+                return AVERROR_INVALIDDATA;
+            *(AVRational *)p = q;
+            break;
+        }
+    }
+    return 0;
+}
+
+int ff_probe_cache_key(AVFormatContext *s, char *key, int key_size)
+{
+    URLContext *h = s->pb ? ffio_geturlcontext(s->pb) : NULL;
+    struct AVHashContext *hash;
+    struct stat st;
+    AVBPrint bp;
+    int64_t mtime_nsec = 0;
+    int fd, ret;
+
+    /* only regular files can be identified without reading all of them */
+    if (!h || (s->flags & (AVFMT_FLAG_CUSTOM_IO | AVFMT_FLAG_NOBUFFER)) ||
+        (fd = ffurl_get_file_handle(h)) < 0 ||
+        fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+        return AVERROR(ENOSYS);
+#if HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+    mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+
+    if ((ret = av_hash_alloc(&hash, "SHA256")) < 0)
+        return ret;
+    av_hash_init(hash);
+
+    /* everything that can change the outcome of the probing */
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_AUTOMATIC);
+    av_bprintf(&bp, "%d|%s|%s|%"PRIu64"|%"PRIu64"|%"PRId64"|%"PRId64"|%"PRId64"|"
+               "%"PRId64"|%"PRId64"|%d|%d|%u",
+               CACHE_VERSION, s->url, s->iformat->name,
+               (uint64_t)st.st_dev, (uint64_t)st.st_ino, (int64_t)st.st_size,
+               (int64_t)st.st_mtime, mtime_nsec,
+               s->probesize, s->max_analyze_duration, s->fps_probe_size,
+               s->flags, s->nb_streams);
+    av_hash_update(hash, bp.str, bp.len);
+    av_bprint_finalize(&bp, NULL);
+
+    av_hash_final_hex(hash, key, key_size);
+    av_hash_freep(&hash);
+    return 0;
+}
+
+static char *cache_path(AVFormatContext *s, const char *key)
+{
+    return av_asprintf("%s/%s", s->probe_cache, key);
+}
+
+/**
+ * Parse the entry of one stream into par and check that it agrees with
+ * what the demuxer already knows about st.
+ */
+static int parse_stream(AVCodecParameters *par, const AVStream *st,
+                        const AVDictionary *dict)
+{
+    const AVDictionaryEntry *e;
+    AVRational time_base;
+    int ret;
+
+    if (!(e = av_dict_get(dict, "st_id", NULL, 0)) || atoi(e->value) != st->id ||
+        !(e = av_dict_get(dict, "st_time_base", NULL, 0)) ||
+        sscanf(e->value, "%d/%d", &time_base.num, &time_base.den) != 2 ||
+        av_cmp_q(time_base, st->time_base))
+        return AVERROR_INVALIDDATA;
+
+    if ((ret = get_fields(dict, par, par_fields, FF_ARRAY_ELEMS(par_fields))) < 0)
+        return ret;
+    /* the codec id may legitimately be refined by probing (e.g. mp3 to mp2
+     * in MPEG-TS), the media type may not */
+    if (st->codecpar->codec_type != AVMEDIA_TYPE_UNKNOWN &&
+        st->codecpar->codec_type != par->codec_type)
+        return AVERROR_INVALIDDATA;
+
+    if ((e = av_dict_get(dict, "ch_layout", NULL, 0)) &&
+        (ret = av_channel_layout_from_string(&par->ch_layout, e->value)) < 0)
+        return ret;
+
+    if ((e = av_dict_get(dict, "extradata", NULL, 0))) {
+        int size = ff_hex_to_data(NULL, e->value);
+        if ((ret = ff_alloc_extradata(par, size)) < 0)
+            return ret;
+        ff_hex_to_data(par->extradata, e->value);
+    }
+    return 0;
+}
+
+void ff_probe_cache_free(FFProbeCacheEntry **pentry)
+{
+    FFProbeCacheEntry *entry = *pentry;
+
+    if (!entry)
+        return;
+    if (entry->dicts)
+        for (unsigned i = 0; i <= entry->nb_streams; i++)
+            av_dict_free(&entry->dicts[i]);
+    if (entry->pars)
+        for (unsigned i = 0; i < entry->nb_streams; i++)
+            avcodec_parameters_free(&entry->pars[i]);
+    av_free(entry->dicts);
+    av_free(entry->pars);
+    av_freep(pentry);
+}
+
+int ff_probe_cache_load(AVFormatContext *s, const char *key,
+                        FFProbeCacheEntry **pentry)
+{
+    FFProbeCacheEntry *entry;
+    AVIOContext *pb = NULL;
+    AVBPrint bp;
+    char *path, *line, *next = NULL;
+    AVFormatContext tmp_fmt = *s;
+    int ret;
+
+    *pentry = NULL;
+    if (!(path = cache_path(s, key)))
+        return AVERROR(ENOMEM);
+    ret = ffio_open_whitelist(&pb, path, AVIO_FLAG_READ, &s->interrupt_callback,
+                              NULL, s->protocol_whitelist, s->protocol_blacklist);
+    av_free(path);
+    if (ret < 0)
+        return ret;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    ret = avio_read_to_bprint(pb, &bp, CACHE_MAX_SIZE);
+    avio_closep(&pb);
+    if (ret >= 0 && !av_bprint_is_complete(&bp))
+        ret = AVERROR(ENOMEM);
+    if (ret < 0)
+        goto end;
+
+    if (!(entry = *pentry = av_mallocz(sizeof(*entry)))) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    entry->nb_streams = s->nb_streams;
+    entry->dicts = av_calloc(s->nb_streams + 1, sizeof(*entry->dicts));
+    entry->pars  = av_calloc(s->nb_streams, sizeof(*entry->pars));
+    if (!entry->dicts || !entry->pars) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    line = av_strtok(bp.str, "\n", &next);
+    for (unsigned i = 0; i <= s->nb_streams; i++) {
+        if (!line || (ret = av_dict_parse_string(&entry->dicts[i], line, "=", ";", 0)) < 0) {
+            ret = AVERROR_INVALIDDATA;
+            goto end;
+        }
+        line = av_strtok(NULL, "\n", &next);
+    }
+    if (line || !av_dict_get(entry->dicts[0], "nb_streams", NULL, 0) ||
+        atoi(av_dict_get(entry->dicts[0], "nb_streams", NULL, 0)->value) != s->nb_streams) {
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+
+    /* check the whole entry, so that applying it cannot fail halfway */
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        AVStream tmp = *s->streams[i];
+
+        if (!(entry->pars[i] = avcodec_parameters_alloc())) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if ((ret = parse_stream(entry->pars[i], s->streams[i], entry->dicts[i + 1])) < 0 ||
+            (ret = get_fields(entry->dicts[i + 1], &tmp, stream_fields,
+                              FF_ARRAY_ELEMS(stream_fields))) < 0)
+            goto end;
+    }
+    ret = get_fields(entry->dicts[0], &tmp_fmt, format_fields, FF_ARRAY_ELEMS(format_fields));
+
+end:
+    if (ret < 0)
+        ff_probe_cache_free(pentry);
+    av_bprint_finalize(&bp, NULL);
+    return ret;
+}
+
+int ff_probe_cache_check(AVFormatContext *s, const FFProbeCacheEntry *entry,
+                         const AVPacket *pkt)
+{
+    const AVCodecParameters *par;
+    const AVCodec *codec;
+    AVCodecContext *avctx;
+    AVDictionary *opts = NULL;
+    AVFrame *frame;
+    int ret;
+
+    /* streams appeared while reading the packet */
+    if (s->nb_streams != entry->nb_streams)
+        return AVERROR_INVALIDDATA;
+    par = entry->pars[pkt->stream_index];
+    if (par->codec_type != AVMEDIA_TYPE_VIDEO && par->codec_type != AVMEDIA_TYPE_AUDIO)
+        return 0;
+    if (!(codec = avcodec_find_decoder(par->codec_id)))
+        return 0;
+
+    avctx = avcodec_alloc_context3(codec);
+    frame = av_frame_alloc();
+    if (!avctx || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if ((ret = avcodec_parameters_to_context(avctx, par)) < 0)
+        goto end;
+    av_dict_set(&opts, "threads", "1", 0);
+    if (s->codec_whitelist)
+        av_dict_set(&opts, "codec_whitelist", s->codec_whitelist, 0);
+    if ((ret = avcodec_open2(avctx, codec, &opts)) < 0)
+        goto end;
+
+    ret = avcodec_send_packet(avctx, pkt);
+    if (ret >= 0) {
+        ret = avcodec_receive_frame(avctx, frame);
+        if (ret == AVERROR(EAGAIN) && avcodec_send_packet(avctx, NULL) >= 0)
+            ret = avcodec_receive_frame(avctx, frame);
+    }
+    /* a packet that does not decode on its own (e.g. not a keyframe) proves
+     * nothing, only what was actually decoded is compared */
+    if (ret < 0) {
+        ret = 0;
+        goto end;
+    }
+
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+        if (frame->width != par->width || frame->height != par->height ||
+            frame->format != par->format)
+            ret = AVERROR_INVALIDDATA;
+    } else {
+        if (frame->sample_rate != par->sample_rate ||
+            frame->ch_layout.nb_channels != par->ch_layout.nb_channels ||
+            frame->format != par->format)
+            ret = AVERROR_INVALIDDATA;
+    }
+
+end:
+    av_dict_free(&opts);
+    av_frame_free(&frame);
+    avcodec_free_context(&avctx);
+    return ret;
+}
+
+int ff_probe_cache_apply(AVFormatContext *s, FFProbeCacheEntry *entry)
+{
+    get_fields(entry->dicts[0], s, format_fields, FF_ARRAY_ELEMS(format_fields));
+
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        AVStream *const st  = s->streams[i];
+        FFStream *const sti = ffstream(st);
+        const AVDictionaryEntry *e = NULL;
+        int ret;
+
+        get_fields(entry->dicts[i + 1], st, stream_fields, FF_ARRAY_ELEMS(stream_fields));
+        if ((ret = avcodec_parameters_copy(st->codecpar, entry->pars[i])) < 0)
+            return ret;
+
+        while ((e = av_dict_get(entry->dicts[i + 1], "side_data_", e, AV_DICT_IGNORE_SUFFIX))) {
+            int type = atoi(e->key + strlen("side_data_"));
+            uint8_t *data;
+
+            if (type < 0 || type >= AV_PKT_DATA_NB)
+                continue;
+            data = av_stream_new_side_data(st, type, ff_hex_to_data(NULL, e->value));
+            if (!data)
+                return AVERROR(ENOMEM);
+            ff_hex_to_data(data, e->value);
+        }
+        if (sti->request_probe > 0)
+            sti->request_probe = -1;
+        sti->need_context_update = 1;
+    }
+    return 0;
+}
+
+int ff_probe_cache_delete(AVFormatContext *s, const char *key)
+{
+    char *path = cache_path(s, key);
+    int ret;
+
+    if (!path)
+        return AVERROR(ENOMEM);
+    ret = ffurl_delete(path);
+    av_free(path);
+    return ret;
+}
+
+static int set_hex(AVDictionary **dict, const char *key,
+                   const uint8_t *data, int size)
+{
+    char *hex = av_malloc(2 * size + 1);
+
+    if (!hex)
+        return AVERROR(ENOMEM);
+    ff_data_to_hex(hex, data, size, 1);
+    hex[2 * size] = 0;
+    return av_dict_set(dict, key, hex, AV_DICT_DONT_STRDUP_VAL);
+}
+
+static int write_dict(AVIOContext *pb, const AVDictionary *dict)
+{
+    char *str;
+    int ret = av_dict_get_string(dict, &str, '=', ';');
+    if (ret < 0)
+        return ret;
+    avio_printf(pb, "%s\n", str);
+    av_free(str);
+    return 0;
+}
+
+static int stream_dict(AVDictionary **dict, const AVStream *st)
+{
+    const AVCodecParameters *par = st->codecpar;
+    char buf[128];
+    int ret;
+
+    snprintf(buf, sizeof(buf), "%d/%d", st->time_base.num, st->time_base.den);
+    if ((ret = av_dict_set_int(dict, "st_id", st->id, 0)) < 0 ||
+        (ret = av_dict_set(dict, "st_time_base", buf, 0)) < 0 ||
+        (ret = set_fields(dict, par, par_fields, FF_ARRAY_ELEMS(par_fields))) < 0 ||
+        (ret = set_fields(dict, st, stream_fields, FF_ARRAY_ELEMS(stream_fields))) < 0)
+        return ret;
+
+    if (par->ch_layout.nb_channels) {
+        if (av_channel_layout_describe(&par->ch_layout, buf, sizeof(buf)) < 0 ||
+            strchr(buf, ';') || strchr(buf, '='))
+            return AVERROR(ENOSYS);
+        if ((ret = av_dict_set(dict, "ch_layout", buf, 0)) < 0)
+            return ret;
+    }
+
+    if (par->extradata_size > 0 &&
+        (ret = set_hex(dict, "extradata", par->extradata, par->extradata_size)) < 0)
+        return ret;
+
+    for (int i = 0; i < st->nb_side_data; i++) {
+        const AVPacketSideData *sd = &st->side_data[i];
+
+        snprintf(buf, sizeof(buf), "side_data_%d", sd->type);
+        if (sd->size > 0 && (ret = set_hex(dict, buf, sd->data, sd->size)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
+int ff_probe_cache_store(AVFormatContext *s, const char *key)
+{
+    AVIOContext *pb = NULL;
+    AVDictionary *dict = NULL;
+    char *path, *tmp = NULL;
+    int ret;
+
+    if (!(path = cache_path(s, key)) ||
+        !(tmp = av_asprintf("%s.%08"PRIx32".tmp", path, av_get_random_seed()))) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    /* write to a temporary file and rename it, so that concurrent
+     * readers never see a partial entry */
+    ret = ffio_open_whitelist(&pb, tmp, AVIO_FLAG_WRITE, &s->interrupt_callback,
+                              NULL, s->protocol_whitelist, s->protocol_blacklist);
+    if (ret < 0)
+        goto end;
+
+    if ((ret = av_dict_set_int(&dict, "nb_streams", s->nb_streams, 0)) < 0 ||
+        (ret = set_fields(&dict, s, format_fields, FF_ARRAY_ELEMS(format_fields))) < 0 ||
+        (ret = write_dict(pb, dict)) < 0)
+        goto end;
+
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        av_dict_free(&dict);
+        if ((ret = stream_dict(&dict, s->streams[i])) < 0 ||
+            (ret = write_dict(pb, dict)) < 0)
+            goto end;
+    }
+
+    avio_flush(pb);
+    ret = pb->error;
+
+end:
+    av_dict_free(&dict);
+    if (pb) {
+        int err = avio_closep(&pb);
+        if (ret >= 0)
+            ret = err;
+        if (ret >= 0)
+            ret = ff_rename(tmp, path, s);
+        if (ret < 0)
+            ffurl_delete(tmp);
+    }
+    av_free(path);
+    av_free(tmp);
+    return ret;
+}
@@ -23,6 +23,7 @@
 #include "config_components.h"
 
 #include "avformat.h"
+#include "avio_internal.h"
 #include "internal.h"
 #include "rawdec.h"
 #include "libavutil/opt.h"
@@ -34,10 +35,25 @@
 int ff_raw_read_partial_packet(AVFormatContext *s, AVPacket *pkt)
 {
     FFRawDemuxerContext *raw = s->priv_data;
+    AVBufferRef *buf;
+    int64_t pos;
     int ret, size;
 
     size = raw->raw_packet_size;
 
+    pos = avio_tell(s->pb);
+    ret = ffio_read_ref(s->pb, size, &buf);
+    if (ret >= 0) {
+        pkt->buf  = buf;
+        pkt->data = buf->data;
+        pkt->size = ret;
+        pkt->pos  = pos;
+        pkt->stream_index = 0;
+        return ret;
+    } else if (ret != AVERROR(ENOSYS)) {
+        return ret;
+    }
+
     if ((ret = av_new_packet(pkt, size)) < 0)
         return ret;
 
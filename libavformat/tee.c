@@ -115,6 +115,27 @@ static int parse_slave_fifo_options(const char *fifo_options, TeeSlave *tee_slav
     return av_dict_parse_string(&tee_slave->fifo_options, fifo_options, "=", ":", 0);
 }
 
+static int parse_slave_queue_size(const char *queue_size, TeeSlave *tee_slave)
+{
+    tee_slave->use_fifo = 1;
+    return av_dict_set(&tee_slave->fifo_options, "queue_size", queue_size, 0);
+}
+
+static int parse_slave_overflow_policy(const char *onfull, TeeSlave *tee_slave)
+{
+    const char *drop;
+
+    if (!av_strcasecmp("block", onfull))
+        drop = "0";
+    else if (!av_strcasecmp("drop", onfull))
+        drop = "1";
+    else
+        return AVERROR(EINVAL);
+
+    tee_slave->use_fifo = 1;
+    return av_dict_set(&tee_slave->fifo_options, "drop_pkts_on_overflow", drop, 0);
+}
+
 static int close_slave(TeeSlave *tee_slave)
 {
     AVFormatContext *avf;
@@ -161,6 +182,7 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
     char *filename;
     char *format = NULL, *select = NULL, *on_fail = NULL;
     char *use_fifo = NULL, *fifo_options_str = NULL;
+    char *queue_size = NULL, *onfull = NULL;
     AVFormatContext *avf2 = NULL;
     AVStream *st, *st2;
     int stream_count;
@@ -195,6 +217,12 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
                           av_err2str(ret)););
     PROCESS_OPTION("fifo_options", fifo_options_str,
                    parse_slave_fifo_options(fifo_options_str, tee_slave), ;);
+    PROCESS_OPTION("queue_size", queue_size,
+                   parse_slave_queue_size(queue_size, tee_slave), ;);
+    PROCESS_OPTION("onfull", onfull,
+                   parse_slave_overflow_policy(onfull, tee_slave),
+                   av_log(avf, AV_LOG_ERROR, "Invalid onfull option value, "
+                          "valid options are 'block' and 'drop'\n"););
     entry = NULL;
     while ((entry = av_dict_get(options, "bsfs", entry, AV_DICT_IGNORE_SUFFIX))) {
         /* trim out strlen("bsfs") characters from key */
@@ -543,6 +571,11 @@ static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
     unsigned i, s;
     int s2;
 
+    /* Make the packet refcounted here, so that the slaves and their fifo
+     * queues share its data instead of each of them making a copy. */
+    if (pkt && !pkt->buf && (ret = av_packet_make_refcounted(pkt)) < 0)
+        return ret;
+
     for (i = 0; i < tee->nb_slaves; i++) {
         if (!(avf2 = tee->slaves[i].avf))
             continue;
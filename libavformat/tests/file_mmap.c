@@ -0,0 +1,85 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/dict.h"
+#include "libavutil/error.h"
+#include "libavformat/avformat.h"
+
+/* Read a rawvideo file with and without mmap and check that the packets
+ * are identical and that the padding of the mapped ones is zero. */
+
+static int open_input(AVFormatContext **s, const char *filename, int mmap)
+{
+    AVDictionary *opts = NULL;
+    int ret;
+
+    av_dict_set(&opts, "video_size",   "352x288", 0);
+    av_dict_set(&opts, "pixel_format", "yuv420p", 0);
+    av_dict_set(&opts, "mmap", mmap ? "1" : "0", 0);
+    ret = avformat_open_input(s, filename, av_find_input_format("rawvideo"), &opts);
+    av_dict_free(&opts);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint8_t zero[AV_INPUT_BUFFER_PADDING_SIZE];
+    AVFormatContext *ref = NULL, *map = NULL;
+    AVPacket *ref_pkt = av_packet_alloc(), *map_pkt = av_packet_alloc();
+    int ret, n = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <352x288 yuv420p file>\n", argv[0]);
+        return 1;
+    }
+    if (!ref_pkt || !map_pkt)
+        return 1;
+
+    if ((ret = open_input(&ref, argv[1], 0)) < 0 ||
+        (ret = open_input(&map, argv[1], 1)) < 0) {
+        fprintf(stderr, "cannot open %s: %s\n", argv[1], av_err2str(ret));
+        return 1;
+    }
+
+    while ((ret = av_read_frame(ref, ref_pkt)) >= 0) {
+        if ((ret = av_read_frame(map, map_pkt)) < 0) {
+            printf("frame %d: missing with mmap\n", n);
+            break;
+        }
+        printf("frame %d: size %d, %s, data %s, padding %s\n", n,
+               map_pkt->size,
+               av_buffer_is_writable(map_pkt->buf) ? "copied" : "mapped",
+               map_pkt->size == ref_pkt->size &&
+               !memcmp(map_pkt->data, ref_pkt->data, ref_pkt->size) ? "ok" : "differs",
+               !memcmp(map_pkt->data + map_pkt->size, zero, sizeof(zero)) ? "ok" : "not zero");
+        av_packet_unref(ref_pkt);
+        av_packet_unref(map_pkt);
+        n++;
+    }
+    if (ret == AVERROR_EOF && av_read_frame(map, map_pkt) != AVERROR_EOF)
+        printf("extra packets with mmap\n");
+
+    av_packet_free(&ref_pkt);
+    av_packet_free(&map_pkt);
+    avformat_close_input(&ref);
+    avformat_close_input(&map);
+    return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/hash.h"
+#include "libavutil/log.h"
+#include "libavutil/macros.h"
+#include "libavformat/avformat.h"
+#include "libavformat/avio.h"
+#include "libavformat/demux.h"
+#include "libavformat/os_support.h"
+#include "libavformat/url.h"
+
+/* Open a BMP file repeatedly with a probe cache and print whether the cached
+ * parameters were used, after changing the file and after forging a stale
+ * entry that has to be detected from the decoded picture. */
+
+static const char *cache_event;
+
+static void log_callback(void *avcl, int level, const char *fmt, va_list vl)
+{
+    if (strstr(fmt, "Using the cached stream parameters"))
+        cache_event = "hit";
+    else if (strstr(fmt, "do not match the input"))
+        cache_event = "invalidated";
+}
+
+static int write_bmp(const char *filename, int width, int height)
+{
+    int stride = FFALIGN(3 * width, 4);
+    int size = 54 + stride * height;
+    AVIOContext *pb;
+    int ret;
+
+    if ((ret = avio_open(&pb, filename, AVIO_FLAG_WRITE)) < 0)
+        return ret;
+    avio_write(pb, "BM", 2);
+    avio_wl32(pb, size);
+    avio_wl32(pb, 0);
+    avio_wl32(pb, 54);
+    avio_wl32(pb, 40);
+    avio_wl32(pb, width);
+    avio_wl32(pb, height);
+    avio_wl16(pb, 1);
+    avio_wl16(pb, 24);
+    avio_wl32(pb, 0);
+    avio_wl32(pb, stride * height);
+    avio_wl32(pb, 2835);
+    avio_wl32(pb, 2835);
+    avio_wl32(pb, 0);
+    avio_wl32(pb, 0);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < stride; x++)
+            avio_w8(pb, x + y);
+    return avio_closep(&pb);
+}
+
+static int open_input(AVFormatContext **s, const char *filename, const char *cache)
+{
+    AVDictionary *opts = NULL;
+    int ret;
+
+    av_dict_set(&opts, "probe_cache", cache, 0);
+    ret = avformat_open_input(s, filename, av_find_input_format("bmp_pipe"), &opts);
+    av_dict_free(&opts);
+    return ret;
+}
+
+static int probe(const char *step, const char *filename, const char *cache)
+{
+    AVFormatContext *s = NULL;
+    int ret;
+
+    cache_event = "miss";
+    if ((ret = open_input(&s, filename, cache)) < 0 ||
+        (ret = avformat_find_stream_info(s, NULL)) < 0) {
+        printf("%s: %s\n", step, av_err2str(ret));
+        avformat_close_input(&s);
+        return ret;
+    }
+    printf("%s: %s, %dx%d\n", step, cache_event,
+           s->streams[0]->codecpar->width, s->streams[0]->codecpar->height);
+    avformat_close_input(&s);
+    return 0;
+}
+
+static int cache_key(char *key, const char *filename, const char *cache)
+{
+    AVFormatContext *s = NULL;
+    int ret;
+
+    if ((ret = open_input(&s, filename, cache)) < 0)
+        return ret;
+    ret = ff_probe_cache_key(s, key, AV_HASH_MAX_SIZE * 2 + 1);
+    avformat_close_input(&s);
+    return ret;
+}
+
+static int copy_file(const char *dst, const char *src)
+{
+    AVIOContext *in, *out;
+    uint8_t buf[4096];
+    int ret;
+
+    if ((ret = avio_open(&in, src, AVIO_FLAG_READ)) < 0)
+        return ret;
+    if ((ret = avio_open(&out, dst, AVIO_FLAG_WRITE)) < 0) {
+        avio_closep(&in);
+        return ret;
+    }
+    while ((ret = avio_read(in, buf, sizeof(buf))) > 0)
+        avio_write(out, buf, ret);
+    avio_closep(&in);
+    return avio_closep(&out);
+}
+
+int main(int argc, char **argv)
+{
+    char key[AV_HASH_MAX_SIZE * 2 + 1], stale_key[AV_HASH_MAX_SIZE * 2 + 1];
+    char *cache, *filename, *src, *dst;
+    AVIODirContext *dir = NULL;
+    AVIODirEntry *entry;
+    int ret;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <directory>\n", argv[0]);
+        return 1;
+    }
+    av_log_set_callback(log_callback);
+
+    cache    = av_asprintf("%s/cache", argv[1]);
+    filename = av_asprintf("%s/probecache.bmp", argv[1]);
+    if (!cache || !filename)
+        return 1;
+    if ((mkdir(argv[1], 0777) < 0 && errno != EEXIST) ||
+        (mkdir(cache,   0777) < 0 && errno != EEXIST)) {
+        fprintf(stderr, "cannot create %s\n", cache);
+        return 1;
+    }
+
+    /* start from an empty cache */
+    if (avio_open_dir(&dir, cache, NULL) >= 0) {
+        while (avio_read_dir(dir, &entry) >= 0 && entry) {
+            char *path = av_asprintf("%s/%s", cache, entry->name);
+            if (path && entry->type == AVIO_ENTRY_FILE)
+                ffurl_delete(path);
+            av_free(path);
+            avio_free_directory_entry(&entry);
+        }
+        avio_close_dir(&dir);
+    }
+
+    if (write_bmp(filename, 8, 16) < 0 ||
+        probe("first open", filename, cache) < 0 ||
+        probe("second open", filename, cache) < 0)
+        return 1;
+
+    /* a different size gives a different key */
+    if (write_bmp(filename, 16, 16) < 0 ||
+        probe("after resizing", filename, cache) < 0 ||
+        cache_key(key, filename, cache) < 0)
+        return 1;
+
+    /* same file size; give the new file the entry of the old one, as if
+     * the modification time had not changed */
+    if (write_bmp(filename, 32, 8) < 0 ||
+        cache_key(stale_key, filename, cache) < 0)
+        return 1;
+    if (strcmp(key, stale_key)) {
+        src = av_asprintf("%s/%s", cache, key);
+        dst = av_asprintf("%s/%s", cache, stale_key);
+        ret = src && dst ? copy_file(dst, src) : AVERROR(ENOMEM);
+        av_free(src);
+        av_free(dst);
+        if (ret < 0)
+            return 1;
+    }
+    if (probe("stale entry", filename, cache) < 0 ||
+        probe("after invalidation", filename, cache) < 0)
+        return 1;
+
+    av_free(cache);
+    av_free(filename);
+    return 0;
+}
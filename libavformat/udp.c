@@ -26,6 +26,7 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() with glibc */
 
 #include "avformat.h"
 #include "avio_internal.h"
@@ -61,6 +62,10 @@
 #define IPPROTO_UDPLITE                                  136
 #endif
 
+#if defined(__linux__) && !defined(UDP_SEGMENT)
+#define UDP_SEGMENT                                      103
+#endif
+
 #if HAVE_W32THREADS
 #undef HAVE_PTHREAD_CANCEL
 #define HAVE_PTHREAD_CANCEL 1
@@ -79,6 +84,11 @@
 #define UDP_RX_BUF_SIZE 393216
 #define UDP_MAX_PKT_SIZE 65536
 #define UDP_HEADER_SIZE 8
+#define UDP_MAX_BATCH 1024
+#define UDP_GSO_MAX_SEGMENTS 64
+#define UDP_GSO_MAX_SIZE 65507
+
+#define UDP_BATCH (HAVE_RECVMMSG && HAVE_SENDMMSG)
 
 typedef struct UDPContext {
     const AVClass *class;
@@ -117,6 +127,21 @@ typedef struct UDPContext {
     char *sources;
     char *block;
     IPSourceFilters filters;
+    int batch;
+    int gso;
+#if UDP_BATCH
+    /* Datagrams received ahead of udp_read() or queued by udp_write(),
+     * in batch slots of slot_size bytes; when gso_segments is set, the
+     * queued datagrams are concatenated in the first slot instead. */
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    struct sockaddr_storage *addrs;
+    uint8_t *batch_buf;
+    int slot_size;
+    int gso_segments;
+    int msg_first;
+    int nb_msgs;
+#endif
 } UDPContext;
 
 #define OFFSET(x) offsetof(UDPContext, x)
@@ -141,6 +166,8 @@ static const AVOption options[] = {
     { "timeout",        "set raise error timeout, in microseconds (only in read mode)",OFFSET(timeout),         AV_OPT_TYPE_INT,  {.i64 = 0}, 0, INT_MAX, D },
     { "sources",        "Source list",                                     OFFSET(sources),        AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "block",          "Block list",                                      OFFSET(block),          AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
+    { "batch",          "Number of datagrams received or sent per system call", OFFSET(batch),     AV_OPT_TYPE_INT,    { .i64 = 1 },      1, UDP_MAX_BATCH, .flags = D|E },
+    { "gso",            "Let the kernel split batches of pkt_size datagrams", OFFSET(gso),         AV_OPT_TYPE_BOOL,   { .i64 = 0 },      0, 1,       E },
     { NULL }
 };
 
@@ -480,7 +507,178 @@ static int udp_get_file_handle(URLContext *h)
     return s->udp_fd;
 }
 
+#if UDP_BATCH
+static int udp_batch_init(URLContext *h, int is_output)
+{
+    UDPContext *s = h->priv_data;
+    int nb_slots = s->batch, slot_size = UDP_MAX_PKT_SIZE, i;
+
+    if (is_output) {
+        /* larger writes bypass the queue */
+        if (s->pkt_size <= 0 || s->pkt_size > UDP_MAX_PKT_SIZE)
+            return 0;
+        slot_size = s->pkt_size;
+        if (s->gso) {
+            int segments = FFMIN3(s->batch, UDP_GSO_MAX_SEGMENTS,
+                                  UDP_GSO_MAX_SIZE / s->pkt_size);
+#ifdef UDP_SEGMENT
+            if (segments > 1 &&
+                setsockopt(s->udp_fd, IPPROTO_UDP, UDP_SEGMENT,
+                           &s->pkt_size, sizeof(s->pkt_size)) < 0) {
+                ff_log_net_error(h, AV_LOG_WARNING, "setsockopt(UDP_SEGMENT)");
+                segments = 0;
+            }
+#else
+            av_log(h, AV_LOG_WARNING,
+                   "UDP segmentation offload is not supported on this platform\n");
+            segments = 0;
+#endif
+            if (segments > 1) {
+                s->gso_segments = segments;
+                slot_size      *= segments;
+                nb_slots        = 1;
+            }
+        }
+    }
+
+    s->batch_buf = av_malloc_array(nb_slots, slot_size);
+    s->msgs      = av_calloc(nb_slots, sizeof(*s->msgs));
+    s->iovs      = av_calloc(nb_slots, sizeof(*s->iovs));
+    s->addrs     = av_calloc(nb_slots, sizeof(*s->addrs));
+    if (!s->batch_buf || !s->msgs || !s->iovs || !s->addrs)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < nb_slots; i++) {
+        s->iovs[i].iov_base = s->batch_buf + (size_t)i * slot_size;
+        s->msgs[i].msg_hdr.msg_iov    = &s->iovs[i];
+        s->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    s->batch     = nb_slots;
+    s->slot_size = slot_size;
+    return 0;
+}
+
+static void udp_batch_free(UDPContext *s)
+{
+    av_freep(&s->batch_buf);
+    av_freep(&s->msgs);
+    av_freep(&s->iovs);
+    av_freep(&s->addrs);
+}
+
+/* Receive up to batch datagrams. Returns the recvmmsg() result, so errors
+ * are reported through ff_neterrno(). */
+static int udp_recv_batch(UDPContext *s, int flags)
+{
+    int i, ret;
+
+    for (i = 0; i < s->batch; i++) {
+        s->iovs[i].iov_len = s->slot_size;
+        s->msgs[i].msg_hdr.msg_name    = &s->addrs[i];
+        s->msgs[i].msg_hdr.msg_namelen = sizeof(s->addrs[i]);
+    }
+    ret = recvmmsg(s->udp_fd, s->msgs, s->batch, flags, NULL);
+    s->msg_first = 0;
+    s->nb_msgs   = FFMAX(ret, 0);
+    return ret;
+}
+
+static int udp_queue_full(UDPContext *s)
+{
+    if (s->gso_segments)
+        return s->nb_msgs == s->gso_segments ||
+               (s->nb_msgs && s->iovs[0].iov_len % s->pkt_size);
+    return s->msg_first + s->nb_msgs == s->batch;
+}
+
+/* The caller checks that the datagram fits, i.e. size <= pkt_size and
+ * the queue is not full. */
+static void udp_queue(UDPContext *s, const uint8_t *buf, int size)
+{
+    struct mmsghdr *msg;
+
+    if (s->gso_segments) {
+        msg = &s->msgs[0];
+        if (!s->nb_msgs)
+            s->iovs[0].iov_len = 0;
+        memcpy(s->batch_buf + s->iovs[0].iov_len, buf, size);
+        s->iovs[0].iov_len += size;
+    } else {
+        int i = s->msg_first + s->nb_msgs;
+        msg = &s->msgs[i];
+        memcpy(s->iovs[i].iov_base, buf, size);
+        s->iovs[i].iov_len = size;
+    }
+    msg->msg_hdr.msg_name    = s->is_connected ? NULL : &s->dest_addr;
+    msg->msg_hdr.msg_namelen = s->is_connected ? 0    : s->dest_addr_len;
+    s->nb_msgs++;
+}
+
+/* Send the queued datagrams. On error, those not sent yet stay queued. */
+static int udp_send_queued(UDPContext *s)
+{
+    int ret;
+
+    if (s->gso_segments) {
+        if (s->nb_msgs) {
+            if (sendmsg(s->udp_fd, &s->msgs[0].msg_hdr, 0) < 0)
+                return ff_neterrno();
+            s->nb_msgs = 0;
+        }
+        return 0;
+    }
+
+    while (s->nb_msgs) {
+        ret = sendmmsg(s->udp_fd, s->msgs + s->msg_first, s->nb_msgs, 0);
+        if (ret < 0)
+            return ff_neterrno();
+        s->msg_first += ret;
+        s->nb_msgs   -= ret;
+    }
+    s->msg_first = 0;
+    return 0;
+}
+
+static int udp_flush_queued(URLContext *h)
+{
+    UDPContext *s = h->priv_data;
+
+    if (!s->nb_msgs)
+        return 0;
+    if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
+        int ret = ff_network_wait_fd(s->udp_fd, 1);
+        if (ret < 0)
+            return ret;
+    }
+    return udp_send_queued(s);
+}
+#endif
+
 #if HAVE_PTHREAD_CANCEL
+static int udp_fifo_write(URLContext *h, const uint8_t *buf, int len)
+{
+    UDPContext *s = h->priv_data;
+    uint8_t tmp[4];
+
+    if (av_fifo_can_write(s->fifo) < len + 4) {
+        /* No Space left */
+        if (s->overrun_nonfatal) {
+            av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
+                    "Surviving due to overrun_nonfatal option\n");
+            return 0;
+        } else {
+            av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                    "To avoid, increase fifo_size URL option. "
+                    "To survive in such case, use overrun_nonfatal option\n");
+            return AVERROR(EIO);
+        }
+    }
+    AV_WL32(tmp, len);
+    av_fifo_write(s->fifo, tmp, 4);
+    av_fifo_write(s->fifo, buf, len);
+    return 0;
+}
+
 static void *circular_buffer_task_rx( void *_URLContext)
 {
     URLContext *h = _URLContext;
@@ -497,7 +695,7 @@ static void *circular_buffer_task_rx( void *_URLContext)
         goto end;
     }
     while(1) {
-        int len;
+        int len, nb = 1, i, ret;
         struct sockaddr_storage addr;
         socklen_t addr_len = sizeof(addr);
 
@@ -506,7 +704,12 @@ static void *circular_buffer_task_rx( void *_URLContext)
            see "General Information" / "Thread Cancelation Overview"
            in Single Unix. */
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
-        len = recvfrom(s->udp_fd, s->tmp+4, sizeof(s->tmp)-4, 0, (struct sockaddr *)&addr, &addr_len);
+#if UDP_BATCH
+        if (s->msgs)
+            len = nb = udp_recv_batch(s, MSG_WAITFORONE);
+        else
+#endif
+        len = recvfrom(s->udp_fd, s->tmp, sizeof(s->tmp), 0, (struct sockaddr *)&addr, &addr_len);
         pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
         pthread_mutex_lock(&s->mutex);
         if (len < 0) {
@@ -516,25 +719,23 @@ static void *circular_buffer_task_rx( void *_URLContext)
             }
             continue;
         }
-        if (ff_ip_check_source_lists(&addr, &s->filters))
-            continue;
-        AV_WL32(s->tmp, len);
-
-        if (av_fifo_can_write(s->fifo) < len + 4) {
-            /* No Space left */
-            if (s->overrun_nonfatal) {
-                av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
-                        "Surviving due to overrun_nonfatal option\n");
+        for (i = 0; i < nb; i++) {
+            struct sockaddr_storage *src = &addr;
+            const uint8_t *data = s->tmp;
+#if UDP_BATCH
+            if (s->msgs) {
+                src  = &s->addrs[i];
+                data = s->iovs[i].iov_base;
+                len  = s->msgs[i].msg_len;
+            }
+#endif
+            if (ff_ip_check_source_lists(src, &s->filters))
                 continue;
-            } else {
-                av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
-                        "To avoid, increase fifo_size URL option. "
-                        "To survive in such case, use overrun_nonfatal option\n");
-                s->circular_buffer_error = AVERROR(EIO);
+            if ((ret = udp_fifo_write(h, data, len)) < 0) {
+                s->circular_buffer_error = ret;
                 goto end;
             }
         }
-        av_fifo_write(s->fifo, s->tmp, len + 4);
         pthread_cond_signal(&s->cond);
     }
 
@@ -587,6 +788,25 @@ static void *circular_buffer_task_tx( void *_URLContext)
 
         av_fifo_read(s->fifo, s->tmp, len);
 
+#if UDP_BATCH
+        /* take whatever else is already waiting, up to a full batch */
+        if (s->msgs && len <= s->pkt_size) {
+            udp_queue(s, s->tmp, len);
+            while (!udp_queue_full(s) && av_fifo_can_read(s->fifo) >= 4) {
+                int next;
+
+                av_fifo_peek(s->fifo, tmp, 4, 0);
+                next = AV_RL32(tmp);
+                if (next > s->pkt_size)
+                    break;
+                av_fifo_drain2(s->fifo, 4);
+                av_fifo_read(s->fifo, s->tmp, next);
+                udp_queue(s, s->tmp, next);
+                len += next;
+            }
+        }
+#endif
+
         pthread_mutex_unlock(&s->mutex);
 
         if (s->bitrate) {
@@ -609,6 +829,19 @@ static void *circular_buffer_task_tx( void *_URLContext)
             target_timestamp = start_timestamp + sent_bits * 1000000 / s->bitrate;
         }
 
+#if UDP_BATCH
+        while (s->nb_msgs) {
+            int ret = udp_send_queued(s);
+            if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR)) {
+                pthread_mutex_lock(&s->mutex);
+                s->circular_buffer_error = ret;
+                pthread_mutex_unlock(&s->mutex);
+                return NULL;
+            }
+            len = 0;
+        }
+#endif
+
         p = s->tmp;
         while (len) {
             int ret;
@@ -757,6 +990,10 @@ static int udp_open(URLContext *h, const char *uri, int flags)
             s->timeout = strtol(buf, NULL, 10);
         if (is_output && av_find_info_tag(buf, sizeof(buf), "broadcast", p))
             s->is_broadcast = strtol(buf, NULL, 10);
+        if (av_find_info_tag(buf, sizeof(buf), "batch", p))
+            s->batch = av_clip(strtol(buf, NULL, 10), 1, UDP_MAX_BATCH);
+        if (is_output && av_find_info_tag(buf, sizeof(buf), "gso", p))
+            s->gso = strtol(buf, NULL, 10);
     }
     /* handling needed to support options picking from both AVOption and URL */
     s->circular_buffer_size *= 188;
@@ -923,6 +1160,17 @@ static int udp_open(URLContext *h, const char *uri, int flags)
 
     s->udp_fd = udp_fd;
 
+    if (s->batch > 1) {
+#if UDP_BATCH
+        if ((ret = udp_batch_init(h, is_output)) < 0)
+            goto fail;
+#else
+        av_log(h, AV_LOG_WARNING,
+               "'batch' option was set but it is not supported on this build "
+               "(recvmmsg() and sendmmsg() are required)\n");
+#endif
+    }
+
 #if HAVE_PTHREAD_CANCEL
     /*
       Create thread in case of:
@@ -974,6 +1222,9 @@ static int udp_open(URLContext *h, const char *uri, int flags)
  fail:
     if (udp_fd >= 0)
         closesocket(udp_fd);
+#if UDP_BATCH
+    udp_batch_free(s);
+#endif
     av_fifo_freep2(&s->fifo);
     ff_ip_reset_filters(&s->filters);
     return ret;
@@ -1040,6 +1291,34 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     }
 #endif
 
+#if UDP_BATCH
+    if (s->msgs) {
+        if (!s->nb_msgs) {
+            if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
+                ret = ff_network_wait_fd(s->udp_fd, 0);
+                if (ret < 0)
+                    return ret;
+            }
+            if (udp_recv_batch(s, 0) < 0)
+                return ff_neterrno();
+        }
+        while (s->nb_msgs) {
+            int i = s->msg_first++;
+            s->nb_msgs--;
+            if (ff_ip_check_source_lists(&s->addrs[i], &s->filters))
+                continue;
+            ret = s->msgs[i].msg_len;
+            if (ret > size) {
+                av_log(h, AV_LOG_WARNING, "Part of datagram lost due to insufficient buffer size\n");
+                ret = size;
+            }
+            memcpy(buf, s->iovs[i].iov_base, ret);
+            return ret;
+        }
+        return AVERROR(EINTR);
+    }
+#endif
+
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 0);
         if (ret < 0)
@@ -1086,6 +1365,22 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
         pthread_mutex_unlock(&s->mutex);
         return size;
     }
+#endif
+#if UDP_BATCH
+    if (s->msgs) {
+        /* The queue is only flushed once it is full and another datagram
+         * arrives, so that an error never refers to an already queued
+         * datagram and a retried write is not sent twice. */
+        if (size > s->pkt_size || udp_queue_full(s)) {
+            ret = udp_flush_queued(h);
+            if (ret < 0)
+                return ret;
+        }
+        if (size <= s->pkt_size) {
+            udp_queue(s, buf, size);
+            return size;
+        }
+    }
 #endif
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 1);
@@ -1117,6 +1412,17 @@ static int udp_close(URLContext *h)
     }
 #endif
 
+#if UDP_BATCH
+    if (s->msgs && !s->fifo && (h->flags & AVIO_FLAG_WRITE)) {
+        int ret;
+        do {
+            ret = udp_flush_queued(h);
+        } while (ret == AVERROR(EAGAIN) || ret == AVERROR(EINTR));
+        if (ret < 0)
+            av_log(h, AV_LOG_ERROR, "Sending queued datagrams failed: %s\n", av_err2str(ret));
+    }
+#endif
+
     if (s->is_multicast && (h->flags & AVIO_FLAG_READ))
         udp_leave_multicast_group(s->udp_fd, (struct sockaddr *)&s->dest_addr,
                                   (struct sockaddr *)&s->local_addr_storage, h);
@@ -1143,6 +1449,9 @@ static int udp_close(URLContext *h)
     }
 #endif
     closesocket(s->udp_fd);
+#if UDP_BATCH
+    udp_batch_free(s);
+#endif
     av_fifo_freep2(&s->fifo);
     ff_ip_reset_filters(&s->filters);
     return 0;
@@ -26,6 +26,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -85,6 +86,13 @@ typedef struct URLProtocol {
     int (*url_get_multi_file_handle)(URLContext *h, int **handles,
                                      int *numhandles);
     int (*url_get_short_seek)(URLContext *h);
+    /**
+     * Return in *buf a reference to size bytes of the resource starting at
+     * pos, sharing the protocol's memory instead of copying it. The
+     * AV_INPUT_BUFFER_PADDING_SIZE bytes after the range must be zero.
+     * Return AVERROR(ENOSYS) if the range cannot be referenced.
+     */
+    int (*url_get_buffer)(URLContext *h, int64_t pos, int size, AVBufferRef **buf);
     int (*url_shutdown)(URLContext *h, int flags);
     const AVClass *priv_data_class;
     int priv_data_size;
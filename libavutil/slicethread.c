@@ -22,12 +22,26 @@
 #include "slicethread.h"
 #include "mem.h"
 #include "thread.h"
+#include "threadpool.h"
 #include "avassert.h"
 
 #define MAX_AUTO_THREADS 16
 
 #if HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS2THREADS
 
+struct AVSliceThreadPool {
+    pthread_t       *threads;
+    int             nb_threads;
+    atomic_int      refcount;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    /* contexts with jobs left that can take another worker, served
+     * round-robin */
+    AVSliceThread   *head, *tail;
+    int             finished;
+};
+
 typedef struct WorkerContext {
     AVSliceThread   *ctx;
     pthread_mutex_t mutex;
@@ -52,8 +66,19 @@ struct AVSliceThread {
     void            *priv;
     void            (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads);
     void            (*main_func)(void *priv);
+
+    /* pool mode, all protected by pool->mutex */
+    AVSliceThreadPool *pool;
+    AVSliceThread   *next;
+    int             queued;
+    int             next_threadnr;
+    int             nb_pool_workers;    ///< pool threads working on our jobs
 };
 
+static AVMutex shared_pool_lock = AV_MUTEX_INITIALIZER;
+static AVSliceThreadPool *shared_pool;
+static int shared_pool_threads;
+
 static int run_jobs(AVSliceThread *ctx)
 {
     unsigned nb_jobs    = ctx->nb_jobs;
@@ -95,14 +120,175 @@ static void *attribute_align_arg thread_worker(void *v)
     }
 }
 
-int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
-                              void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
-                              void (*main_func)(void *priv),
-                              int nb_threads)
+/* Jobs are taken strictly in order, so a job only ever waits on jobs that
+ * already run. */
+static void run_pool_jobs(AVSliceThread *ctx, int threadnr)
 {
-    AVSliceThread *ctx;
-    int nb_workers, i;
+    unsigned nb_jobs = ctx->nb_jobs;
+    unsigned job;
+
+    while ((job = atomic_fetch_add_explicit(&ctx->current_job, 1, memory_order_acq_rel)) < nb_jobs)
+        ctx->worker_func(ctx->priv, job, threadnr, nb_jobs, ctx->nb_active_threads);
+}
+
+static void pool_unlink(AVSliceThreadPool *pool, AVSliceThread *ctx)
+{
+    AVSliceThread **p = &pool->head;
+
+    if (!ctx->queued)
+        return;
+    while (*p != ctx)
+        p = &(*p)->next;
+    *p = ctx->next;
+    if (pool->tail == ctx) {
+        AVSliceThread *last = pool->head;
+        while (last && last->next)
+            last = last->next;
+        pool->tail = last;
+    }
+    ctx->next   = NULL;
+    ctx->queued = 0;
+}
+
+static void pool_append(AVSliceThreadPool *pool, AVSliceThread *ctx)
+{
+    ctx->next   = NULL;
+    ctx->queued = 1;
+    if (pool->tail)
+        pool->tail->next = ctx;
+    else
+        pool->head = ctx;
+    pool->tail = ctx;
+}
+
+static void *attribute_align_arg pool_worker(void *v)
+{
+    AVSliceThreadPool *pool = v;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->finished) {
+        AVSliceThread *ctx = pool->head;
+        int threadnr;
+
+        if (!ctx) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+            continue;
+        }
+
+        /* join ctx, then move it to the back so the next idle worker
+         * serves another client first */
+        threadnr = ctx->next_threadnr++;
+        pool_unlink(pool, ctx);
+        if (ctx->next_threadnr < ctx->nb_active_threads)
+            pool_append(pool, ctx);
+        ctx->nb_pool_workers++;
+        pthread_mutex_unlock(&pool->mutex);
+
+        run_pool_jobs(ctx, threadnr);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool_unlink(pool, ctx);
+        if (!--ctx->nb_pool_workers)
+            pthread_cond_signal(&ctx->done_cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+int avpriv_slicethread_pool_create(AVSliceThreadPool **ppool, int nb_threads)
+{
+    AVSliceThreadPool *pool;
+    int i, ret;
+
+    av_assert0(nb_threads > 0);
+
+    *ppool = pool = av_mallocz(sizeof(*pool));
+    if (!pool)
+        return AVERROR(ENOMEM);
+
+    pool->threads = av_calloc(nb_threads, sizeof(*pool->threads));
+    if (!pool->threads) {
+        av_freep(ppool);
+        return AVERROR(ENOMEM);
+    }
+
+    atomic_init(&pool->refcount, 1);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (i = 0; i < nb_threads; i++) {
+        if (ret = pthread_create(&pool->threads[i], NULL, pool_worker, pool)) {
+            avpriv_slicethread_pool_unref(ppool);
+            return AVERROR(ret);
+        }
+        pool->nb_threads++;
+    }
+
+    return 0;
+}
+
+AVSliceThreadPool *avpriv_slicethread_pool_ref(AVSliceThreadPool *pool)
+{
+    atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
+    return pool;
+}
+
+void avpriv_slicethread_pool_unref(AVSliceThreadPool **ppool)
+{
+    AVSliceThreadPool *pool = *ppool;
+    int i;
+
+    if (!pool)
+        return;
+    *ppool = NULL;
+    if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) > 1)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->finished = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 0; i < pool->nb_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    av_freep(&pool->threads);
+    av_free(pool);
+}
+
+int av_thread_pool_set_shared(int nb_threads)
+{
+    if (nb_threads < 0)
+        return AVERROR(EINVAL);
+
+    ff_mutex_lock(&shared_pool_lock);
+    /* contexts attached to the old pool keep it alive until they are freed */
+    avpriv_slicethread_pool_unref(&shared_pool);
+    shared_pool_threads = nb_threads;
+    ff_mutex_unlock(&shared_pool_lock);
+
+    return 0;
+}
+
+AVSliceThreadPool *avpriv_slicethread_pool_get_shared(void)
+{
+    AVSliceThreadPool *pool = NULL;
+
+    ff_mutex_lock(&shared_pool_lock);
+    if (shared_pool_threads && !shared_pool)
+        avpriv_slicethread_pool_create(&shared_pool, shared_pool_threads);
+    if (shared_pool)
+        pool = avpriv_slicethread_pool_ref(shared_pool);
+    ff_mutex_unlock(&shared_pool_lock);
+
+    return pool;
+}
 
+static int get_nb_threads(int nb_threads)
+{
     av_assert0(nb_threads >= 0);
     if (!nb_threads) {
         int nb_cpus = av_cpu_count();
@@ -111,6 +297,84 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
         else
             nb_threads = 1;
     }
+    return nb_threads;
+}
+
+int avpriv_slicethread_create_pooled(AVSliceThread **pctx, AVSliceThreadPool *pool,
+                                     void *priv,
+                                     void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                                     int nb_threads)
+{
+    AVSliceThread *ctx;
+
+    nb_threads = get_nb_threads(nb_threads);
+
+    *pctx = ctx = av_mallocz(sizeof(*ctx));
+    if (!ctx)
+        return AVERROR(ENOMEM);
+
+    ctx->pool        = avpriv_slicethread_pool_ref(pool);
+    ctx->priv        = priv;
+    ctx->worker_func = worker_func;
+    ctx->nb_threads  = nb_threads;
+
+    atomic_init(&ctx->first_job, 0);
+    atomic_init(&ctx->current_job, 0);
+    pthread_mutex_init(&ctx->done_mutex, NULL);
+    pthread_cond_init(&ctx->done_cond, NULL);
+
+    return nb_threads;
+}
+
+static void pool_execute(AVSliceThread *ctx, int nb_jobs)
+{
+    AVSliceThreadPool *pool = ctx->pool;
+
+    ctx->nb_jobs           = nb_jobs;
+    ctx->nb_active_threads = FFMIN(nb_jobs, ctx->nb_threads);
+    ctx->next_threadnr     = 1;
+    /* the caller takes job 0 itself, so it always runs with threadnr 0 */
+    atomic_store_explicit(&ctx->current_job, 1, memory_order_relaxed);
+
+    if (ctx->nb_active_threads > 1) {
+        pthread_mutex_lock(&pool->mutex);
+        pool_append(pool, ctx);
+        pthread_cond_signal(&pool->cond);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    ctx->worker_func(ctx->priv, 0, 0, nb_jobs, ctx->nb_active_threads);
+    run_pool_jobs(ctx, 0);
+
+    if (ctx->nb_active_threads > 1) {
+        pthread_mutex_lock(&pool->mutex);
+        pool_unlink(pool, ctx);
+        while (ctx->nb_pool_workers)
+            pthread_cond_wait(&ctx->done_cond, &pool->mutex);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
+                              void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                              void (*main_func)(void *priv),
+                              int nb_threads)
+{
+    AVSliceThread *ctx;
+    int nb_workers, i;
+
+    nb_threads = get_nb_threads(nb_threads);
+
+    /* main_func may wait on the jobs, which then need dedicated threads */
+    if (!main_func && nb_threads > 1) {
+        AVSliceThreadPool *pool = avpriv_slicethread_pool_get_shared();
+        if (pool) {
+            int ret = avpriv_slicethread_create_pooled(pctx, pool, priv,
+                                                       worker_func, nb_threads);
+            avpriv_slicethread_pool_unref(&pool);
+            return ret;
+        }
+    }
 
     nb_workers = nb_threads;
     if (!main_func)
@@ -170,6 +434,11 @@ void avpriv_slicethread_execute(AVSliceThread *ctx, int nb_jobs, int execute_mai
     int nb_workers, i, is_last = 0;
 
     av_assert0(nb_jobs > 0);
+    if (ctx->pool) {
+        pool_execute(ctx, nb_jobs);
+        return;
+    }
+
     ctx->nb_jobs           = nb_jobs;
     ctx->nb_active_threads = FFMIN(nb_jobs, ctx->nb_threads);
     atomic_store_explicit(&ctx->first_job, 0, memory_order_relaxed);
@@ -209,6 +478,14 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
         return;
 
     ctx = *pctx;
+    if (ctx->pool) {
+        avpriv_slicethread_pool_unref(&ctx->pool);
+        pthread_cond_destroy(&ctx->done_cond);
+        pthread_mutex_destroy(&ctx->done_mutex);
+        av_freep(pctx);
+        return;
+    }
+
     nb_workers = ctx->nb_threads;
     if (!ctx->main_func)
         nb_workers--;
@@ -256,4 +533,40 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
     av_assert0(!pctx || !*pctx);
 }
 
+int avpriv_slicethread_pool_create(AVSliceThreadPool **ppool, int nb_threads)
+{
+    *ppool = NULL;
+    return AVERROR(ENOSYS);
+}
+
+AVSliceThreadPool *avpriv_slicethread_pool_ref(AVSliceThreadPool *pool)
+{
+    av_assert0(0);
+    return NULL;
+}
+
+void avpriv_slicethread_pool_unref(AVSliceThreadPool **ppool)
+{
+    av_assert0(!ppool || !*ppool);
+}
+
+int avpriv_slicethread_create_pooled(AVSliceThread **pctx, AVSliceThreadPool *pool,
+                                     void *priv,
+                                     void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                                     int nb_threads)
+{
+    *pctx = NULL;
+    return AVERROR(ENOSYS);
+}
+
+AVSliceThreadPool *avpriv_slicethread_pool_get_shared(void)
+{
+    return NULL;
+}
+
+int av_thread_pool_set_shared(int nb_threads)
+{
+    return nb_threads ? AVERROR(ENOSYS) : 0;
+}
+
 #endif /* HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS32THREADS */
@@ -21,6 +21,14 @@
 
 typedef struct AVSliceThread AVSliceThread;
 
+/**
+ * A pool of worker threads shared by several slice threading contexts.
+ * Each execute call of an attached context runs on the calling thread plus
+ * however many pool threads are idle, up to the context's thread count.
+ * Idle pool threads pick the waiting contexts round-robin.
+ */
+typedef struct AVSliceThreadPool AVSliceThreadPool;
+
 /**
  * Create slice threading context.
  * @param pctx slice threading context returned here
@@ -35,6 +43,23 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
                               void (*main_func)(void *priv),
                               int nb_threads);
 
+/**
+ * Create a slice threading context running its jobs on pool.
+ * Jobs are started in increasing order and job 0 always runs on the calling
+ * thread with threadnr 0.
+ * @param pctx slice threading context returned here
+ * @param pool pool to attach to, a new reference is taken
+ * @param priv private pointer to be passed to callback function
+ * @param worker_func callback function to be executed
+ * @param nb_threads maximum number of threads working on one execute call,
+ *                   0 for automatic, must be >= 0
+ * @return return number of threads or negative AVERROR on failure
+ */
+int avpriv_slicethread_create_pooled(AVSliceThread **pctx, AVSliceThreadPool *pool,
+                                     void *priv,
+                                     void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                                     int nb_threads);
+
 /**
  * Execute slice threading.
  * @param ctx slice threading context
@@ -49,4 +74,30 @@ void avpriv_slicethread_execute(AVSliceThread *ctx, int nb_jobs, int execute_mai
  */
 void avpriv_slicethread_free(AVSliceThread **pctx);
 
+/**
+ * Create a pool of worker threads.
+ * @param ppool pool returned here, with one reference
+ * @param nb_threads number of threads, must be > 0
+ * @return 0 or negative AVERROR on failure
+ */
+int avpriv_slicethread_pool_create(AVSliceThreadPool **ppool, int nb_threads);
+
+/**
+ * Add a reference to pool.
+ * @return pool
+ */
+AVSliceThreadPool *avpriv_slicethread_pool_ref(AVSliceThreadPool *pool);
+
+/**
+ * Drop a reference to the pool, the threads are joined with the last one.
+ * @param ppool pointer to pool, set to NULL
+ */
+void avpriv_slicethread_pool_unref(AVSliceThreadPool **ppool);
+
+/**
+ * Get the process-wide pool enabled by av_thread_pool_set_shared().
+ * @return a new reference to the pool, NULL if it is disabled
+ */
+AVSliceThreadPool *avpriv_slicethread_pool_get_shared(void);
+
 #endif
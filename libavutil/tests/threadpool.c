@@ -0,0 +1,259 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Slice threading contexts sharing a worker pool. Check that all jobs run
+ * exactly once, that no context gets more threads than it asked for and
+ * the pool no more than it has, and that jobs waiting on other jobs, as WPP
+ * rows do, do not deadlock.
+ *
+ * First several contexts, each executed from its own thread, share the
+ * process-wide pool with fewer threads than any of them asks for. The pool
+ * is disabled and the contexts are freed while the others are still busy.
+ * Then a single context gets fewer threads than its pool has.
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/slicethread.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadpool.h"
+
+#define NB_JOBS    48
+#define NB_RUNS    16
+#define NB_CLIENTS 4
+
+typedef struct Client {
+    AVSliceThread  *thread;
+    pthread_t       caller;     ///< thread calling execute, set by itself
+    pthread_t       caller_id;  ///< the same, for joining it
+    int             index;
+    int             nb_threads;
+    int             dependent;  ///< job n waits until job n - 1 is done
+    int             nb_runs;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    int             job_started[NB_JOBS];
+    int             job_done[NB_JOBS];
+    atomic_int      job_runs[NB_JOBS];
+
+    atomic_int      running;
+    atomic_int      max_running;
+    atomic_int      bad_threadnr;
+} Client;
+
+static atomic_int pool_running;
+static atomic_int pool_max_running;
+
+static void update_max(atomic_int *max, int val)
+{
+    int cur = atomic_load(max);
+    while (val > cur && !atomic_compare_exchange_weak(max, &cur, val))
+        ;
+}
+
+static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    Client *c = priv;
+    int from_pool = !pthread_equal(pthread_self(), c->caller);
+
+    update_max(&c->max_running, atomic_fetch_add(&c->running, 1) + 1);
+    if (from_pool)
+        update_max(&pool_max_running, atomic_fetch_add(&pool_running, 1) + 1);
+    if (threadnr < 0 || threadnr >= nb_threads || nb_threads > c->nb_threads ||
+        (threadnr == 0) == from_pool)
+        atomic_store(&c->bad_threadnr, 1);
+
+    pthread_mutex_lock(&c->mutex);
+    c->job_started[jobnr] = 1;
+    pthread_cond_broadcast(&c->cond);
+    /* make sure a pool thread joins every execute call */
+    while (!jobnr && !c->job_started[1])
+        pthread_cond_wait(&c->cond, &c->mutex);
+    while (c->dependent && jobnr > 0 && !c->job_done[jobnr - 1])
+        pthread_cond_wait(&c->cond, &c->mutex);
+    pthread_mutex_unlock(&c->mutex);
+
+    atomic_fetch_add(&c->job_runs[jobnr], 1);
+
+    if (from_pool)
+        atomic_fetch_sub(&pool_running, 1);
+    atomic_fetch_sub(&c->running, 1);
+
+    pthread_mutex_lock(&c->mutex);
+    c->job_done[jobnr] = 1;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->mutex);
+}
+
+static void client_init(Client *c, int index, int nb_threads, int dependent, int nb_runs)
+{
+    c->index      = index;
+    c->nb_threads = nb_threads;
+    c->dependent  = dependent;
+    c->nb_runs    = nb_runs;
+    pthread_mutex_init(&c->mutex, NULL);
+    pthread_cond_init(&c->cond, NULL);
+}
+
+static void *client_main(void *arg)
+{
+    Client *c = arg;
+
+    c->caller = pthread_self();
+    for (int i = 0; i < c->nb_runs; i++) {
+        memset(c->job_started, 0, sizeof(c->job_started));
+        memset(c->job_done,    0, sizeof(c->job_done));
+        avpriv_slicethread_execute(c->thread, NB_JOBS, 0);
+    }
+    /* the others may still run on the pool */
+    avpriv_slicethread_free(&c->thread);
+
+    return NULL;
+}
+
+static int client_check(Client *c)
+{
+    int ret = 0;
+
+    for (int i = 0; i < NB_JOBS; i++) {
+        if (atomic_load(&c->job_runs[i]) != c->nb_runs) {
+            printf("client %d: job %d ran %d times instead of %d\n", c->index,
+                   i, atomic_load(&c->job_runs[i]), c->nb_runs);
+            ret = 1;
+            break;
+        }
+    }
+    if (atomic_load(&c->max_running) > c->nb_threads) {
+        printf("client %d: %d threads instead of at most %d\n", c->index,
+               atomic_load(&c->max_running), c->nb_threads);
+        ret = 1;
+    }
+    if (atomic_load(&c->bad_threadnr)) {
+        printf("client %d: invalid thread number\n", c->index);
+        ret = 1;
+    }
+
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->mutex);
+    return ret;
+}
+
+static int pool_check(int pool_threads)
+{
+    int max = atomic_load(&pool_max_running);
+
+    atomic_store(&pool_max_running, 0);
+    if (!max || max > pool_threads) {
+        printf("%d pool threads used instead of 1 to %d\n", max, pool_threads);
+        return 1;
+    }
+    return 0;
+}
+
+static int test_shared(int pool_threads, int client_threads)
+{
+    Client clients[NB_CLIENTS] = { 0 };
+    AVSliceThreadPool *pool;
+    int ret = 0;
+
+    if (av_thread_pool_set_shared(pool_threads) < 0)
+        return 1;
+
+    for (int i = 0; i < NB_CLIENTS; i++) {
+        Client *c = &clients[i];
+
+        /* the clients finish at different times */
+        client_init(c, i, client_threads, i & 1, NB_RUNS * (i + 1));
+        if (avpriv_slicethread_create(&c->thread, c, worker_func, NULL,
+                                      client_threads) != client_threads) {
+            printf("client %d: creating the context failed\n", i);
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < NB_CLIENTS; i++) {
+        if (pthread_create(&clients[i].caller_id, NULL, client_main, &clients[i])) {
+            printf("client %d: creating the thread failed\n", i);
+            return 1;
+        }
+    }
+
+    /* the attached contexts keep using the pool */
+    av_thread_pool_set_shared(0);
+
+    for (int i = 0; i < NB_CLIENTS; i++)
+        pthread_join(clients[i].caller_id, NULL);
+
+    for (int i = 0; i < NB_CLIENTS; i++)
+        ret |= client_check(&clients[i]);
+    ret |= pool_check(pool_threads);
+
+    pool = avpriv_slicethread_pool_get_shared();
+    if (pool) {
+        printf("shared pool still enabled\n");
+        avpriv_slicethread_pool_unref(&pool);
+        ret = 1;
+    }
+
+    printf("%d clients with %d threads each on %d shared pool threads: %s\n",
+           NB_CLIENTS, client_threads, pool_threads, ret ? "failed" : "ok");
+    return ret;
+}
+
+static int test_pooled(int pool_threads, int client_threads)
+{
+    Client client = { 0 };
+    AVSliceThreadPool *pool;
+    int ret;
+
+    if (avpriv_slicethread_pool_create(&pool, pool_threads) < 0)
+        return 1;
+
+    client_init(&client, 0, client_threads, 1, NB_RUNS);
+    ret = avpriv_slicethread_create_pooled(&client.thread, pool, &client,
+                                           worker_func, client_threads);
+    /* the context holds its own reference */
+    avpriv_slicethread_pool_unref(&pool);
+    if (ret != client_threads) {
+        printf("creating the context failed\n");
+        return 1;
+    }
+
+    client_main(&client);
+
+    ret  = client_check(&client);
+    ret |= pool_check(client_threads - 1);
+
+    printf("1 client with %d threads on %d pool threads: %s\n",
+           client_threads, pool_threads, ret ? "failed" : "ok");
+    return ret;
+}
+
+int main(void)
+{
+    int ret = 0;
+
+    ret |= test_shared(2, 4);
+    ret |= test_pooled(4, 2);
+
+    return ret;
+}
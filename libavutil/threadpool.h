@@ -0,0 +1,60 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_THREADPOOL_H
+#define AVUTIL_THREADPOOL_H
+
+/**
+ * @file
+ * @ingroup lavu_threadpool
+ * Process-wide worker thread pool
+ */
+
+/**
+ * @defgroup lavu_threadpool Thread pool
+ * @ingroup lavu_misc
+ *
+ * By default every slice threaded codec context, filter graph and scaler
+ * creates its own worker threads, so running many of them at once leads
+ * to far more threads than CPUs. Enabling the shared pool makes all of
+ * them created afterwards run their slice jobs on the calling thread plus
+ * one common set of worker threads, which caps the total number of
+ * workers. Idle workers serve the waiting clients round-robin, and each
+ * client never gets more workers than its own thread count allows.
+ *
+ * Frame threading is not affected, and neither are contexts created
+ * before the pool was enabled.
+ *
+ * @{
+ */
+
+/**
+ * Enable or disable the shared worker thread pool.
+ *
+ * @param nb_threads number of worker threads in the pool, 0 to disable it
+ *                   (the default)
+ * @return 0 on success, a negative AVERROR code on failure; AVERROR(ENOSYS)
+ *         if FFmpeg was built without threading support
+ */
+int av_thread_pool_set_shared(int nb_threads);
+
+/**
+ * @}
+ */
+
+#endif /* AVUTIL_THREADPOOL_H */
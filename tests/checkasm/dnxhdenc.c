@@ -0,0 +1,62 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "checkasm.h"
+
+#include "libavcodec/dnxhdenc.h"
+
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem_internal.h"
+
+#define SRC_STRIDE 64
+#define SRC_SIZE   (SRC_STRIDE * 4)
+
+static void check_get_pixels_8x4_sym(int bit_depth)
+{
+    LOCAL_ALIGNED_16(uint8_t, src, [SRC_SIZE]);
+    LOCAL_ALIGNED_16(int16_t, dst0, [64]);
+    LOCAL_ALIGNED_16(int16_t, dst1, [64]);
+    DNXHDEncContext ctx = { .bit_depth = bit_depth };
+    int i;
+
+    declare_func(void, int16_t *block, const uint8_t *pixels, ptrdiff_t line_size);
+
+    ff_dnxhdenc_init(&ctx);
+
+    if (check_func(ctx.get_pixels_8x4_sym, "get_pixels_8x4_sym_%d", bit_depth)) {
+        for (i = 0; i < SRC_SIZE; i += 4)
+            AV_WN32A(src + i, rnd());
+        memset(dst0, 0, 64 * sizeof(*dst0));
+        memset(dst1, 0, 64 * sizeof(*dst1));
+
+        call_ref(dst0, src, SRC_STRIDE);
+        call_new(dst1, src, SRC_STRIDE);
+        if (memcmp(dst0, dst1, 64 * sizeof(*dst0)))
+            fail();
+        bench_new(dst1, src, SRC_STRIDE);
+    }
+}
+
+void checkasm_check_dnxhdenc(void)
+{
+    check_get_pixels_8x4_sym(8);
+    check_get_pixels_8x4_sym(10);
+    report("get_pixels_8x4_sym");
+}
@@ -88,6 +88,91 @@ static void check_deblock_chroma(HEVCDSPContext *h, int bit_depth)
     }
 }
 
+#define LUMA_STRIDE  (16 * 2)
+#define LUMA_LINES   (24)
+#define LUMA_OFFSET  (LUMA_STRIDE * 8 + 8 * SIZEOF_PIXEL)
+#define LUMA_SIZE    (LUMA_STRIDE * LUMA_LINES)
+
+static void set_pixel(uint8_t *buf, int bit_depth, int idx, int val)
+{
+    val = av_clip(val, 0, (1 << bit_depth) - 1);
+    if (bit_depth > 8)
+        AV_WN16A(buf + 2 * idx, val);
+    else
+        buf[idx] = val;
+}
+
+/* Fill the buffers with a block whose edge at column/row 8 is either flat
+ * with a small step (strong filter), mildly noisy (normal filter) or random
+ * (mostly unfiltered), so that every filter decision gets exercised. */
+static void randomize_luma_buffers(uint8_t *buf0, uint8_t *buf1, int bit_depth,
+                                   int type, int vertical, int beta, int tc)
+{
+    const int width = LUMA_STRIDE / SIZEOF_PIXEL;
+    const int max   = (1 << bit_depth) - 1;
+    int base = rnd() & max;
+    int step = (int)(rnd() % (((tc * 5 + 1) >> 1) + 1)) * ((rnd() & 1) ? 1 : -1);
+    int amp;
+
+    switch (type) {
+    case 0:  amp = 1;               break;
+    case 1:  amp = (beta >> 3) + 1; break;
+    case 2:  amp = beta + 1;        break;
+    default: amp = max + 1;         break;
+    }
+
+    for (int y = 0; y < LUMA_LINES; y++) {
+        for (int x = 0; x < width; x++) {
+            int q   = vertical ? x >= 8 : y >= 8;
+            int val = base + (q ? step : 0) + (int)(rnd() % amp) - amp / 2;
+            if (type == 3)
+                val = rnd() & max;
+            set_pixel(buf0, bit_depth, y * width + x, val);
+        }
+    }
+    memcpy(buf1, buf0, LUMA_SIZE);
+}
+
+static void check_deblock_luma(HEVCDSPContext *h, int bit_depth)
+{
+    int32_t tc[2] = { 0, 0 };
+    // no_p, no_q are only used by the *_c variants, see chroma above
+    uint8_t no_p[2] = { 0, 0 };
+    uint8_t no_q[2] = { 0, 0 };
+    LOCAL_ALIGNED_32(uint8_t, buf0, [LUMA_SIZE]);
+    LOCAL_ALIGNED_32(uint8_t, buf1, [LUMA_SIZE]);
+
+    declare_func_emms(AV_CPU_FLAG_MMX, void, uint8_t *pix, ptrdiff_t stride, int beta,
+                      int32_t *tc, uint8_t *no_p, uint8_t *no_q);
+
+    for (int vertical = 0; vertical < 2; vertical++) {
+        void (*func)(uint8_t *, ptrdiff_t, int, const int32_t *, const uint8_t *, const uint8_t *) =
+            vertical ? h->hevc_v_loop_filter_luma : h->hevc_h_loop_filter_luma;
+
+        if (check_func(func, "hevc_%c_loop_filter_luma%d", vertical ? 'v' : 'h', bit_depth)) {
+            for (int i = 0; i < 32; i++) {
+                // see betatable[] and tctable[] in hevc_filter.c
+                int beta = rnd() % 65;
+                int scaled_beta;
+                tc[0] = rnd() % 25;
+                tc[1] = rnd() % 25;
+                scaled_beta = beta << (bit_depth - 8);
+                randomize_luma_buffers(buf0, buf1, bit_depth, i & 3, vertical,
+                                       scaled_beta, FFMAX(tc[0], tc[1]) << (bit_depth - 8));
+
+                call_ref(buf0 + LUMA_OFFSET, LUMA_STRIDE, beta, tc, no_p, no_q);
+                call_new(buf1 + LUMA_OFFSET, LUMA_STRIDE, beta, tc, no_p, no_q);
+                if (memcmp(buf0, buf1, LUMA_SIZE))
+                    fail();
+            }
+            randomize_luma_buffers(buf0, buf1, bit_depth, 1, vertical, 32 << (bit_depth - 8),
+                                   12 << (bit_depth - 8));
+            tc[0] = tc[1] = 12;
+            bench_new(buf1 + LUMA_OFFSET, LUMA_STRIDE, 32, tc, no_p, no_q);
+        }
+    }
+}
+
 void checkasm_check_hevc_deblock(void)
 {
     int bit_depth;
@@ -98,4 +183,11 @@ void checkasm_check_hevc_deblock(void)
         check_deblock_chroma(&h, bit_depth);
     }
     report("chroma");
+
+    for (bit_depth = 8; bit_depth <= 12; bit_depth += 2) {
+        HEVCDSPContext h;
+        ff_hevc_dsp_init(&h, bit_depth);
+        check_deblock_luma(&h, bit_depth);
+    }
+    report("luma");
 }
@@ -0,0 +1,155 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem_internal.h"
+
+#include "libavcodec/hevcdec.h"
+#include "libavcodec/hevcpred.h"
+
+#include "checkasm.h"
+
+/* the stride passed to the prediction functions is in pixels */
+#define PIXEL_STRIDE (MAX_TB_SIZE * 2)
+#define BUF_SIZE     (PIXEL_STRIDE * MAX_TB_SIZE * 2)
+/* top[-1] .. top[2 * MAX_TB_SIZE - 1], as set up by intra_pred() */
+#define NEIGHBOURS   (2 * MAX_TB_SIZE + 1)
+
+static void randomize_neighbours(uint8_t *buf, int bit_depth)
+{
+    int i;
+
+    if (bit_depth == 8) {
+        for (i = 0; i < NEIGHBOURS; i++)
+            buf[i] = rnd();
+    } else {
+        int mask = (1 << bit_depth) - 1;
+        for (i = 0; i < NEIGHBOURS; i++)
+            AV_WN16A(buf + i * 2, rnd() & mask);
+    }
+}
+
+static void check_pred_planar(HEVCPredContext *h, uint8_t *dst0, uint8_t *dst1,
+                              const uint8_t *top, const uint8_t *left, int bit_depth)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        int size = 4 << i;
+        declare_func(void, uint8_t *src, const uint8_t *top,
+                     const uint8_t *left, ptrdiff_t stride);
+
+        if (check_func(h->pred_planar[i], "hevc_pred_planar_%dx%d_%d", size, size, bit_depth)) {
+            memset(dst0, 0, BUF_SIZE);
+            memset(dst1, 0, BUF_SIZE);
+            call_ref(dst0, top, left, PIXEL_STRIDE);
+            call_new(dst1, top, left, PIXEL_STRIDE);
+            if (memcmp(dst0, dst1, BUF_SIZE))
+                fail();
+            bench_new(dst1, top, left, PIXEL_STRIDE);
+        }
+    }
+}
+
+static void check_pred_dc(HEVCPredContext *h, uint8_t *dst0, uint8_t *dst1,
+                          const uint8_t *top, const uint8_t *left, int bit_depth)
+{
+    int log2_size, c_idx;
+
+    for (log2_size = 2; log2_size <= 5; log2_size++) {
+        for (c_idx = 0; c_idx <= 1; c_idx++) {
+            int size = 1 << log2_size;
+            declare_func(void, uint8_t *src, const uint8_t *top,
+                         const uint8_t *left, ptrdiff_t stride,
+                         int log2_size, int c_idx);
+
+            if (check_func(h->pred_dc, "hevc_pred_dc_%dx%d_%s_%d", size, size,
+                           c_idx ? "chroma" : "luma", bit_depth)) {
+                memset(dst0, 0, BUF_SIZE);
+                memset(dst1, 0, BUF_SIZE);
+                call_ref(dst0, top, left, PIXEL_STRIDE, log2_size, c_idx);
+                call_new(dst1, top, left, PIXEL_STRIDE, log2_size, c_idx);
+                if (memcmp(dst0, dst1, BUF_SIZE))
+                    fail();
+                bench_new(dst1, top, left, PIXEL_STRIDE, log2_size, c_idx);
+            }
+        }
+    }
+}
+
+static void check_pred_angular(HEVCPredContext *h, uint8_t *dst0, uint8_t *dst1,
+                               const uint8_t *top, const uint8_t *left, int bit_depth)
+{
+    int i, dir, mode, c_idx;
+
+    for (i = 0; i < 4; i++) {
+        int size = 4 << i;
+        /* modes 2..17 predict from the left column, 18..34 from the top row */
+        for (dir = 0; dir <= 1; dir++) {
+            int first = dir ? 18 : 2;
+            int last  = dir ? 34 : 17;
+            declare_func(void, uint8_t *src, const uint8_t *top,
+                         const uint8_t *left, ptrdiff_t stride,
+                         int c_idx, int mode);
+
+            if (check_func(h->pred_angular[i], "hevc_pred_angular_%s_%dx%d_%d",
+                           dir ? "ver" : "hor", size, size, bit_depth)) {
+                for (mode = first; mode <= last; mode++) {
+                    for (c_idx = 0; c_idx <= 1; c_idx++) {
+                        memset(dst0, 0, BUF_SIZE);
+                        memset(dst1, 0, BUF_SIZE);
+                        call_ref(dst0, top, left, PIXEL_STRIDE, c_idx, mode);
+                        call_new(dst1, top, left, PIXEL_STRIDE, c_idx, mode);
+                        if (memcmp(dst0, dst1, BUF_SIZE))
+                            fail();
+                    }
+                }
+                bench_new(dst1, top, left, PIXEL_STRIDE, 1, dir ? 29 : 7);
+            }
+        }
+    }
+}
+
+void checkasm_check_hevc_pred(void)
+{
+    LOCAL_ALIGNED_32(uint8_t, dst0, [BUF_SIZE]);
+    LOCAL_ALIGNED_32(uint8_t, dst1, [BUF_SIZE]);
+    LOCAL_ALIGNED_32(uint8_t, top_array,  [NEIGHBOURS * 2]);
+    LOCAL_ALIGNED_32(uint8_t, left_array, [NEIGHBOURS * 2]);
+    int bit_depth;
+
+    for (bit_depth = 8; bit_depth <= 12; bit_depth += 2) {
+        int pixel_size = bit_depth > 8 ? 2 : 1;
+        const uint8_t *top  = top_array  + pixel_size;
+        const uint8_t *left = left_array + pixel_size;
+        HEVCPredContext h;
+
+        ff_hevc_pred_init(&h, bit_depth);
+        randomize_neighbours(top_array,  bit_depth);
+        randomize_neighbours(left_array, bit_depth);
+        /* top[-1] and left[-1] are the same corner sample */
+        memcpy(left_array, top_array, pixel_size);
+
+        check_pred_planar(&h, dst0, dst1, top, left, bit_depth);
+        check_pred_dc(&h, dst0, dst1, top, left, bit_depth);
+        check_pred_angular(&h, dst0, dst1, top, left, bit_depth);
+    }
+    report("pred");
+}
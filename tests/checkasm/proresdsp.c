@@ -0,0 +1,89 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "checkasm.h"
+
+#include "libavcodec/avcodec.h"
+#include "libavcodec/proresdsp.h"
+
+#include "libavutil/common.h"
+#include "libavutil/mem_internal.h"
+
+/* dst line size in pixels, wider than the block to catch overwrites */
+#define DST_STRIDE 16
+#define DST_SIZE   (DST_STRIDE * 8)
+
+/* Dequantized coefficients stay within what a valid stream produces:
+ * sparse AC, and rows holding only a DC coefficient. */
+static void randomize_block(int16_t *block, int16_t *qmat)
+{
+    int i;
+
+    for (i = 0; i < 64; i++) {
+        qmat[i]  = 1 + (rnd() & 15);
+        block[i] = !i || !(rnd() & 3) ? (int)(rnd() % 2047) - 1023 : 0;
+    }
+}
+
+static void check_idct_put(int bits)
+{
+    LOCAL_ALIGNED_16(int16_t, block,  [64]);
+    LOCAL_ALIGNED_16(int16_t, qmat,   [64]);
+    LOCAL_ALIGNED_16(int16_t, block0, [64]);
+    LOCAL_ALIGNED_16(int16_t, block1, [64]);
+    LOCAL_ALIGNED_16(int16_t, qmat1,  [64]);
+    LOCAL_ALIGNED_16(uint16_t, dst0,  [DST_SIZE]);
+    LOCAL_ALIGNED_16(uint16_t, dst1,  [DST_SIZE]);
+    AVCodecContext avctx = { .bits_per_raw_sample = bits };
+    ProresDSPContext dsp;
+    int i, j;
+
+    declare_func(void, uint16_t *out, ptrdiff_t linesize,
+                 int16_t *block, const int16_t *qmat);
+
+    ff_proresdsp_init(&dsp, &avctx);
+
+    if (check_func(dsp.idct_put, "prores_idct_put_%d", bits)) {
+        for (i = 0; i < 16; i++) {
+            randomize_block(block, qmat);
+            /* the C version uses no permutation */
+            memcpy(block0, block, 64 * sizeof(*block));
+            for (j = 0; j < 64; j++) {
+                block1[dsp.idct_permutation[j]] = block[j];
+                qmat1[dsp.idct_permutation[j]]  = qmat[j];
+            }
+            memset(dst0, 0, DST_SIZE * sizeof(*dst0));
+            memset(dst1, 0, DST_SIZE * sizeof(*dst1));
+
+            call_ref(dst0, DST_STRIDE * sizeof(*dst0), block0, qmat);
+            call_new(dst1, DST_STRIDE * sizeof(*dst1), block1, qmat1);
+            if (memcmp(dst0, dst1, DST_SIZE * sizeof(*dst0)))
+                fail();
+        }
+        bench_new(dst1, DST_STRIDE * sizeof(*dst1), block1, qmat1);
+    }
+}
+
+void checkasm_check_proresdsp(void)
+{
+    check_idct_put(10);
+    check_idct_put(12);
+    report("idct_put");
+}
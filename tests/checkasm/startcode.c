@@ -0,0 +1,94 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavutil/mem_internal.h"
+
+#include "libavcodec/defs.h"
+#include "libavcodec/startcode.h"
+
+#include "checkasm.h"
+
+#define BUF_SIZE 1024
+
+/* fill the buffer and its padding with non-zero bytes */
+static void randomize_buffer(uint8_t *buf)
+{
+    int i;
+
+    for (i = 0; i < BUF_SIZE + AV_INPUT_BUFFER_PADDING_SIZE; i++)
+        buf[i] = 1 + rnd() % 255;
+}
+
+/* scatter a few zero bytes or 00 00 xx sequences, including ones that
+ * straddle the end of the buffer */
+static void add_patterns(uint8_t *buf, int size, int escapes)
+{
+    int i, n = rnd() % 4;
+
+    for (i = 0; i < n; i++) {
+        int pos = rnd() % (size + 3);
+        buf[pos] = 0;
+        if (escapes) {
+            buf[pos + 1] = 0;
+            buf[pos + 2] = rnd() % 6;
+        }
+    }
+}
+
+static void check_find(int (*func)(const uint8_t *, int), const char *name,
+                       uint8_t *buf, int escapes)
+{
+    declare_func(int, const uint8_t *buf, int size);
+
+    if (check_func(func, "startcode_%s", name)) {
+        int i;
+
+        for (i = 0; i < 256; i++) {
+            int offset = rnd() % 32;
+            int size   = rnd() % (BUF_SIZE - 32 - 3);
+            int ref, new;
+
+            randomize_buffer(buf);
+            add_patterns(buf + offset, size, escapes);
+            ref = call_ref(buf + offset, size);
+            new = call_new(buf + offset, size);
+            if (ref != new) {
+                fail();
+                break;
+            }
+        }
+        randomize_buffer(buf);
+        bench_new(buf, BUF_SIZE);
+    }
+}
+
+void checkasm_check_startcode(void)
+{
+    LOCAL_ALIGNED_32(uint8_t, buf, [BUF_SIZE + AV_INPUT_BUFFER_PADDING_SIZE]);
+    StartCodeContext c;
+
+    ff_startcode_init(&c);
+
+    check_find(c.find_candidate, "find_candidate", buf, 0);
+    report("find_candidate");
+
+    check_find(c.find_escape, "find_escape", buf, 1);
+    report("find_escape");
+}
@@ -210,6 +210,24 @@ FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER) +=         \
                                                     $(HEVC_TESTS_422_10BIN) \
                                                     $(HEVC_TESTS_444_12BIT) \
 
+# WPP row threads, alone, with low delay and together with frame threads;
+# the output must match the plain conformance tests
+HEVC_SAMPLES_WPP_8BIT  := $(filter WPP_%_ericsson_MAIN_2,   $(HEVC_SAMPLES_8BIT))
+HEVC_SAMPLES_WPP_10BIT := $(filter WPP_%_ericsson_MAIN10_2, $(HEVC_SAMPLES_10BIT))
+
+define FATE_HEVC_WPP_SUITE
+fate-hevc-wpp-$(1):          CMD = framecrc -wpp_threads 4 -flags unaligned -i $(TARGET_SAMPLES)/hevc-conformance/$(1).bit $(2)
+fate-hevc-wpp-lowdelay-$(1): CMD = framecrc -wpp_threads 4 -flags unaligned+low_delay -i $(TARGET_SAMPLES)/hevc-conformance/$(1).bit $(2)
+fate-hevc-wpp-frame-$(1):    CMD = threads=4 thread_type=frame framecrc -wpp_threads 4 -flags unaligned -i $(TARGET_SAMPLES)/hevc-conformance/$(1).bit $(2)
+fate-hevc-wpp-$(1) fate-hevc-wpp-lowdelay-$(1) fate-hevc-wpp-frame-$(1): REF = $(SRC_PATH)/tests/ref/fate/hevc-conformance-$(1)
+FATE_HEVC_WPP += fate-hevc-wpp-$(1) fate-hevc-wpp-lowdelay-$(1) fate-hevc-wpp-frame-$(1)
+endef
+
+$(foreach N,$(HEVC_SAMPLES_WPP_8BIT),$(eval $(call FATE_HEVC_WPP_SUITE,$(N),-pix_fmt yuv420p)))
+$(foreach N,$(HEVC_SAMPLES_WPP_10BIT),$(eval $(call FATE_HEVC_WPP_SUITE,$(N),-pix_fmt yuv420p10le -vf scale)))
+
+FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER) += $(FATE_HEVC_WPP)
+
 fate-hevc-paramchange-yuv420p-yuv420p10: CMD = framecrc -vsync passthrough -i $(TARGET_SAMPLES)/hevc/paramchange_yuv420p_yuv420p10.hevc -sws_flags area+accurate_rnd+bitexact
 FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER LARGE_TESTS) += fate-hevc-paramchange-yuv420p-yuv420p10
 
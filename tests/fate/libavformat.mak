@@ -2,6 +2,15 @@
 #fate-async: libavformat/tests/async$(EXESUF)
 #fate-async: CMD = run libavformat/tests/async
 
+FATE_FILE_MMAP-$(call ALLYES, FILE_PROTOCOL RAWVIDEO_DEMUXER) += fate-file-mmap
+FATE_LIBAVFORMAT-$(HAVE_MMAP) += $(FATE_FILE_MMAP-yes)
+fate-file-mmap: libavformat/tests/file_mmap$(EXESUF) tests/data/vsynth1.yuv
+fate-file-mmap: CMD = run libavformat/tests/file_mmap$(EXESUF) $(TARGET_PATH)/tests/data/vsynth1.yuv
+
+FATE_LIBAVFORMAT-$(call ALLYES, FILE_PROTOCOL IMAGE_BMP_PIPE_DEMUXER BMP_DECODER) += fate-probecache
+fate-probecache: libavformat/tests/probecache$(EXESUF)
+fate-probecache: CMD = run libavformat/tests/probecache$(EXESUF) $(TARGET_PATH)/tests/data/probecache
+
 FATE_LIBAVFORMAT-$(CONFIG_NETWORK) += fate-noproxy
 fate-noproxy: libavformat/tests/noproxy$(EXESUF)
 fate-noproxy: CMD = run libavformat/tests/noproxy$(EXESUF)
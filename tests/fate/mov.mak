@@ -177,6 +177,34 @@ FATE_MOV_FFMPEG-$(call TRANSCODE, PCM_S16LE, MOV, WAV_DEMUXER PAN_FILTER) \
 fate-mov-mp4-pcm-float: tests/data/asynth-44100-1.wav
 fate-mov-mp4-pcm-float: CMD = transcode wav $(TARGET_PATH)/tests/data/asynth-44100-1.wav mp4 "-af aresample,pan=FL+LFE+BR|c0=c0|c1=c0|c2=c0 -c:a pcm_f32le" "-map 0 -c copy -frames:a 0"
 
+# Read and seek with the compact sample index and the on-demand fragment
+# index. The output must be the same as with the default full index.
+FATE_MOV_FFMPEG-$(call TRANSCODE, MPEG4 MP2, MOV, RAWVIDEO_DEMUXER WAV_DEMUXER) \
+                          += fate-mov-compact-index fate-mov-lazy-frag-index
+fate-mov-compact-index fate-mov-lazy-frag-index: tests/data/vsynth1.yuv tests/data/asynth-44100-2.wav
+fate-mov-compact-index fate-mov-lazy-frag-index: KEEP_FILES ?= 1
+fate-mov-compact-index: CMD = transcode rawvideo $(TARGET_PATH)/tests/data/vsynth1.yuv mov "-c:v mpeg4 -g 10 -qscale:v 10 -c:a mp2 -b:a 64k -use_editlist 0" "-c copy" "" "-i $(TARGET_PATH)/tests/data/asynth-44100-2.wav" "-compact_index 1" "-s 352x288"
+fate-mov-lazy-frag-index: CMD = transcode rawvideo $(TARGET_PATH)/tests/data/vsynth1.yuv mp4 "-c:v mpeg4 -g 10 -qscale:v 10 -c:a mp2 -b:a 64k -movflags frag_keyframe+empty_moov" "-c copy" "" "-i $(TARGET_PATH)/tests/data/asynth-44100-2.wav" "-lazy_frag_index 1" "-s 352x288"
+
+FATE_MOV_FFMPEG-$(call TRANSCODE, MPEG4 MP2, MOV, RAWVIDEO_DEMUXER WAV_DEMUXER) \
+                          += fate-mov-compact-index-seek fate-mov-lazy-frag-index-seek
+fate-mov-compact-index-seek fate-mov-lazy-frag-index-seek: libavformat/tests/seek$(EXESUF)
+fate-mov-compact-index-seek: fate-mov-compact-index
+fate-mov-compact-index-seek: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/fate/mov-compact-index.mov -compact_index 1
+fate-mov-lazy-frag-index-seek: fate-mov-lazy-frag-index
+fate-mov-lazy-frag-index-seek: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/fate/mov-lazy-frag-index.mp4 -lazy_frag_index 1
+
+# Reserve space for the moov atom in front of the mdat with faststart. The
+# estimate does not account for per-stream metadata, so a long track title
+# makes it too small and the muxer falls back to moving the moov atom.
+MOV_RESERVE_MOOV_TITLE = $(shell printf '%016384d' 0)
+
+FATE_MOV_FFMPEG-$(call TRANSCODE, MPEG4 MP2, MOV, RAWVIDEO_DEMUXER WAV_DEMUXER) \
+                          += fate-mov-reserve-moov fate-mov-reserve-moov-fallback
+fate-mov-reserve-moov fate-mov-reserve-moov-fallback: tests/data/vsynth1.yuv tests/data/asynth-44100-2.wav
+fate-mov-reserve-moov: CMD = transcode rawvideo $(TARGET_PATH)/tests/data/vsynth1.yuv mov "-c:v mpeg4 -g 10 -qscale:v 10 -c:a mp2 -b:a 64k -movflags +faststart+reserve_moov" "-c copy" "" "-i $(TARGET_PATH)/tests/data/asynth-44100-2.wav" "" "-s 352x288"
+fate-mov-reserve-moov-fallback: CMD = transcode rawvideo $(TARGET_PATH)/tests/data/vsynth1.yuv mov "-c:v mpeg4 -g 10 -qscale:v 10 -c:a mp2 -b:a 64k -metadata:s:v title=$(MOV_RESERVE_MOOV_TITLE) -movflags +faststart+reserve_moov" "-c copy" "" "-i $(TARGET_PATH)/tests/data/asynth-44100-2.wav" "" "-s 352x288"
+
 FATE_FFMPEG += $(FATE_MOV_FFMPEG-yes)
 
 fate-mov: $(FATE_MOV) $(FATE_MOV_FFMPEG-yes) $(FATE_MOV_FFPROBE) $(FATE_MOV_FASTSTART) $(FATE_MOV_FFMPEG_FFPROBE-yes)
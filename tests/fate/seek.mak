@@ -178,6 +178,14 @@ FATE_SEEK_LAVF_IMAGE2PIPE := $(filter $(subst fate-,fate-seek-,$(FATE_LAVF_IMAGE
 $(FATE_SEEK_LAVF_IMAGE2PIPE): SRC = lavf/$(@:fate-seek-lavf-%pipe=%)pipe.$(@:fate-seek-lavf-%pipe=%)
 FATE_SEEK += $(FATE_SEEK_LAVF_IMAGE2PIPE)
 
+# the same files read through the file protocol readahead, which must not
+# change the results
+
+FATE_SEEK_READAHEAD := $(filter fate-seek-lavf-mkv fate-seek-lavf-mov fate-seek-lavf-nut, $(FATE_SEEK_LAVF_CONTAINER))
+FATE_SEEK_READAHEAD := $(FATE_SEEK_READAHEAD:fate-seek-lavf-%=fate-seek-readahead-lavf-%)
+$(FATE_SEEK_READAHEAD): fate-seek-readahead-lavf-%: fate-lavf-% libavformat/tests/seek$(EXESUF)
+$(FATE_SEEK_READAHEAD): CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.$(@:fate-seek-readahead-lavf-%=%) -readahead 4 -readahead_size 4096
+$(FATE_SEEK_READAHEAD): REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-readahead-%=%)
 # extra files
 
 FATE_SEEK_EXTRA-$(CONFIG_MP3_DEMUXER)   += fate-seek-extra-mp3
@@ -205,6 +213,6 @@ $(FATE_SEEK) $(FATE_SAMPLES_SEEK): fate-seek-%: fate-%
 $(subst fate-seek-,fate-,$(FATE_SAMPLES_SEEK) $(FATE_SEEK)): KEEP_FILES ?= 1
 fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
-FATE_AVCONV += $(FATE_SEEK)
+FATE_AVCONV += $(FATE_SEEK) $(FATE_SEEK_READAHEAD)
 FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
-fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
+fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_READAHEAD)
@@ -0,0 +1,165 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Send datagrams to a multicast group through the UDP protocol and receive
+ * them back in the same process, reporting the throughput and the CPU time
+ * used on both ends, e.g.:
+ *
+ *   udp_bench -n 200000 -b 32 -g 239.255.0.1:1234
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#if HAVE_GETRUSAGE
+#include <sys/resource.h>
+#endif
+
+#include "libavutil/intreadwrite.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+#include "libavformat/avformat.h"
+
+typedef struct RecvContext {
+    AVIOContext *pb;
+    int64_t nb_packets;
+    int64_t nb_bytes;
+} RecvContext;
+
+static int usage(const char *argv0, int ret)
+{
+    fprintf(stderr, "%s [-n packets] [-s pkt_size] [-b batch] [-g] [-f fifo_size] [group:port]\n", argv0);
+    fprintf(stderr, "-b sets the batch option on both ends, -g enables gso on the sender\n");
+    return ret;
+}
+
+static int64_t cpu_time(void)
+{
+#if HAVE_GETRUSAGE
+    struct rusage rusage;
+
+    getrusage(RUSAGE_SELF, &rusage);
+    return (rusage.ru_utime.tv_sec + rusage.ru_stime.tv_sec) * 1000000LL +
+           rusage.ru_utime.tv_usec + rusage.ru_stime.tv_usec;
+#else
+    return 0;
+#endif
+}
+
+static void *receiver(void *arg)
+{
+    RecvContext *r = arg;
+    uint8_t buf[65536];
+    int ret;
+
+    while ((ret = avio_read_partial(r->pb, buf, sizeof(buf))) >= 0) {
+        r->nb_packets++;
+        r->nb_bytes += ret;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int64_t nb_packets = 100000, start, cpu_start, elapsed, cpu;
+    int pkt_size = 1316, batch = 1, gso = 0, fifo_size = 7 * 4096, ret, i;
+    const char *group = "239.255.0.1:1234";
+    char url[256], errbuf[50];
+    AVDictionary *in_opts = NULL, *out_opts = NULL;
+    AVIOContext *output;
+    RecvContext r = { 0 };
+    pthread_t thread;
+    uint8_t *pkt;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            nb_packets = strtoll(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            pkt_size = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            batch = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            fifo_size = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-g")) {
+            gso = 1;
+        } else if (argv[i][0] != '-') {
+            group = argv[i];
+        } else {
+            return usage(argv[0], 1);
+        }
+    }
+    if (nb_packets <= 0 || pkt_size <= 0 || pkt_size > 65507 || batch <= 0)
+        return usage(argv[0], 1);
+
+    pkt = calloc(1, pkt_size);
+    if (!pkt)
+        return 1;
+
+    avformat_network_init();
+
+    av_dict_set_int(&in_opts,  "batch",            batch,     0);
+    av_dict_set_int(&in_opts,  "fifo_size",        fifo_size, 0);
+    av_dict_set_int(&in_opts,  "overrun_nonfatal", 1,         0);
+    av_dict_set_int(&in_opts,  "timeout",          500000,    0);
+    av_dict_set_int(&out_opts, "batch",            batch,     0);
+    av_dict_set_int(&out_opts, "gso",              gso,       0);
+    av_dict_set_int(&out_opts, "pkt_size",         pkt_size,  0);
+    av_dict_set_int(&out_opts, "buffer_size",      4 << 20,   0);
+
+    snprintf(url, sizeof(url), "udp://%s", group);
+    ret = avio_open2(&r.pb, url, AVIO_FLAG_READ, NULL, &in_opts);
+    if (ret >= 0)
+        ret = avio_open2(&output, url, AVIO_FLAG_WRITE, NULL, &out_opts);
+    if (ret < 0) {
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        fprintf(stderr, "Unable to open %s: %s\n", url, errbuf);
+        return 1;
+    }
+    if (pthread_create(&thread, NULL, receiver, &r)) {
+        fprintf(stderr, "Unable to start the receiver\n");
+        return 1;
+    }
+
+    start     = av_gettime_relative();
+    cpu_start = cpu_time();
+    for (i = 0; i < nb_packets; i++) {
+        AV_WN32(pkt, i);
+        avio_write(output, pkt, pkt_size);
+    }
+    avio_closep(&output);
+    pthread_join(thread, NULL);
+    /* the receiver stops after a 0.5 s timeout */
+    elapsed = av_gettime_relative() - start - 500000;
+    cpu     = cpu_time() - cpu_start;
+    avio_closep(&r.pb);
+
+    printf("sent %"PRId64" packets of %d bytes, received %"PRId64" (%"PRId64" bytes)\n",
+           nb_packets, pkt_size, r.nb_packets, r.nb_bytes);
+    printf("%.1f Mbit/s, %.3f s CPU time, %.2f us CPU per packet\n",
+           r.nb_bytes * 8.0 / FFMAX(elapsed, 1), cpu / 1000000.0,
+           (double)cpu / FFMAX(r.nb_packets, 1));
+
+    av_dict_free(&in_opts);
+    av_dict_free(&out_opts);
+    free(pkt);
+    avformat_network_deinit();
+    return 0;
+}